@@ -0,0 +1,247 @@
+#include "cpu_tracer.h"
+
+#include <benchmark/benchmark.h>
+
+#include <vector>
+
+#ifdef __linux__
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+using namespace cpu;
+
+// Deterministic inputs shared by the kernel benchmarks; cycling through a
+// table keeps the branch predictor from learning a single ray.
+static const int kTableSize = 1024;
+
+static std::vector<Ray> make_rays() {
+  std::vector<Ray> rays;
+  Vec3 position = {0.0f, 0.5f, 3.0f};
+  Vec3 direction = {0.0f, 0.0f, -1.0f};
+  for (int i = 0; i < kTableSize; ++i) {
+    rays.push_back(camera_ray(position, direction, 45.0f, i % 32, i / 32, 32,
+                              kTableSize / 32));
+  }
+  return rays;
+}
+
+static std::vector<HitRecord> make_hits(const Scene &scene, int type) {
+  std::vector<HitRecord> hits;
+  for (const Ray &ray : make_rays()) {
+    HitRecord record;
+    if (hit_scene(scene, ray, 0.001f, record)) {
+      record.material.type = type;
+      record.material.roughness = type == MAT_METAL ? 0.3f : 0.0f;
+      record.material.ior = 1.5f;
+      hits.push_back(record);
+    }
+  }
+  return hits;
+}
+
+// Hardware cache misses of this thread while a benchmark loop runs, read
+// through perf_event_open. Where the kernel does not expose the counter
+// (other platforms, perf_event_paranoid, most VMs) the benchmark simply
+// reports no cache-miss column.
+class CacheMissCounter {
+public:
+  CacheMissCounter() {
+#ifdef __linux__
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = PERF_COUNT_HW_CACHE_MISSES;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    fd = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    if (fd >= 0) {
+      ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+      ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+#endif
+  }
+  ~CacheMissCounter() {
+#ifdef __linux__
+    if (fd >= 0)
+      close(fd);
+#endif
+  }
+
+  // Adds the misses per ray as a counter, when they could be counted.
+  void report(benchmark::State &state, long rays) const {
+#ifdef __linux__
+    long long misses = 0;
+    if (fd < 0 || rays == 0 || read(fd, &misses, sizeof(misses)) !=
+                                   (ssize_t)sizeof(misses))
+      return;
+    state.counters["misses/ray"] = (double)misses / (double)rays;
+#else
+    (void)state;
+    (void)rays;
+#endif
+  }
+
+private:
+  int fd = -1;
+};
+
+static Vec2 rnd_state(int i) {
+  return {(float)(i % 97) * 0.173f, (float)(i % 89) * 0.311f};
+}
+
+static void BM_HitSphere(benchmark::State &state) {
+  Scene scene = default_scene();
+  std::vector<Ray> rays = make_rays();
+  int i = 0;
+  for (auto _ : state) {
+    HitRecord record;
+    float t;
+    bool hit = hit_sphere(scene.spheres[0], scene.materials[0],
+                          rays[i++ % kTableSize], 0.001f, kFltMax, t, record);
+    benchmark::DoNotOptimize(hit);
+    benchmark::DoNotOptimize(record);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_HitSphere);
+
+static void BM_HitPlane(benchmark::State &state) {
+  Scene scene = default_scene();
+  std::vector<Ray> rays = make_rays();
+  int i = 0;
+  for (auto _ : state) {
+    HitRecord record;
+    float t;
+    bool hit = hit_plane(scene.plane, scene.plane_material,
+                         rays[i++ % kTableSize], 0.001f, kFltMax, t, record);
+    benchmark::DoNotOptimize(hit);
+    benchmark::DoNotOptimize(record);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_HitPlane);
+
+static void BM_Schlick(benchmark::State &state) {
+  int i = 0;
+  for (auto _ : state) {
+    float cosine = (float)(i++ % kTableSize) / (float)kTableSize;
+    benchmark::DoNotOptimize(schlick(cosine, 1.0f / 1.5f));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_Schlick);
+
+static void BM_RandomInUnitSphere(benchmark::State &state) {
+  int i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(random_in_unit_sphere(rnd_state(i++)));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_RandomInUnitSphere);
+
+// Arg: material type, so the scatter_* family shows up side by side.
+static void BM_Scatter(benchmark::State &state) {
+  int type = (int)state.range(0);
+  Scene scene = default_scene();
+  std::vector<Ray> rays = make_rays();
+  std::vector<HitRecord> hits = make_hits(scene, type);
+  size_t i = 0;
+  for (auto _ : state) {
+    const HitRecord &record = hits[i % hits.size()];
+    Vec3 attenuation;
+    Ray scattered;
+    bool ok = scatter(rays[i % kTableSize], record, attenuation, scattered,
+                      rnd_state((int)i));
+    benchmark::DoNotOptimize(ok);
+    benchmark::DoNotOptimize(scattered);
+    i += 1;
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.SetLabel(type == MAT_LAMBERT ? "lambert"
+                 : type == MAT_METAL ? "metal"
+                                     : "dielectric");
+}
+BENCHMARK(BM_Scatter)->Arg(MAT_LAMBERT)->Arg(MAT_METAL)->Arg(MAT_DIELECTRIC);
+
+// Full paths for a small image. Arg: spheres per side of the grid scene, or 0
+// for the default four-sphere scene.
+static void BM_Trace(benchmark::State &state) {
+  int grid = (int)state.range(0);
+  Scene scene = grid == 0 ? default_scene() : sphere_grid_scene(grid);
+  const int width = 64;
+  const int height = 36;
+  Vec3 position = {0.0f, 0.5f, 3.0f};
+  Vec3 direction = {0.0f, 0.0f, -1.0f};
+
+  float frame = 1.0f;
+  long rays = 0;
+  CacheMissCounter misses;
+  for (auto _ : state) {
+    for (int y = 0; y < height; ++y) {
+      for (int x = 0; x < width; ++x) {
+        Ray ray = camera_ray(position, direction, 45.0f, x, y, width, height);
+        Vec2 rnd = {(x + 0.5f) / width * frame, (y + 0.5f) / height * frame};
+        benchmark::DoNotOptimize(trace(scene, ray, rnd, &rays));
+      }
+    }
+    frame += 1.0f;
+  }
+
+  // Items are paths; rays/s counts every segment and shadow ray.
+  state.SetItemsProcessed(state.iterations() * width * height);
+  state.counters["rays/s"] =
+      benchmark::Counter((double)rays, benchmark::Counter::kIsRate);
+  misses.report(state, rays);
+}
+BENCHMARK(BM_Trace)->Arg(0)->Arg(4)->Arg(8)->Unit(benchmark::kMillisecond);
+
+// The same image as BM_Trace through trace_stream(). Args: spheres per side
+// of the grid scene (0 for the default scene), then 1 to sort secondary rays.
+static void BM_TraceStream(benchmark::State &state) {
+  int grid = (int)state.range(0);
+  bool sort_rays = state.range(1) != 0;
+  Scene scene = grid == 0 ? default_scene() : sphere_grid_scene(grid);
+  const int width = 64;
+  const int height = 36;
+  Vec3 position = {0.0f, 0.5f, 3.0f};
+  Vec3 direction = {0.0f, 0.0f, -1.0f};
+
+  std::vector<Ray> rays_in;
+  for (int y = 0; y < height; ++y)
+    for (int x = 0; x < width; ++x)
+      rays_in.push_back(
+          camera_ray(position, direction, 45.0f, x, y, width, height));
+  std::vector<Vec2> rnd(rays_in.size());
+  std::vector<Vec3> radiance;
+
+  float frame = 1.0f;
+  long rays = 0;
+  CacheMissCounter misses;
+  for (auto _ : state) {
+    for (int y = 0; y < height; ++y)
+      for (int x = 0; x < width; ++x)
+        rnd[y * width + x] = {(x + 0.5f) / width * frame,
+                              (y + 0.5f) / height * frame};
+    trace_stream(scene, rays_in, rnd, sort_rays, radiance, &rays);
+    benchmark::DoNotOptimize(radiance.data());
+    frame += 1.0f;
+  }
+
+  state.SetItemsProcessed(state.iterations() * width * height);
+  state.counters["rays/s"] =
+      benchmark::Counter((double)rays, benchmark::Counter::kIsRate);
+  misses.report(state, rays);
+  state.SetLabel(sort_rays ? "sorted" : "unsorted");
+}
+BENCHMARK(BM_TraceStream)
+    ->ArgsProduct({{0, 4, 8}, {0, 1}})
+    ->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,57 @@
+# Script mode: writes the instruction count of one shader variant,
+#
+#   cmake -DSPIRV_DIS=... -DVARIANT=... -DINPUT=<spv> [-DOPTIMIZED=<spv>]
+#         -DOUTPUT=<txt> -P ShaderReport.cmake
+#
+# or merges the given per-variant reports into a summary and prints it.
+#
+#   cmake -DREPORTS=<txt>,<txt>,... -DOUTPUT=<txt> -P ShaderReport.cmake
+
+if(REPORTS)
+  string(REPLACE "," ";" reports "${REPORTS}")
+  set(summary "")
+  foreach(report IN LISTS reports)
+    file(READ ${report} content)
+    string(APPEND summary "${content}")
+  endforeach()
+  file(WRITE ${OUTPUT} "${summary}")
+  message("Shader instruction counts:\n${summary}")
+  return()
+endif()
+
+# Counts instructions inside function bodies, which is what the driver ends up
+# compiling; names, decorations and type declarations are left out.
+function(count_instructions spv out_var)
+  execute_process(
+    COMMAND ${SPIRV_DIS} --no-header --no-color ${spv}
+    OUTPUT_VARIABLE disassembly
+    RESULT_VARIABLE result)
+  if(NOT result EQUAL 0)
+    message(FATAL_ERROR "spirv-dis failed on ${spv}")
+  endif()
+
+  string(REPLACE "\n" ";" lines "${disassembly}")
+  set(count 0)
+  set(in_function FALSE)
+  foreach(line IN LISTS lines)
+    if(line MATCHES "OpFunctionEnd")
+      set(in_function FALSE)
+    elseif(line MATCHES "= OpFunction ")
+      set(in_function TRUE)
+    elseif(in_function AND line MATCHES "Op[A-Z]" AND
+           NOT line MATCHES "OpLabel|OpLine|OpNoLine|OpFunctionParameter")
+      math(EXPR count "${count} + 1")
+    endif()
+  endforeach()
+  set(${out_var} ${count} PARENT_SCOPE)
+endfunction()
+
+count_instructions(${INPUT} unoptimized)
+set(line "${VARIANT}: ${unoptimized} instructions")
+
+if(OPTIMIZED)
+  count_instructions(${OPTIMIZED} optimized)
+  set(line "${line}, ${optimized} after spirv-opt")
+endif()
+
+file(WRITE ${OUTPUT} "${line}\n")
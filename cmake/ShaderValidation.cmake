@@ -0,0 +1,113 @@
+# Offline shader validation.
+#
+# Every shader variant is compiled with glslang, optimized with spirv-opt and,
+# when spirv-cross is available, translated back to GLSL 410 so drivers can be
+# handed pre-optimized code. A per-variant instruction count report is written
+# to ${CMAKE_BINARY_DIR}/shader_report.txt. Any compile error fails the build.
+
+find_program(GLSLANG_VALIDATOR NAMES glslangValidator glslang)
+find_program(SPIRV_OPT spirv-opt)
+find_program(SPIRV_CROSS spirv-cross)
+find_program(SPIRV_DIS spirv-dis)
+
+set(SHADER_BUILD_DIR ${CMAKE_BINARY_DIR}/shader_build)
+set(SHADER_REPORT_DIR ${SHADER_BUILD_DIR}/reports)
+set(SHADER_OPTIMIZED_DIR ${SHADER_OUTPUT_DIR}/optimized)
+set_property(GLOBAL PROPERTY SHADER_VARIANT_OUTPUTS "")
+set_property(GLOBAL PROPERTY SHADER_VARIANT_REPORTS "")
+
+# add_shader_variant(<name> <stage> <source> [DEFINES def...])
+#   <stage> is a glslang stage name (vert, frag).
+function(add_shader_variant name stage source)
+  cmake_parse_arguments(ARG "" "" "DEFINES" ${ARGN})
+
+  set(define_flags "")
+  foreach(define IN LISTS ARG_DEFINES)
+    list(APPEND define_flags "-D${define}")
+  endforeach()
+
+  set(spv ${SHADER_BUILD_DIR}/${name}.spv)
+  set(outputs ${spv})
+
+  # GL_ARB_gl_spirv needs GLSL 4.50 semantics and explicit locations; the
+  # sources stay at 410 for macOS, so override both for the offline pass.
+  add_custom_command(
+    OUTPUT ${spv}
+    COMMAND ${CMAKE_COMMAND} -E make_directory ${SHADER_BUILD_DIR}
+    COMMAND ${GLSLANG_VALIDATOR} -G --glsl-version 450
+            --auto-map-locations --auto-map-bindings
+            -S ${stage} ${define_flags} -o ${spv} ${source}
+    DEPENDS ${source}
+    COMMENT "Validating shader variant ${name}"
+    VERBATIM)
+
+  if(SPIRV_OPT)
+    set(opt_spv ${SHADER_BUILD_DIR}/${name}.opt.spv)
+    add_custom_command(
+      OUTPUT ${opt_spv}
+      COMMAND ${SPIRV_OPT} -O ${spv} -o ${opt_spv}
+      DEPENDS ${spv}
+      COMMENT "Optimizing shader variant ${name}"
+      VERBATIM)
+    list(APPEND outputs ${opt_spv})
+
+    if(SPIRV_CROSS)
+      set(opt_glsl ${SHADER_OPTIMIZED_DIR}/${name}.${stage})
+      add_custom_command(
+        OUTPUT ${opt_glsl}
+        COMMAND ${CMAKE_COMMAND} -E make_directory ${SHADER_OPTIMIZED_DIR}
+        COMMAND ${SPIRV_CROSS} --version 410 --no-es ${opt_spv}
+                --output ${opt_glsl}
+        DEPENDS ${opt_spv}
+        COMMENT "Emitting optimized GLSL for ${name}"
+        VERBATIM)
+      list(APPEND outputs ${opt_glsl})
+    endif()
+  else()
+    set(opt_spv "")
+  endif()
+
+  if(SPIRV_DIS)
+    set(report ${SHADER_REPORT_DIR}/${name}.txt)
+    add_custom_command(
+      OUTPUT ${report}
+      COMMAND ${CMAKE_COMMAND} -E make_directory ${SHADER_REPORT_DIR}
+      COMMAND ${CMAKE_COMMAND}
+              -DSPIRV_DIS=${SPIRV_DIS}
+              -DVARIANT=${name}
+              -DINPUT=${spv}
+              -DOPTIMIZED=${opt_spv}
+              -DOUTPUT=${report}
+              -P ${CMAKE_SOURCE_DIR}/cmake/ShaderReport.cmake
+      DEPENDS ${spv} ${opt_spv} ${CMAKE_SOURCE_DIR}/cmake/ShaderReport.cmake
+      VERBATIM)
+    list(APPEND outputs ${report})
+    set_property(GLOBAL APPEND PROPERTY SHADER_VARIANT_REPORTS ${report})
+  endif()
+
+  set_property(GLOBAL APPEND PROPERTY SHADER_VARIANT_OUTPUTS ${outputs})
+endfunction()
+
+# Collects all variants into the validate_shaders target.
+function(finalize_shader_validation)
+  get_property(outputs GLOBAL PROPERTY SHADER_VARIANT_OUTPUTS)
+  get_property(reports GLOBAL PROPERTY SHADER_VARIANT_REPORTS)
+
+  set(summary ${CMAKE_BINARY_DIR}/shader_report.txt)
+  if(reports)
+    # Only the variants registered now: reports left in the directory by
+    # variants that were since removed must not reach the summary.
+    string(REPLACE ";" "," reports_arg "${reports}")
+    add_custom_command(
+      OUTPUT ${summary}
+      COMMAND ${CMAKE_COMMAND}
+              -DREPORTS=${reports_arg}
+              -DOUTPUT=${summary}
+              -P ${CMAKE_SOURCE_DIR}/cmake/ShaderReport.cmake
+      DEPENDS ${reports}
+      VERBATIM)
+    list(APPEND outputs ${summary})
+  endif()
+
+  add_custom_target(validate_shaders ALL DEPENDS ${outputs})
+endfunction()
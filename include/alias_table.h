@@ -0,0 +1,10 @@
+#pragma once
+
+// Vose's alias method over n weights: drawing slot i uniformly and keeping
+// it with probability threshold[i], or taking alias[i] otherwise, picks
+// every slot in proportion to its weight in O(1). Results are written to
+// threshold[i * stride] and alias[i * stride], the alias as a float index,
+// so callers can interleave them with other per-slot data. All-zero weights
+// give a uniform table.
+void build_alias_table(const double *weights, int n, float *threshold,
+                       float *alias, int stride);
@@ -5,11 +5,117 @@
 #define GLFW_INCLUDE_NONE
 #include <GLFW/glfw3.h>
 
+#include "benchmark.h"
+#include "denoiser.h"
+#include "dynamic_resolution.h"
+#include "environment_map.h"
+#include "frame_telemetry.h"
+#include "ggx_albedo.h"
+#include "gpu_timer.h"
+#include "profiler.h"
+#include "render_target.h"
+#include "scene.h"
+#include "scene_gpu.h"
 #include "shader.h"
+#include "texture_array.h"
+#include "thread_pool.h"
+#include "tile_scheduler.h"
+
+#include <stdlib.h>
+#include <string>
+
+// Exit status when no window or GL context can be created, the automake
+// "skipped" code, so CTest reports the image regression test as skipped on
+// machines without a display instead of failing it.
+const int kExitNoContext = 77;
+
+struct AppOptions {
+  // JSON scene; its compiled .rtsb cache is written alongside it.
+  std::string scene_path = "scenes/default.json";
+
+  // Written as <prefix>.csv and <prefix>.json on exit when non-empty.
+  std::string telemetry_path;
+
+  // Replays a camera script with fixed seeds and prints throughput/hashes.
+  std::string benchmark_script;
+
+  // Samples the camera while flying and saves it as a benchmark script.
+  std::string record_path;
+
+  // Image regression (benchmark runs only): save the final frame as EXR, or
+  // compare it against a golden EXR and exit non-zero above the threshold.
+  std::string save_image_path;
+  std::string compare_image_path;
+  float rmse_threshold = 0.01f;
+
+  // Chrome trace-event file of CPU/GPU frame phases, written on exit.
+  std::string trace_path;
+
+  // Keep the window hidden, e.g. for unattended runs under llvmpipe.
+  bool headless = false;
+};
+
+// Uniform handles for the trace program, resolved once after link.
+struct TraceUniforms {
+  UniformHandle time;
+  UniformHandle resolution;
+  UniformHandle camera_position;
+  UniformHandle camera_direction;
+  UniformHandle camera_fov;
+  UniformHandle sun_direction;
+  UniformHandle sun_color;
+  UniformHandle sun_intensity;
+  UniformHandle sun_angular_radius;
+  UniformHandle sky_color;
+  UniformHandle sky_intensity;
+  UniformHandle env_enabled;
+  UniformHandle env_map;
+  UniformHandle env_distribution;
+  UniformHandle env_cells;
+  UniformHandle ggx_albedo;
+  UniformHandle ggx_dielectric_albedo;
+  UniformHandle textures;
+  UniformHandle texture_layers;
+  UniformHandle interleave;
+  UniformHandle interleave_phase;
+  UniformHandle samples_per_pixel;
+  UniformHandle pixel_filter;
+  UniformHandle primary_pass;
+  UniformHandle primary_cached;
+  UniformHandle primary_layer;
+  UniformHandle primary_layers;
+  UniformHandle primary_point;
+  UniformHandle primary_normal;
+  UniformHandle primary_surface;
+  UniformHandle scene;
+  UniformHandle scene_sections;
+  UniformHandle num_planes;
+  UniformHandle num_instances;
+  UniformHandle num_lights;
+
+  void resolve(const Shader &shader);
+};
+
+// Uniform handles for the temporal accumulation pass.
+struct TemporalUniforms {
+  UniformHandle current;
+  UniformHandle gbuffer;
+  UniformHandle prev_gbuffer;
+  UniformHandle albedo;
+  UniformHandle history;
+  UniformHandle prev_moments;
+  UniformHandle prev_view_proj;
+  UniformHandle prev_camera_position;
+  UniformHandle reset;
+  UniformHandle reproject;
+  UniformHandle max_history;
+
+  void resolve(const Shader &shader);
+};
 
 class Application {
 public:
-  Application();
+  Application(const AppOptions &options = AppOptions());
   ~Application();
 
   void run();
@@ -26,20 +132,100 @@ private:
                                   float &fps);
 
   void draw_performance_window(float fps, float frame_time);
+  void export_telemetry(const std::string &prefix) const;
+  void finish_benchmark();
   void draw_settings(float &fov, float sun_dir[3], float &sun_intensity,
                      float sun_color[3], float &sky_intensity,
                      float sky_color[3], bool &accumulate_when_still);
+  bool draw_instance_editor();
 
   GLFWwindow *window;
   Shader *shader;
+  TraceUniforms uniforms;
+
+  // The path tracer links in the background; until then frames are drawn
+  // with the PREVIEW variant of the same fragment shader.
+  Shader *preview_shader = nullptr;
+  TraceUniforms preview_uniforms;
+  GLFWwindow *worker_window = nullptr;
+  bool trace_ready = false;
   GLuint vao;
-  GLuint prev_frame_tex = 0;
-  int prev_frame_width = 0;
-  int prev_frame_height = 0;
-  bool prev_frame_valid = false;
+  SceneBlob scene_blob;
+  SceneGpu *scene = nullptr;
+  int selected_instance = 0;
+  // Sky map named by the scene, or null for the gradient.
+  EnvironmentMap *environment = nullptr;
+  ThreadPool *thread_pool = nullptr;
+  GgxAlbedoLut *ggx_albedo = nullptr;
+  // The scene's textures, or null when it has none or they failed to load.
+  TextureArray *textures = nullptr;
+  // Edited from the settings window; the rest of the lighting lives in run().
+  float sun_angular_radius = 0.5f;
+
+  // Trace output (color, G-buffer) and accumulated history, ping-ponged
+  // by frame parity so last frame's copies stay readable.
+  RenderTarget *trace_targets[2] = {nullptr, nullptr};
+  RenderTarget *history[2] = {nullptr, nullptr};
+  int frame_parity = 0;
+  bool history_valid = false;
+  Shader *temporal_shader = nullptr;
+  TemporalUniforms temporal_uniforms;
+  float prev_view_proj[16] = {};
+  float prev_camera_position[3] = {};
+  bool temporal_reprojection = true;
+  float max_history = 16.0f;
+
+  Denoiser *denoiser = nullptr;
+  bool denoise = true;
+  DenoiseSettings denoise_settings;
+
+  // Trace resolution while moving; full resolution once still.
+  DynamicResolution dynamic_resolution;
+  bool dynamic_resolution_enabled = true;
+  int still_frames = 0;
+
+  // Pixels per traced sample while moving (1, 2 or 4); the rest are
+  // reconstructed by the temporal pass.
+  int interleave = 1;
+  unsigned int interleave_frame = 0;
+
+  // Progressive rendering: every pixel gets its primary hit each frame but
+  // only the tiles that fit the scheduler's budget are path traced.
+  int samples_per_pixel = 1;
+  // Reconstruction filter, a FILTER_* value from shader.frag: 0 traces
+  // through pixel centers, the rest jitter every sample.
+  int pixel_filter = 3;
+  bool tiled_rendering = false;
+  TileScheduler *tile_scheduler = nullptr;
+
+  // First hits through a fixed set of sample offsets, one layer per offset
+  // (a single one for the pixel-center filter), written by primary-only
+  // draws once the camera stops and read by every frame after it, until the
+  // camera, the scene, the filter or the render size changes. Samples cycle
+  // through the layers by frame, so while the cache is in use a jittered
+  // filter is resolved at primary_offsets points: more of them anti-alias
+  // better and cost three RGBA32F layers each.
+  RenderTarget *primary_cache = nullptr;
+  bool primary_cache_valid = false;
+  bool cache_primary_hits = true;
+  int primary_offsets = 4;
+  unsigned int primary_cache_frame = 0;
+
+  AppOptions options;
+  int exit_code = EXIT_SUCCESS;
+  BenchmarkRunner *benchmark = nullptr;
+  CameraRecorder *recorder = nullptr;
 
   // Frame time and FPS tracking
   double last_time = 0.0;
   float frame_time = 0.0f;
   float fps = 0.0f;
+
+  FrameTelemetry telemetry;
+  GpuTimer *gpu_timer = nullptr;
+  Profiler *profiler = nullptr;
+  float last_gpu_ms = 0.0f;
+  double last_poll_time = 0.0;
+  FrameStats telemetry_stats;
+  double telemetry_stats_time = 0.0;
 };
@@ -0,0 +1,104 @@
+#pragma once
+
+#include "camera.h"
+#include "image_io.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct CameraKey {
+  float time = 0.0f; // seconds along the path
+  float position[3] = {0.0f, 0.0f, 0.0f};
+  float yaw = 0.0f;
+  float pitch = 0.0f;
+  float fov = 45.0f;
+};
+
+// Text format, one directive per line ('#' starts a comment):
+//
+//   resolution 1280 720
+//   frames 600          # measured frames
+//   warmup 30           # frames rendered before timing starts
+//   seed 1
+//   hash_every 0        # also hash every N frames (0 = last frame only)
+//   samples_per_pixel 1
+//   pixel_filter 3      # FILTER_* value from shader.frag
+//   denoise 4           # à-trous iterations, 0 = denoiser off
+//   key <time> <x> <y> <z> <yaw> <pitch> <fov>
+//
+// Frames are spread evenly over the key times, so the path is replayed the
+// same way regardless of how fast the machine is. The render settings are
+// applied for the whole run, overriding the application defaults, so a
+// script measures the same work on every build.
+struct BenchmarkScript {
+  int width = 1280;
+  int height = 720;
+  int frames = 600;
+  int warmup = 30;
+  unsigned int seed = 1;
+  int hash_every = 0;
+  int samples_per_pixel = 1;
+  int pixel_filter = 3;
+  int denoise_iterations = 4;
+  std::vector<CameraKey> keys;
+};
+
+bool load_benchmark_script(const std::string &path, BenchmarkScript &script);
+bool save_benchmark_script(const std::string &path,
+                           const BenchmarkScript &script);
+
+// Camera at `time` seconds, interpolating linearly between keys.
+Camera evaluate_camera_path(const std::vector<CameraKey> &keys, float time);
+
+// Drives the render loop through a script with fixed seeds, then prints
+// throughput and image hashes.
+class BenchmarkRunner {
+public:
+  explicit BenchmarkRunner(const BenchmarkScript &script);
+
+  // Camera and shader time for the next frame. The time uniform seeds the
+  // per-pixel RNG, so it is derived from the frame number and script seed.
+  // Returns true on the first frame, where accumulation must restart so no
+  // pre-benchmark frame leaks into the result.
+  bool begin_frame(Camera &camera, float &shader_time);
+
+  // Call after the frame has been presented to the default framebuffer.
+  // `output` is the framebuffer it was presented from, whose first
+  // attachment holds the RGBA32F image at width x height; the captured image
+  // is read from there so regression runs compare full float precision.
+  void end_frame(unsigned int output, int width, int height);
+
+  bool finished() const;
+  void report() const;
+
+  // Keeps a float copy of the last frame for image regression runs.
+  void set_capture(bool enabled) { capture = enabled; }
+  const Image &captured_image() const { return image; }
+  double elapsed_ms() const { return (end_time - start_time) * 1000.0; }
+  int frame_count() const { return script.frames; }
+  const BenchmarkScript &settings() const { return script; }
+
+private:
+  BenchmarkScript script;
+  int frame = 0; // includes warmup frames
+  double start_time = 0.0;
+  double end_time = 0.0;
+  int measured_width = 0;
+  int measured_height = 0;
+  std::vector<std::pair<int, uint64_t>> hashes;
+  bool capture = false;
+  Image image;
+};
+
+// Samples the camera at a fixed rate for --record.
+class CameraRecorder {
+public:
+  void update(const Camera &camera, double now);
+  bool save(const std::string &path, int width, int height) const;
+
+private:
+  std::vector<CameraKey> keys;
+  double start_time = -1.0;
+  double last_sample = 0.0;
+};
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <vector>
+
+struct Aabb {
+  float min[3] = {1e30f, 1e30f, 1e30f};
+  float max[3] = {-1e30f, -1e30f, -1e30f};
+
+  void grow(const float p[3]);
+  void grow(const Aabb &other);
+  float area() const;
+  bool empty() const { return min[0] > max[0]; }
+};
+
+// Children of an interior node are stored next to each other at `first` and
+// `first + 1`; a leaf covers items [first, first + count) of the build order.
+struct BvhNode {
+  Aabb bounds;
+  int first = 0;
+  int count = 0; // 0 for interior nodes
+};
+
+// Deepest leaf a build produces, root at depth 0. Traversal in shader.frag
+// pushes at most one node per level onto a stack of BVH_STACK_SIZE, which
+// must be at least this.
+const int kBvhMaxDepth = 32;
+
+// Binned SAH build over item bounds, switching to median splits where SAH
+// could leave leaves deeper than kBvhMaxDepth. Node 0 is the root; `order`
+// lists item indices in leaf order.
+void build_bvh(const std::vector<Aabb> &items, std::vector<BvhNode> &nodes,
+               std::vector<int> &order);
+
+// Bounds of a box under a row-major 3x4 affine transform.
+Aabb transform_aabb(const Aabb &box, const float m[12]);
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cmath>
+
+struct Camera {
+  float position[3] = {0.0f, 0.5f, 3.0f};
+  float direction[3] = {0.0f, 0.0f, -1.0f};
+  float fov = 45.0f;
+
+  // New: Rotation state
+  float yaw = -90.0f;
+  float pitch = 0.0f;
+};
+
+// Recomputes camera.direction from yaw/pitch (degrees).
+static inline void update_camera_direction(Camera &camera) {
+  float yaw_rad = camera.yaw * (3.14159f / 180.0f);
+  float pitch_rad = camera.pitch * (3.14159f / 180.0f);
+
+  camera.direction[0] = cos(yaw_rad) * cos(pitch_rad);
+  camera.direction[1] = sin(pitch_rad);
+  camera.direction[2] = sin(yaw_rad) * cos(pitch_rad);
+
+  // Normalize direction (manual math since we don't have GLM here)
+  float len = sqrt(camera.direction[0] * camera.direction[0] +
+                   camera.direction[1] * camera.direction[1] +
+                   camera.direction[2] * camera.direction[2]);
+  camera.direction[0] /= len;
+  camera.direction[1] /= len;
+  camera.direction[2] /= len;
+}
+
+// Column-major view-projection matching the ray generation in shader.frag:
+// `fov` is vertical, world up is +Y and depth maps [near, far] to [-1, 1].
+static inline void camera_view_projection(const Camera &camera, float aspect,
+                                          float out[16]) {
+  const float near_plane = 0.01f;
+  const float far_plane = 1000.0f;
+
+  float f[3] = {camera.direction[0], camera.direction[1],
+                camera.direction[2]};
+  float f_len = sqrt(f[0] * f[0] + f[1] * f[1] + f[2] * f[2]);
+  for (int i = 0; i < 3; ++i)
+    f[i] /= f_len;
+
+  // right = normalize(cross(f, up)), up' = cross(right, f)
+  float r[3] = {-f[2], 0.0f, f[0]};
+  float r_len = sqrt(r[0] * r[0] + r[2] * r[2]);
+  r[0] /= r_len;
+  r[2] /= r_len;
+  float u[3] = {r[1] * f[2] - r[2] * f[1], r[2] * f[0] - r[0] * f[2],
+                r[0] * f[1] - r[1] * f[0]};
+
+  const float *p = camera.position;
+  float view[3][4] = {
+      {r[0], r[1], r[2], -(r[0] * p[0] + r[1] * p[1] + r[2] * p[2])},
+      {u[0], u[1], u[2], -(u[0] * p[0] + u[1] * p[1] + u[2] * p[2])},
+      {-f[0], -f[1], -f[2], f[0] * p[0] + f[1] * p[1] + f[2] * p[2]},
+  };
+
+  float focal = 1.0f / tan(camera.fov * (3.14159265f / 180.0f) * 0.5f);
+  float a = (far_plane + near_plane) / (near_plane - far_plane);
+  float b = 2.0f * far_plane * near_plane / (near_plane - far_plane);
+
+  // Rows of projection * view; the projection is diagonal apart from the
+  // depth and w rows.
+  float rows[4][4];
+  for (int c = 0; c < 4; ++c) {
+    rows[0][c] = focal / aspect * view[0][c];
+    rows[1][c] = focal * view[1][c];
+    rows[2][c] = a * view[2][c] + (c == 3 ? b : 0.0f);
+    rows[3][c] = -view[2][c];
+  }
+  for (int c = 0; c < 4; ++c)
+    for (int row = 0; row < 4; ++row)
+      out[c * 4 + row] = rows[row][c];
+}
@@ -0,0 +1,281 @@
+#pragma once
+
+// C++ port of the baseline kernels of shaders/shader.frag: analytic spheres
+// and planes tested one by one, the random()-hash sampler and the Lambert,
+// metal and dielectric scatter functions. The shader has since moved on
+// (BVH scene buffer, PCG sampling, GGX, textures, light sampling), so these
+// measure the original hot path rather than what the GPU runs today. Used
+// by the raytracer_bench target; the application itself traces on the GPU
+// only.
+
+#include <cmath>
+#include <vector>
+
+namespace cpu {
+
+constexpr float kFltMax = 3.402823466e+38f;
+
+struct Vec2 {
+  float x, y;
+};
+
+struct Vec3 {
+  float x, y, z;
+};
+
+inline Vec3 operator+(Vec3 a, Vec3 b) {
+  return {a.x + b.x, a.y + b.y, a.z + b.z};
+}
+inline Vec3 operator-(Vec3 a, Vec3 b) {
+  return {a.x - b.x, a.y - b.y, a.z - b.z};
+}
+inline Vec3 operator-(Vec3 a) { return {-a.x, -a.y, -a.z}; }
+inline Vec3 operator*(Vec3 a, Vec3 b) {
+  return {a.x * b.x, a.y * b.y, a.z * b.z};
+}
+inline Vec3 operator*(Vec3 a, float s) { return {a.x * s, a.y * s, a.z * s}; }
+inline Vec3 operator*(float s, Vec3 a) { return a * s; }
+inline Vec3 operator/(Vec3 a, float s) { return a * (1.0f / s); }
+inline Vec3 &operator+=(Vec3 &a, Vec3 b) { return a = a + b; }
+inline Vec3 &operator*=(Vec3 &a, Vec3 b) { return a = a * b; }
+
+inline float dot(Vec3 a, Vec3 b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+inline Vec3 cross(Vec3 a, Vec3 b) {
+  return {a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x};
+}
+inline float length(Vec3 a) { return std::sqrt(dot(a, a)); }
+inline Vec3 normalize(Vec3 a) { return a / length(a); }
+inline Vec3 mix(Vec3 a, Vec3 b, float t) { return a * (1.0f - t) + b * t; }
+
+// GLSL reflect()/refract() semantics.
+inline Vec3 reflect(Vec3 i, Vec3 n) { return i - 2.0f * dot(n, i) * n; }
+inline Vec3 refract(Vec3 i, Vec3 n, float eta) {
+  float k = 1.0f - eta * eta * (1.0f - dot(n, i) * dot(n, i));
+  if (k < 0.0f)
+    return {0.0f, 0.0f, 0.0f};
+  return eta * i - (eta * dot(n, i) + std::sqrt(k)) * n;
+}
+
+inline float fract(float x) { return x - std::floor(x); }
+
+enum MaterialType { MAT_LAMBERT = 0, MAT_METAL = 1, MAT_DIELECTRIC = 2 };
+
+struct Material {
+  int type;
+  Vec3 albedo;
+  float roughness;
+  float ior;
+};
+
+struct Sphere {
+  Vec3 center;
+  float radius;
+  Vec3 color;
+};
+
+struct Plane {
+  Vec3 point;
+  Vec3 normal;
+  Vec3 color;
+};
+
+struct HitRecord {
+  Vec3 point;
+  Vec3 normal;
+  float t;
+  Material material;
+};
+
+struct Ray {
+  Vec3 origin;
+  Vec3 direction;
+};
+
+struct Scene {
+  std::vector<Sphere> spheres;
+  std::vector<Material> materials; // one per sphere
+  Plane plane;
+  Material plane_material;
+
+  Vec3 sun_direction;
+  Vec3 sun_color;
+  float sun_intensity;
+  Vec3 sky_color;
+  float sky_intensity;
+};
+
+// The four-sphere scene hard-coded in shader.frag, lit like Application's
+// defaults.
+Scene default_scene();
+
+// A grid of count x count spheres over the ground plane with mixed
+// materials, for scaling measurements.
+Scene sphere_grid_scene(int count);
+
+inline bool hit_sphere(const Sphere &s, const Material &material,
+                       const Ray &ray, float t_min, float t_max, float &t_hit,
+                       HitRecord &record) {
+  Vec3 oc = ray.origin - s.center;
+  float a = dot(ray.direction, ray.direction);
+  float b = dot(oc, ray.direction);
+  float c = dot(oc, oc) - s.radius * s.radius;
+  float d = b * b - a * c;
+
+  if (d < 0.0f)
+    return false;
+
+  float sqrtd = std::sqrt(d);
+  float t = (-b - sqrtd) / a;
+  if (t < t_min || t > t_max) {
+    t = (-b + sqrtd) / a;
+    if (t < t_min || t > t_max)
+      return false;
+  }
+
+  record.t = t;
+  record.point = ray.origin + t * ray.direction;
+  record.normal = (record.point - s.center) * (1.0f / s.radius);
+  record.material = material;
+
+  t_hit = t;
+  return true;
+}
+
+inline bool hit_plane(const Plane &p, const Material &material,
+                      const Ray &ray, float t_min, float t_max, float &t_hit,
+                      HitRecord &record) {
+  float denom = dot(p.normal, ray.direction);
+  if (std::fabs(denom) < 1e-6f)
+    return false;
+  float t = dot(p.point - ray.origin, p.normal) / denom;
+  if (t < t_min || t > t_max)
+    return false;
+  record.t = t;
+  record.point = ray.origin + t * ray.direction;
+  record.normal = p.normal;
+  record.material = material;
+
+  t_hit = t;
+  return true;
+}
+
+inline float random(Vec2 st) {
+  return fract(std::sin(st.x * 12.9898f + st.y * 78.233f) * 43758.5453123f);
+}
+
+inline Vec3 random_in_unit_sphere(Vec2 rnd_state) {
+  Vec3 p = {0.0f, 0.0f, 0.0f};
+
+  for (int i = 0; i < 4; ++i) {
+    p = Vec3{random({rnd_state.x + 1.0f, rnd_state.y}),
+             random({rnd_state.x, rnd_state.y + 1.0f}),
+             random({rnd_state.x + 1.0f, rnd_state.y + 1.0f})} *
+            2.0f -
+        Vec3{1.0f, 1.0f, 1.0f};
+
+    if (dot(p, p) < 1.0f)
+      return p;
+
+    // decorrelate on retry
+    rnd_state.x += 13.37f;
+    rnd_state.y += 13.37f;
+  }
+
+  // fallback to guarantee return
+  return normalize(p) * random({rnd_state.x + 42.0f, rnd_state.y + 42.0f});
+}
+
+inline float schlick(float cosine, float ref_idx) {
+  float r0 = (1.0f - ref_idx) / (1.0f + ref_idx);
+  r0 = r0 * r0;
+  return r0 + (1.0f - r0) * std::pow(1.0f - cosine, 5.0f);
+}
+
+inline bool scatter_lambert(const HitRecord &record, Vec3 &attenuation,
+                            Ray &scattered, Vec2 rnd_state) {
+  Vec3 target = record.point + record.normal + random_in_unit_sphere(rnd_state);
+  scattered = Ray{record.point, target - record.point};
+  attenuation = record.material.albedo;
+  return true;
+}
+
+inline bool scatter_metal(const Ray &ray_in, const HitRecord &record,
+                          Vec3 &attenuation, Ray &scattered, Vec2 rnd_state) {
+  Vec3 reflected = reflect(normalize(ray_in.direction), record.normal);
+  Vec3 roughness_dir =
+      record.material.roughness * random_in_unit_sphere(rnd_state);
+  scattered = Ray{record.point, reflected + roughness_dir};
+  attenuation = record.material.albedo;
+  return dot(scattered.direction, record.normal) > 0.0f;
+}
+
+inline bool scatter_dielectric(const Ray &ray_in, const HitRecord &record,
+                               Vec3 &attenuation, Ray &scattered,
+                               Vec2 rnd_state) {
+  attenuation = {1.0f, 1.0f, 1.0f};
+  Vec3 unit_dir = normalize(ray_in.direction);
+
+  float cos_theta = std::fmin(dot(-unit_dir, record.normal), 1.0f);
+  float sin_theta = std::sqrt(std::fmax(0.0f, 1.0f - cos_theta * cos_theta));
+
+  float eta = record.material.ior;
+  Vec3 outward_normal = record.normal;
+  float refraction_ratio = 1.0f / eta;
+  if (dot(unit_dir, record.normal) > 0.0f) {
+    outward_normal = -record.normal;
+    refraction_ratio = eta;
+    cos_theta = std::fmin(dot(-unit_dir, outward_normal), 1.0f);
+  }
+
+  bool cannot_refract = refraction_ratio * sin_theta > 1.0f;
+  float reflect_prob = schlick(cos_theta, refraction_ratio);
+
+  if (cannot_refract || random(rnd_state) < reflect_prob) {
+    scattered = Ray{record.point, reflect(unit_dir, record.normal)};
+  } else {
+    scattered = Ray{record.point,
+                    refract(unit_dir, outward_normal, refraction_ratio)};
+  }
+
+  return true;
+}
+
+inline bool scatter(const Ray &ray_in, const HitRecord &record,
+                    Vec3 &attenuation, Ray &scattered, Vec2 rnd_state) {
+  if (record.material.type == MAT_METAL)
+    return scatter_metal(ray_in, record, attenuation, scattered, rnd_state);
+  if (record.material.type == MAT_DIELECTRIC)
+    return scatter_dielectric(ray_in, record, attenuation, scattered,
+                              rnd_state);
+  return scatter_lambert(record, attenuation, scattered, rnd_state);
+}
+
+// Closest hit over all spheres and the plane.
+bool hit_scene(const Scene &scene, const Ray &ray, float t_min,
+               HitRecord &record);
+
+// Adds the number of rays cast (path segments plus shadow rays) to
+// *ray_count when given.
+Vec3 trace(const Scene &scene, const Ray &ray, Vec2 rnd_state,
+           long *ray_count = nullptr);
+
+// Streaming counterpart of trace() for a batch of paths: every path
+// advances one bounce at a time, and each bounce's rays are intersected in
+// packets of kPacketSize, sphere by sphere. radiance[i] is exactly what
+// trace(scene, rays[i], rnd_states[i]) returns.
+//
+// sort_rays is a measurement hook for BM_TraceStream, not a mode to use:
+// it reorders rays after the first bounce by direction octant and then
+// along a Morton curve through their origins, and on the brute-force CPU
+// scenes the sort costs more than the coherence saves. Pass false.
+constexpr int kPacketSize = 64;
+
+void trace_stream(const Scene &scene, const std::vector<Ray> &rays,
+                  const std::vector<Vec2> &rnd_states, bool sort_rays,
+                  std::vector<Vec3> &radiance, long *ray_count = nullptr);
+
+// Primary ray through pixel (x, y), matching main() in shader.frag.
+Ray camera_ray(const Vec3 &position, const Vec3 &direction, float fov,
+               int x, int y, int width, int height);
+
+} // namespace cpu
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "render_target.h"
+#include "shader.h"
+
+#include <glad/gl.h>
+
+struct DenoiseSettings {
+  int iterations = 4; // à-trous passes, kernel footprint 4 << iterations
+  float phi_color = 4.0f;
+  float phi_normal = 128.0f;
+  float phi_depth = 1.0f;
+};
+
+// Trace and temporal pass outputs the denoiser reads.
+struct DenoiseInputs {
+  GLuint history;  // (color, frames)
+  GLuint moments;  // (luminance, luminance^2) of color / albedo
+  GLuint gbuffer;  // (position, distance) or (direction, 0)
+  GLuint normal;
+  GLuint albedo;
+};
+
+// Spatial denoiser over the temporal history (shaders/denoise.frag): a
+// variance estimate followed by edge-aware à-trous iterations. Draws
+// fullscreen triangles with whatever vertex array is bound.
+class Denoiser {
+public:
+  Denoiser();
+  ~Denoiser();
+
+  // No-op when the size is unchanged.
+  void resize(int width, int height);
+
+  // `pixel_spread` is the world-space size of one pixel at unit distance.
+  // Returns the target holding the filtered color.
+  const RenderTarget &run(const DenoiseInputs &inputs,
+                          const DenoiseSettings &settings,
+                          float pixel_spread);
+
+private:
+  struct VarianceUniforms {
+    UniformHandle gbuffer;
+    UniformHandle normal;
+    UniformHandle albedo;
+    UniformHandle history;
+    UniformHandle moments;
+  };
+
+  struct AtrousUniforms {
+    UniformHandle gbuffer;
+    UniformHandle normal;
+    UniformHandle albedo;
+    UniformHandle input;
+    UniformHandle step;
+    UniformHandle remodulate;
+    UniformHandle phi_color;
+    UniformHandle phi_normal;
+    UniformHandle phi_depth;
+    UniformHandle pixel_spread;
+  };
+
+  Shader *variance_shader;
+  Shader *atrous_shader;
+  VarianceUniforms variance_uniforms;
+  AtrousUniforms atrous_uniforms;
+  // Ping-pong (illumination, variance) between iterations.
+  RenderTarget *targets[2];
+};
@@ -0,0 +1,27 @@
+#pragma once
+
+// Picks the trace resolution scale (fraction of the output size per axis)
+// that keeps GPU frame time near a budget while the camera moves. Trace
+// cost is roughly proportional to pixel count, so each adjustment scales by
+// the square root of budget / measured time. GPU times arrive
+// GpuTimer::kLatency frames late, so after every change the controller
+// discards measurements until ones taken at the new scale come in.
+class DynamicResolution {
+public:
+  float target_ms = 16.7f;
+  float min_scale = 0.35f;
+
+  float scale() const { return current_scale; }
+
+  // Feeds one GPU frame time rendered at scale().
+  void update(float gpu_ms);
+  // Call on frames rendered at another scale, e.g. full resolution while
+  // the camera is still; scale() is kept for when motion resumes.
+  void hold();
+
+private:
+  float current_scale = 1.0f;
+  float smoothed_ms = 0.0f;
+  int samples = 0;
+  int settle_frames = 0;
+};
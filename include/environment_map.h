@@ -0,0 +1,58 @@
+#pragma once
+
+#include "image_io.h"
+#include "packing.h"
+#include "thread_pool.h"
+
+#include <glad/gl.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Importance-sampling tables for an equirectangular environment over a grid
+// of cells, each weighted by its average luminance times sin(theta). Every
+// row holds an alias table over its cells and one extra row the alias table
+// over rows; the rows are built in parallel. Texels are (threshold, alias,
+// weight / total), so a sample costs two lookups and the pdf of any
+// direction one.
+struct EnvironmentDistribution {
+  static constexpr int kMaxWidth = 1024; // larger maps share cells
+
+  int width = 0;  // cells per row
+  int height = 0; // rows of cells, not counting the marginal row
+  int stride = 0; // texels per row, enough for the marginal row too
+  float total = 0.0f; // sum of cell weights, 0 when the map is black
+  std::vector<float> texels; // RGB32F, stride x (height + 1)
+};
+
+void build_environment_distribution(const Image &image, ThreadPool &pool,
+                                    EnvironmentDistribution &distribution);
+
+// An HDR environment (.hdr or .exr) on the GPU: the radiance as an RGB9E5
+// texture, four bytes a texel, and its sampling tables as RGB32F.
+class EnvironmentMap {
+public:
+  EnvironmentMap() = default;
+  ~EnvironmentMap();
+  EnvironmentMap(const EnvironmentMap &) = delete;
+  EnvironmentMap &operator=(const EnvironmentMap &) = delete;
+
+  bool load(const std::string &path, ThreadPool &pool);
+
+  void bind(int radiance_unit, int distribution_unit) const;
+
+  int width() const { return image_width; }
+  int height() const { return image_height; }
+  // Cells of the sampling grid, or 0 x 0 when the map is black and only
+  // reached by bounces.
+  int cells_x() const { return cells[0]; }
+  int cells_y() const { return cells[1]; }
+
+private:
+  GLuint radiance = 0;
+  GLuint distribution = 0;
+  int image_width = 0;
+  int image_height = 0;
+  int cells[2] = {0, 0};
+};
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct FrameSample {
+  uint64_t frame = 0;            // render loop iteration, set by record()
+  float frame_ms = 0.0f;         // wall time since the previous frame
+  float cpu_ms = 0.0f;           // frame start until glfwSwapBuffers
+  float gpu_ms = 0.0f;           // GPU time, lags by GpuTimer::kLatency
+  float present_ms = 0.0f;       // time spent inside glfwSwapBuffers
+  float input_latency_ms = 0.0f; // input poll until the frame was presented
+};
+
+struct MetricStats {
+  float p50 = 0.0f;
+  float p95 = 0.0f;
+  float p99 = 0.0f;
+};
+
+struct FrameStats {
+  size_t count = 0;
+  MetricStats frame_ms;
+  MetricStats cpu_ms;
+  MetricStats gpu_ms;
+  MetricStats present_ms;
+  MetricStats input_latency_ms;
+  float avg_fps = 0.0f;
+  float low_1pct_fps = 0.0f; // FPS over the slowest 1% of frames
+};
+
+// Fixed-size ring of per-frame samples, recorded once per render loop
+// iteration. Not synchronized: record(), snapshot() and the exports must
+// all run on the render loop's thread, between frames.
+class FrameTelemetry {
+public:
+  static constexpr size_t kCapacity = 4096;
+
+  void record(const FrameSample &sample);
+
+  // Copies up to max_count of the most recent samples, oldest first.
+  std::vector<FrameSample> snapshot(size_t max_count = kCapacity) const;
+
+  static FrameStats compute_stats(const std::vector<FrameSample> &samples);
+
+  bool write_csv(const std::string &path) const;
+  bool write_json(const std::string &path) const;
+
+private:
+  std::array<FrameSample, kCapacity> samples;
+  uint64_t head = 0; // samples recorded so far
+};
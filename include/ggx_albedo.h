@@ -0,0 +1,50 @@
+#pragma once
+
+#include "thread_pool.h"
+
+#include <glad/gl.h>
+
+#include <vector>
+
+// Directional albedo of the single-scattering GGX lobes exactly as
+// shader.frag samples them: the fraction of light a scattering event
+// keeps. What is missing is light that bounced between microfacets before
+// leaving, which the shader adds back. Entries sit on uniform grids that
+// include both ends, by cos theta (fastest) and roughness (alpha =
+// roughness^2).
+//
+// The conductor table has a white Fresnel term. The dielectric one covers
+// reflection and refraction together, chosen by Fresnel, in layers over
+// the relative index of refraction eta in [1 / kMaxEta, kMaxEta], spaced
+// evenly in log(eta).
+struct GgxAlbedoTable {
+  static constexpr int kSize = 32;
+  static constexpr int kLayers = 16;
+  static constexpr float kMaxEta = 3.0f;
+  // Per side of the stratified grid behind each entry.
+  static constexpr int kConductorSamples = 32;
+  static constexpr int kDielectricSamples = 16;
+
+  std::vector<float> conductor;  // kSize x kSize
+  std::vector<float> dielectric; // kSize x kSize x kLayers
+};
+
+// Mirrors the shader's visible-normal sampling so the tables match it.
+// Rows are built in parallel.
+void build_ggx_albedo_table(ThreadPool &pool, GgxAlbedoTable &table);
+
+// The tables above as R32F textures filtered linearly, which the shader
+// reads at texel centers so the grid ends land on the table's ends.
+class GgxAlbedoLut {
+public:
+  explicit GgxAlbedoLut(ThreadPool &pool);
+  ~GgxAlbedoLut();
+  GgxAlbedoLut(const GgxAlbedoLut &) = delete;
+  GgxAlbedoLut &operator=(const GgxAlbedoLut &) = delete;
+
+  void bind(int conductor_unit, int dielectric_unit) const;
+
+private:
+  GLuint conductor = 0;
+  GLuint dielectric = 0;
+};
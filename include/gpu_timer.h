@@ -0,0 +1,28 @@
+#pragma once
+
+#include <glad/gl.h>
+
+#include <cstdint>
+
+// Measures the GPU time between begin() and end() with GL_TIMESTAMP queries.
+// Results are read back kLatency frames later so the CPU never waits on the
+// GPU; poll() once per frame returns them in submission order.
+class GpuTimer {
+public:
+  static constexpr int kLatency = 4;
+
+  GpuTimer();
+  ~GpuTimer();
+
+  void begin();
+  void end();
+
+  // Returns true and the elapsed milliseconds of the oldest finished span.
+  bool poll(float &elapsed_ms);
+
+private:
+  GLuint queries[kLatency][2];
+  int write_index = 0;
+  int read_index = 0;
+  int pending = 0;
+};
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <string>
+#include <utility>
+#include <vector>
+
+// Linear RGB float image, rows stored top to bottom.
+struct Image {
+  int width = 0;
+  int height = 0;
+  std::vector<float> pixels; // width * height * 3
+
+  float *at(int x, int y) { return &pixels[((size_t)y * width + x) * 3]; }
+  const float *at(int x, int y) const {
+    return &pixels[((size_t)y * width + x) * 3];
+  }
+};
+
+// Scalar float attributes stored in the EXR header next to the pixels.
+typedef std::vector<std::pair<std::string, float>> ImageAttributes;
+
+// Minimal OpenEXR support: single-part scanline files without compression.
+// Writes 32-bit float R, G, B; reads HALF or FLOAT R, G, B.
+bool write_exr(const std::string &path, const Image &image,
+               const ImageAttributes &attributes = ImageAttributes());
+bool read_exr(const std::string &path, Image &image,
+              ImageAttributes *attributes = nullptr);
+
+// Radiance .hdr (RGBE, flat or run-length encoded scanlines), divided by
+// any EXPOSURE in the header.
+bool read_hdr(const std::string &path, Image &image);
+
+// 8-bit textures, converted from sRGB to linear: binary PPM (P6, maxval up to
+// 255) and Truevision TGA (24 or 32 bit truecolor, flat or run-length
+// encoded). Alpha is dropped.
+bool read_ppm(const std::string &path, Image &image);
+bool read_tga(const std::string &path, Image &image);
+
+// Picks a reader from the extension: .ppm, .tga, .hdr or .exr.
+bool read_image(const std::string &path, Image &image);
+
+struct ImageDiff {
+  float rmse = 0.0f;
+  float psnr_db = 0.0f; // relative to a peak of 1.0
+  float max_abs_error = 0.0f;
+};
+
+// Returns false when the sizes differ.
+bool compare_images(const Image &a, const Image &b, ImageDiff &diff);
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <string>
+#include <utility>
+#include <vector>
+
+// Small DOM-style JSON reader for scene files. Objects keep their key order.
+struct JsonValue {
+  enum Type { Null, Bool, Number, String, Array, Object };
+
+  Type type = Null;
+  bool boolean = false;
+  double number = 0.0;
+  std::string string;
+  std::vector<JsonValue> array;
+  std::vector<std::pair<std::string, JsonValue>> object;
+
+  bool is_number() const { return type == Number; }
+  bool is_string() const { return type == String; }
+  bool is_array() const { return type == Array; }
+  bool is_object() const { return type == Object; }
+
+  // Member lookup; returns nullptr when absent or not an object.
+  const JsonValue *find(const std::string &key) const;
+};
+
+// Returns false and fills `error` with "line:column: message" on failure.
+bool parse_json(const std::string &text, JsonValue &value, std::string &error);
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstdint>
+
+// Compact encodings shared by the scene cache and GPU textures. The shader
+// decodes them by hand: GLSL 4.10 has unpackUnorm4x8 but not
+// unpackHalf2x16.
+
+// Shared-exponent encoding of GL_RGB9_E5; negative values clamp to zero.
+uint32_t pack_rgb9e5(const float rgb[3]);
+void unpack_rgb9e5(uint32_t packed, float rgb[3]);
+
+// IEEE 754 binary16, rounded to nearest even; out-of-range values become
+// infinity.
+uint16_t float_to_half(float value);
+float half_to_float(uint16_t h);
+
+// Four values clamped to [0, 1] at 8 bits each, the first in the low byte,
+// as GLSL's packUnorm4x8.
+uint32_t pack_unorm4x8(const float v[4]);
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <glad/gl.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// CPU and GPU frame-phase profiler. CPU spans come from RAII scopes; GPU
+// spans from GL_TIMESTAMP query pairs that are resolved a few frames later
+// and mapped onto the CPU clock, so both land on one timeline. When
+// recording, events are written as a Chrome trace-event file that
+// chrome://tracing and Perfetto (ui.perfetto.dev) open directly.
+//
+// Span names must be string literals; only the pointer is stored.
+class Profiler {
+public:
+  Profiler();
+  ~Profiler();
+
+  void set_recording(bool enabled) { recording = enabled; }
+  bool is_recording() const { return recording; }
+
+  // Microseconds on the CPU timeline.
+  double now_us() const;
+
+  void add_cpu_span(const char *name, double start_us, double end_us);
+
+  // Returns a handle for gpu_end(), or -1 when the query pool is exhausted.
+  int gpu_begin(const char *name);
+  void gpu_end(int span);
+
+  // Resolves finished GPU spans; call once per frame.
+  void end_frame();
+
+  // Most recent GPU duration of a span, 0 until one has resolved.
+  float last_gpu_ms(const char *name) const;
+
+  bool write_chrome_trace(const std::string &path) const;
+
+private:
+  struct Event {
+    const char *name;
+    double start_us;
+    double duration_us;
+    int track; // 0 = CPU, 1 = GPU
+  };
+
+  struct GpuSpan {
+    const char *name;
+    GLuint queries[2];
+    bool ended;
+  };
+
+  struct LastGpu {
+    const char *name;
+    float ms;
+  };
+
+  void calibrate();
+
+  bool recording = false;
+  std::vector<Event> events;
+
+  std::vector<GLuint> free_queries;
+  std::vector<GpuSpan> pending;
+  std::vector<LastGpu> last_gpu;
+
+  // GPU timestamp (ns) and CPU time (us) sampled at the same moment.
+  int64_t gpu_reference_ns = 0;
+  double cpu_reference_us = 0.0;
+  double last_calibration_us = 0.0;
+};
+
+class ProfileScope {
+public:
+  ProfileScope(Profiler *profiler, const char *name)
+      : profiler(profiler), name(name), start_us(profiler->now_us()) {}
+  ~ProfileScope() {
+    profiler->add_cpu_span(name, start_us, profiler->now_us());
+  }
+
+private:
+  Profiler *profiler;
+  const char *name;
+  double start_us;
+};
+
+// Records both a CPU span and the GPU time of the commands issued inside it.
+class GpuProfileScope {
+public:
+  GpuProfileScope(Profiler *profiler, const char *name)
+      : cpu(profiler, name), profiler(profiler),
+        span(profiler->gpu_begin(name)) {}
+  ~GpuProfileScope() { profiler->gpu_end(span); }
+
+private:
+  ProfileScope cpu;
+  Profiler *profiler;
+  int span;
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_SCOPE(profiler, name)                                          \
+  ProfileScope PROFILE_CONCAT(profile_scope_, __LINE__)(profiler, name)
+#define PROFILE_GPU_SCOPE(profiler, name)                                      \
+  GpuProfileScope PROFILE_CONCAT(profile_scope_, __LINE__)(profiler, name)
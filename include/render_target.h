@@ -0,0 +1,42 @@
+#pragma once
+
+#include <glad/gl.h>
+
+#include <vector>
+
+// Offscreen framebuffer with one texture per color attachment (MRT), all at
+// the same size. Textures use nearest filtering unless `linear` is set. A
+// layered target holds 2D array textures and draws to one layer at a time.
+class RenderTarget {
+public:
+  RenderTarget(const std::vector<GLenum> &formats, bool linear = false,
+               bool layered = false);
+  ~RenderTarget();
+
+  // Reallocates every attachment; contents become undefined. `layers` is
+  // ignored unless the target is layered.
+  void resize(int width, int height, int layers = 1);
+
+  // Binds the framebuffer with all attachments (at `layer` when layered)
+  // as draw buffers and sets the viewport to cover it.
+  void bind(int layer = 0) const;
+
+  GLuint fbo() const { return framebuffer; }
+  GLuint texture(int attachment) const { return textures[attachment]; }
+  int width() const { return target_width; }
+  int height() const { return target_height; }
+  int layers() const { return target_layers; }
+
+private:
+  GLenum target() const {
+    return layered ? GL_TEXTURE_2D_ARRAY : GL_TEXTURE_2D;
+  }
+
+  GLuint framebuffer = 0;
+  std::vector<GLuint> textures;
+  std::vector<GLenum> formats;
+  bool layered = false;
+  int target_width = 0;
+  int target_height = 0;
+  int target_layers = 1;
+};
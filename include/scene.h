@@ -0,0 +1,298 @@
+#pragma once
+
+#include "bvh.h"
+#include "camera.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Matches the MAT_* constants in shader.frag.
+enum SceneMaterialType {
+  kMaterialLambert = 0,
+  kMaterialMetal = 1,
+  kMaterialDielectric = 2,
+};
+
+struct SceneMaterial {
+  int type = kMaterialLambert;
+  float albedo[3] = {1.0f, 1.0f, 1.0f}; // stored at 8 bits, within [0, 1]
+  float roughness = 0.0f;
+  float ior = 1.5f;
+  // Radiance leaving the front of the surface; any type can emit.
+  float emission[3] = {0.0f, 0.0f, 0.0f};
+  // Index into SceneDescription::textures multiplying the albedo, or -1.
+  int albedo_texture = -1;
+  // Texture repeats per unit of UV (per world unit on planes).
+  float texture_scale = 1.0f;
+};
+
+struct SceneSphere {
+  float center[3] = {0.0f, 0.0f, 0.0f};
+  float radius = 1.0f;
+  int material = 0;
+};
+
+struct ScenePlane {
+  float point[3] = {0.0f, 0.0f, 0.0f};
+  float normal[3] = {0.0f, 1.0f, 0.0f};
+  int material = 0;
+};
+
+struct SceneTriangle {
+  float v0[3];
+  float v1[3];
+  float v2[3];
+  float uv0[2] = {0.0f, 0.0f};
+  float uv1[2] = {0.0f, 0.0f};
+  float uv2[2] = {0.0f, 0.0f};
+  int material = 0;
+};
+
+// Shared geometry, built into its own bottom-level BVH once no matter how
+// many instances reference it.
+struct SceneGeometry {
+  std::string name;
+  std::vector<SceneSphere> spheres;
+  std::vector<SceneTriangle> triangles;
+};
+
+struct SceneInstance {
+  int geometry = 0;
+  // Object-to-world, row-major 3x4.
+  float transform[12] = {1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0};
+  // Replaces every primitive's material when >= 0.
+  int material = -1;
+};
+
+// Camera and lighting defaults the scene starts with; the UI edits copies.
+struct SceneSettings {
+  float camera_position[3] = {0.0f, 0.5f, 3.0f};
+  float camera_yaw = -90.0f;
+  float camera_pitch = 0.0f;
+  float camera_fov = 45.0f;
+  float sun_direction[3] = {0.4f, 0.8f, 0.2f};
+  float sun_color[3] = {1.0f, 0.95f, 0.85f};
+  float sun_intensity = 0.6f;
+  // Half-angle of the sun disc in degrees; the real sun is about 0.27.
+  float sun_angular_radius = 0.5f;
+  float sky_color[3] = {0.5f, 0.7f, 1.0f};
+  float sky_intensity = 0.0f;
+  // Equirectangular .hdr/.exr replacing the gradient, resolved against the
+  // scene file's directory; empty for the gradient.
+  char sky_map[256] = {};
+
+  Camera camera() const;
+};
+
+// A scene as written in a JSON scene file:
+//
+//   {
+//     "camera": {"position": [0, 0.5, 3], "yaw": -90, "pitch": 0, "fov": 45},
+//     "sun": {"direction": [0.4, 0.8, 0.2], "color": [1, 0.95, 0.85],
+//             "intensity": 0.6, "angular_radius": 0.5},
+//     "sky": {"color": [0.5, 0.7, 1], "intensity": 0, "map": "sky.hdr"},
+//     "materials": {
+//       "red": {"type": "metal", "albedo": [1, 0, 0.2], "roughness": 0},
+//       "glass": {"type": "dielectric", "ior": 1.5},
+//       "lamp": {"albedo": [0, 0, 0], "emission": [8, 7, 6]},
+//       "bricks": {"albedo_texture": "bricks.tga", "texture_scale": 4}
+//     },
+//     "spheres": [{"center": [0, 1, -3], "radius": 1, "material": "red"}],
+//     "planes": [{"point": [0, 0, 0], "normal": [0, 1, 0],
+//                 "material": "floor"}],
+//     "meshes": [{"obj": "bunny.obj", "material": "glass",
+//                 "translate": [0, 0, -2], "scale": 1},
+//                {"vertices": [[0, 0, 0], [1, 0, 0], [0, 1, 0]],
+//                 "uvs": [[0, 0], [1, 0], [0, 1]],
+//                 "indices": [0, 1, 2], "material": "red"}],
+//     "objects": {
+//       "tree": {"spheres": [...], "meshes": [...]}
+//     },
+//     "instances": [
+//       {"object": "tree", "translate": [4, 0, -2], "rotate": [0, 45, 0],
+//        "scale": 0.5, "material": "red"},
+//       {"object": "tree", "transform": [1, 0, 0, 0, 0, 1, 0, 0,
+//                                        0, 0, 1, -8]}
+//     ]
+//   }
+//
+// Every section is optional. Mesh "obj", sky "map" and texture paths are
+// relative to the scene file. From .obj files only positions, texture
+// coordinates and faces are read; polygons are fanned. Textures are binary
+// PPM, TGA, .hdr or .exr; spheres are mapped by latitude and longitude,
+// planes by world position, and triangles by their "uvs" (one per vertex).
+// A sky map replaces the color gradient and its intensity defaults to 1.
+// Metal and dielectric roughness is perceptual, GGX alpha = roughness^2.
+// Spheres and triangles with an emissive material are sampled as lights;
+// triangles emit from the side their winding faces, and emissive planes
+// light the scene only through the bounces that happen to reach them.
+// Top-level spheres and meshes form an implicit object instanced once.
+// Instances take either a row-major 3x4 "transform" or translate/rotate/
+// scale, with the rotation in degrees applied about X, then Y, then Z.
+struct SceneDescription {
+  SceneSettings settings;
+  std::vector<SceneMaterial> materials;
+  std::vector<ScenePlane> planes;
+  std::vector<SceneGeometry> geometries;
+  std::vector<SceneInstance> instances;
+  std::vector<std::string> textures; // resolved paths, one array layer each
+  std::vector<std::string> meshes;   // resolved .obj paths, once each
+};
+
+bool parse_scene_file(const std::string &path, SceneDescription &scene);
+
+// Compiled scenes are cached next to the source as <name>.rtsb: a header
+// followed by one array of RGBA32F texels per section, laid out exactly as
+// the shader reads them. Loading a current cache is a single mmap with no
+// parsing. The cache is stale once the source or any .obj it pulls in
+// changes size or modification time. Bump the version whenever a layout
+// changes.
+const uint32_t kSceneCacheVersion = 8;
+
+// Integer fields hold int bit patterns (floatBitsToInt in the shader).
+enum SceneSection {
+  kSectionMaterials = 0, // one packed texel, see packing.h:
+                         //   (albedo RGBA8 with the type in alpha,
+                         //   roughness | ior << 16 as halves,
+                         //   emission as RGB9E5,
+                         //   albedo texture (0xffff for none) |
+                         //   texture scale << 16 as a half)
+  kSectionSpheres,       // (center.xyz, radius) (material, -, -, -)
+  kSectionPlanes,        // (point.xyz, material) (normal.xyz, -)
+  kSectionTriangles,     // (v0.xyz, material) (v1 - v0, duv2.x)
+                         //   (v2 - v0, duv2.y) (uv0, duv1), duv = uv - uv0
+  kSectionPrimitives,    // BLAS leaf entries, four per texel:
+                         //   sphere << 1 or triangle << 1 | 1
+  kSectionBlasNodes,     // (min.xyz, first) (max.xyz, count), see BvhNode
+  kSectionInstances,     // world-to-object rows, (blas root, material, -, -)
+                         //   in TLAS leaf order
+  kSectionTlasNodes,     // as BLAS nodes; leaves index instances
+  kSectionLights,        // (total power, -, -, -), then per emitter in
+                         //   world space (v0.xyz, 0) or (center.xyz,
+                         //   radius), (e1.xyz, threshold) (e2.xyz, alias)
+                         //   (emission.rgb, -); edges are 0 for spheres
+  // Kept on the CPU to rebuild the top level when instances move.
+  kSectionGeometries,      // (min.xyz, blas root) (max.xyz, -)
+                           //   (first sphere, spheres, first triangle,
+                           //   triangles)
+  kSectionInstanceSources, // object-to-world rows,
+                           //   (geometry, material, -, -)
+  // Read by TextureArray at load time.
+  kSectionTextures, // per texture a NUL-padded path of kTexturePathTexels
+  // Checked by load_scene before trusting the cache.
+  kSectionMeshFiles, // per .obj a path as for textures, then
+                     //   (size, mtime) as raw uint64/int64 bytes
+  kSceneSectionCount
+};
+
+const int kTexturePathTexels = 16; // 255 characters
+
+// Sections [0, kSceneGpuSectionCount) are uploaded as one texture buffer.
+const int kSceneGpuSectionCount = kSectionLights + 1;
+
+struct SceneSectionRange {
+  uint64_t offset; // bytes from the start of the file, 16-byte aligned
+  uint32_t count;  // elements
+  uint32_t texels; // reserved texels, at least enough for `count`
+};
+
+struct SceneCacheHeader {
+  char magic[4]; // "RTSB"
+  uint32_t version;
+  // Size and modification time of the source file the cache was built from.
+  uint64_t source_size;
+  int64_t source_mtime;
+  SceneSettings settings;
+  SceneSectionRange sections[kSceneSectionCount];
+};
+
+// Read-only view of a compiled scene, either memory-mapped from a cache file
+// or held in memory right after compiling.
+class SceneBlob {
+public:
+  SceneBlob() = default;
+  ~SceneBlob();
+  SceneBlob(const SceneBlob &) = delete;
+  SceneBlob &operator=(const SceneBlob &) = delete;
+
+  bool map(const std::string &path);
+  void adopt(std::vector<unsigned char> bytes);
+  void release();
+
+  bool valid() const { return data != nullptr; }
+  const SceneCacheHeader &header() const {
+    return *reinterpret_cast<const SceneCacheHeader *>(data);
+  }
+  uint32_t count(SceneSection section) const;
+  // First texel of a section (4 floats per texel).
+  const float *texels(SceneSection section) const;
+  // Texel offset of a section within the GPU texture buffer.
+  int gpu_base(SceneSection section) const;
+
+private:
+  bool check() const;
+
+  const unsigned char *data = nullptr;
+  size_t size = 0;
+  void *mapping = nullptr;
+  std::vector<unsigned char> owned;
+};
+
+struct SceneTopLevel {
+  std::vector<float> instances; // kSectionInstances texels
+  std::vector<float> nodes;     // kSectionTlasNodes texels
+};
+
+// Rebuilds the top level from instance sources and geometry records (the
+// kSectionInstanceSources and kSectionGeometries texels). Instances of
+// empty geometry or with a singular transform are dropped.
+void build_top_level(const std::vector<SceneInstance> &instances,
+                     const std::vector<Aabb> &geometry_bounds,
+                     const std::vector<int> &geometry_roots,
+                     SceneTopLevel &top_level);
+
+// Inverse of the above: decodes the CPU-only sections of a blob.
+void read_top_level_sources(const SceneBlob &blob,
+                            std::vector<SceneInstance> &instances,
+                            std::vector<Aabb> &geometry_bounds,
+                            std::vector<int> &geometry_roots);
+
+// What build_lights() reads emitters from: the material and primitive
+// texels as laid out in their sections, and where each geometry's spheres
+// and triangles start.
+struct SceneLightSources {
+  const float *materials = nullptr;
+  const float *spheres = nullptr;
+  const float *triangles = nullptr;
+  // (first sphere, spheres, first triangle, triangles) per geometry
+  std::vector<int> geometry_ranges;
+};
+
+struct SceneLights {
+  std::vector<float> texels; // kSectionLights texels
+  int count = 0;
+  float power = 0.0f; // luminance of the emitted flux over all of them
+};
+
+// Gathers every emissive sphere and triangle of every instance in world
+// space, with an alias table that picks each in proportion to its power.
+// Emissive spheres under a non-uniform scale are sampled as spheres of the
+// same volume. Like the top level, it is rebuilt when instances move.
+void build_lights(const std::vector<SceneInstance> &instances,
+                  const SceneLightSources &sources, SceneLights &lights);
+
+// Points `sources` into a blob, which must outlive it.
+void read_light_sources(const SceneBlob &blob, SceneLightSources &sources);
+
+// Paths of the textures a blob's materials refer to, by index.
+std::vector<std::string> read_texture_paths(const SceneBlob &blob);
+
+std::vector<unsigned char> compile_scene(const SceneDescription &scene,
+                                         uint64_t source_size,
+                                         int64_t source_mtime);
+
+// Loads a JSON scene through its binary cache, rebuilding the cache when it
+// is missing, stale or from another version.
+bool load_scene(const std::string &path, SceneBlob &blob);
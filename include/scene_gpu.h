@@ -0,0 +1,44 @@
+#pragma once
+
+#include "scene.h"
+
+#include <glad/gl.h>
+
+#include <vector>
+
+// GPU copy of a compiled scene. The GPU sections of the blob are uploaded
+// as-is into a single RGBA32F texture buffer; section_bases() gives the
+// texel offset of each for the shader. The blob must outlive it.
+class SceneGpu {
+public:
+  SceneGpu() = default;
+  ~SceneGpu();
+  SceneGpu(const SceneGpu &) = delete;
+  SceneGpu &operator=(const SceneGpu &) = delete;
+
+  // Fails without uploading anything when the sections do not fit one
+  // texture buffer (GL_MAX_TEXTURE_BUFFER_SIZE texels).
+  bool upload(const SceneBlob &blob);
+
+  void bind(int unit) const;
+  int count(SceneSection section) const { return counts[section]; }
+  const int *section_bases() const { return bases; }
+
+  int instance_count() const { return (int)instances.size(); }
+  const SceneInstance &instance(int index) const { return instances[index]; }
+
+  // Moves one instance and rebuilds only the top level and the lights; the
+  // bottom-level BVHs and primitives stay untouched on the GPU.
+  void move_instance(int index, const float transform[12]);
+
+private:
+  GLuint buffer = 0;
+  GLuint texture = 0;
+  int bases[kSceneGpuSectionCount] = {};
+  int counts[kSceneGpuSectionCount] = {};
+
+  std::vector<SceneInstance> instances;
+  std::vector<Aabb> geometry_bounds;
+  std::vector<int> geometry_roots;
+  SceneLightSources light_sources;
+};
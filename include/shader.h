@@ -2,17 +2,60 @@
 
 #include <glad/gl.h>
 
+#include <atomic>
 #include <string>
+#include <thread>
 #include <unordered_map>
+#include <vector>
+
+struct GLFWwindow;
+
+// Uniform location resolved once after link. Passing a handle to the set_*
+// overloads skips the name lookup (and the std::string temporary) entirely.
+struct UniformHandle {
+  GLint location = -1;
+  GLenum type = GL_NONE; // type the caller asked for, checked in DEBUG
+
+  bool valid() const { return location != -1; }
+};
+
+struct ShaderOptions {
+  // Injected as "#define <name>" lines right after the #version directive.
+  std::vector<std::string> defines;
+
+  // Return from the constructor before the program has linked; poll ready()
+  // before drawing with it. Uses GL_KHR_parallel_shader_compile when the
+  // driver has it, otherwise links on a thread bound to worker_context (a
+  // hidden window sharing objects with the current one). Without either the
+  // build falls back to blocking.
+  bool async = false;
+  GLFWwindow *worker_context = nullptr;
+};
 
 class Shader {
 public:
-  Shader(const std::string &vertex_path, const std::string &fragment_path);
+  Shader(const std::string &vertex_path, const std::string &fragment_path,
+         const ShaderOptions &options = ShaderOptions());
   ~Shader();
 
+  // True once the program has linked. Never blocks; for async builds the
+  // first call that observes completion checks the logs and reflects
+  // uniforms, so call it from the thread owning the main context.
+  bool ready();
+
+  static bool supports_parallel_compile();
+
   void use() const;
   unsigned int id() const { return program_id; }
 
+  // Looks up an active uniform from the reflection table built at link time.
+  // In DEBUG builds, missing uniforms and type mismatches are reported here,
+  // i.e. at load time rather than on first use.
+  UniformHandle uniform(const std::string &name, GLenum type) const;
+
+  // Reports active uniforms no handle was ever resolved for (DEBUG only).
+  void report_unused_uniforms() const;
+
   // Uniform helpers
   void set_bool(const std::string &name, bool value) const;
   void set_int(const std::string &name, int value) const;
@@ -21,12 +64,44 @@ public:
   void set_vec3(const std::string &name, float value1, float value2,
                 float value3) const;
 
+  void set_bool(UniformHandle handle, bool value) const;
+  void set_int(UniformHandle handle, int value) const;
+  void set_float(UniformHandle handle, float value) const;
+  void set_vec2(UniformHandle handle, float value1, float value2) const;
+  void set_ivec2(UniformHandle handle, int value1, int value2) const;
+  void set_vec3(UniformHandle handle, float value1, float value2,
+                float value3) const;
+  void set_int_array(UniformHandle handle, const int *values,
+                     int count) const;
+  // Column-major, as glUniformMatrix4fv expects.
+  void set_mat4(UniformHandle handle, const float *values) const;
+
 private:
-  unsigned int program_id;
+  struct ActiveUniform {
+    GLint location;
+    GLenum type;
+    GLint size;
+    mutable bool resolved;
+  };
+
+  unsigned int program_id = 0;
+  unsigned int vert_id = 0;
+  unsigned int frag_id = 0;
+
+  bool linked = false;
+  bool parallel_compile = false;
+  std::thread worker;
+  std::atomic<bool> worker_done{false};
 
+  std::unordered_map<std::string, ActiveUniform> active_uniforms;
   mutable std::unordered_map<std::string, GLint> uniform_cache;
   GLint get_uniform_location(const std::string &name) const;
+  void reflect_uniforms();
+  void link();
+  void finish_link();
 
   static std::string read_file(const std::string &path);
   static unsigned int compile(unsigned int type, const std::string &src);
+  static std::string inject_defines(const std::string &src,
+                                    const std::vector<std::string> &defines);
 };
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "thread_pool.h"
+
+#include <glad/gl.h>
+
+#include <string>
+#include <vector>
+
+// Every texture a scene references, one layer each of a single sRGB8 2D
+// array with a full mip chain, so the shader reaches any of them through
+// one sampler by layer index. Layers share a size: each image is resampled
+// to the smallest power of two covering the largest one, up to kMaxSize.
+// Textures tile, so stretching one to a square keeps its uv mapping.
+//
+// Files are decoded in parallel, and each layer is then resampled, reduced
+// to its mips in linear space and encoded in parallel too.
+class TextureArray {
+public:
+  static constexpr int kMaxSize = 1024;
+
+  TextureArray() = default;
+  ~TextureArray();
+  TextureArray(const TextureArray &) = delete;
+  TextureArray &operator=(const TextureArray &) = delete;
+
+  bool load(const std::vector<std::string> &paths, ThreadPool &pool);
+
+  void bind(int unit) const;
+
+  int layers() const { return layer_count; }
+  int size() const { return layer_size; }
+
+private:
+  GLuint texture = 0;
+  int layer_count = 0;
+  int layer_size = 0;
+};
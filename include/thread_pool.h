@@ -0,0 +1,41 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads for data-parallel loading work. The calling
+// thread joins in, so a pool of size 1 simply runs everything inline.
+class ThreadPool {
+public:
+  // 0 uses one thread per hardware thread.
+  explicit ThreadPool(int threads = 0);
+  ~ThreadPool();
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  // Calls fn(i) for every i in [0, count) and returns once all are done.
+  // Indices are handed out one at a time, so uneven items balance out.
+  void parallel_for(int count, const std::function<void(int)> &fn);
+
+  int size() const { return (int)workers.size() + 1; }
+
+private:
+  void work();
+  void run_items();
+
+  std::vector<std::thread> workers;
+  std::mutex mutex;
+  std::condition_variable wake;
+  std::condition_variable done;
+  bool stopping = false;
+  unsigned generation = 0; // bumped for every parallel_for()
+  int busy = 0;            // workers still inside the current one
+
+  const std::function<void(int)> *job = nullptr;
+  int job_count = 0;
+  std::atomic<int> next{0};
+};
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "gpu_timer.h"
+
+#include <deque>
+
+// Splits the render target into square tiles for progressive rendering and
+// picks how many to draw each frame, continuing round-robin where the last
+// frame stopped, so their GPU time fits a budget. The cost per tile comes
+// from timer queries around each frame's tiles.
+class TileScheduler {
+public:
+  int tile_size = 128;
+  float budget_ms = 8.0f;
+
+  // Picks this frame's tiles of a width x height target and starts timing
+  // them. Returns how many to draw (at least one).
+  int begin(int width, int height);
+  // Scissor rectangle (x, y, width, height) of the index-th tile picked by
+  // the last begin().
+  void rect(int index, int out[4]) const;
+  void end();
+
+  // Forgets the cost estimate, e.g. when the work per pixel changes.
+  void reset_estimate();
+
+  int tile_count() const { return columns * rows; }
+  int tiles_this_frame() const { return picked; }
+  float tile_ms() const { return estimate_ms; }
+
+private:
+  GpuTimer timer;
+  // Tiles drawn in each batch the timer has in flight, oldest first.
+  std::deque<int> batches;
+  int stale = 0; // leading batches to ignore after reset_estimate()
+  float estimate_ms = 0.0f;
+  int columns = 0;
+  int rows = 0;
+  int target_width = 0;
+  int target_height = 0;
+  int first = 0;
+  int picked = 0;
+};
@@ -0,0 +1,128 @@
+#version 410 core
+
+// Edge-aware à-trous wavelet filter over the accumulated history, after
+// SVGF (Schied et al. 2017). Lighting is filtered with the primary albedo
+// divided out so material detail stays sharp. Each tap of the 5x5 B3-spline
+// kernel is weighted by normal, depth-plane and luminance similarity; the
+// luminance tolerance follows the estimated noise of the accumulated mean,
+// so the filter fades out as the history converges.
+//
+// Built twice: with VARIANCE it is the estimation pass that seeds the first
+// iteration, otherwise one iteration with taps u_step pixels apart. Both
+// write rgb = demodulated illumination, a = variance of its luminance,
+// except the last iteration, which multiplies the albedo back in.
+
+out vec4 fragColor;
+
+uniform sampler2D u_gbuffer; // (position, distance) or (direction, 0)
+uniform sampler2D u_normal;
+uniform sampler2D u_albedo;
+
+#ifdef VARIANCE
+uniform sampler2D u_history; // (color, frames)
+uniform sampler2D u_moments; // (luminance, luminance^2)
+#else
+uniform sampler2D u_input;    // (illumination, variance)
+uniform int u_step;           // 1 << iteration
+uniform bool u_remodulate;
+uniform float u_phi_color;    // luminance tolerance, in standard deviations
+uniform float u_phi_normal;   // exponent on the normal dot product
+uniform float u_phi_depth;    // depth-plane tolerance, in pixel footprints
+uniform float u_pixel_spread; // footprint of one pixel at unit distance
+#endif
+
+float luminance(vec3 color) {
+    return dot(color, vec3(0.2126, 0.7152, 0.0722));
+}
+
+#ifdef VARIANCE
+// Below this many frames the temporal moments are too noisy on their own.
+const float SHORT_HISTORY = 4.0;
+
+void main() {
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    vec4 history = texelFetch(u_history, pixel, 0);
+    vec3 albedo = texelFetch(u_albedo, pixel, 0).rgb;
+    vec3 illumination = history.rgb / max(albedo, vec3(1e-3));
+    float frames = max(history.a, 1.0);
+    vec2 moments = texelFetch(u_moments, pixel, 0).xy;
+
+    // Short histories borrow moments from the 3x3 neighbors on the same
+    // surface.
+    vec4 center_hit = texelFetch(u_gbuffer, pixel, 0);
+    if (frames < SHORT_HISTORY && center_hit.w > 0.0) {
+        ivec2 size = textureSize(u_history, 0);
+        vec3 center_normal = texelFetch(u_normal, pixel, 0).xyz;
+        vec2 sum = vec2(0.0);
+        float count = 0.0;
+        for (int y = -1; y <= 1; ++y) {
+            for (int x = -1; x <= 1; ++x) {
+                ivec2 p = clamp(pixel + ivec2(x, y), ivec2(0), size - 1);
+                vec3 normal = texelFetch(u_normal, p, 0).xyz;
+                if (texelFetch(u_gbuffer, p, 0).w == 0.0 ||
+                    dot(normal, center_normal) < 0.9) continue;
+                sum += texelFetch(u_moments, p, 0).xy;
+                count += 1.0;
+            }
+        }
+        moments = sum / count;
+    }
+
+    // Variance of the mean over `frames` samples.
+    float variance = max(moments.y - moments.x * moments.x, 0.0) / frames;
+    fragColor = vec4(illumination, variance);
+}
+#else
+const float KERNEL[3] = float[3](3.0 / 8.0, 1.0 / 4.0, 1.0 / 16.0);
+
+void main() {
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    vec4 center = texelFetch(u_input, pixel, 0);
+    vec4 center_hit = texelFetch(u_gbuffer, pixel, 0);
+
+    // The sky has no surface to filter along.
+    vec4 result = center;
+    if (center_hit.w > 0.0) {
+        ivec2 size = textureSize(u_input, 0);
+        vec3 center_normal = texelFetch(u_normal, pixel, 0).xyz;
+        float center_luminance = luminance(center.rgb);
+        float luminance_scale = u_phi_color * sqrt(center.a) + 1e-4;
+        float depth_scale = u_phi_depth * float(u_step) * u_pixel_spread *
+            center_hit.w + 1e-4;
+
+        float center_weight = KERNEL[0] * KERNEL[0];
+        vec3 sum = center.rgb * center_weight;
+        float variance_sum = center.a * center_weight * center_weight;
+        float weight_sum = center_weight;
+        for (int y = -2; y <= 2; ++y) {
+            for (int x = -2; x <= 2; ++x) {
+                ivec2 p = pixel + ivec2(x, y) * u_step;
+                if ((x == 0 && y == 0) || any(lessThan(p, ivec2(0))) ||
+                    any(greaterThanEqual(p, size))) continue;
+                vec4 hit = texelFetch(u_gbuffer, p, 0);
+                if (hit.w == 0.0) continue;
+
+                vec4 tap = texelFetch(u_input, p, 0);
+                vec3 normal = texelFetch(u_normal, p, 0).xyz;
+                float plane_distance =
+                    abs(dot(center_normal, hit.xyz - center_hit.xyz));
+                float w = KERNEL[abs(x)] * KERNEL[abs(y)] *
+                    pow(max(dot(center_normal, normal), 0.0), u_phi_normal) *
+                    exp(-plane_distance / depth_scale -
+                        abs(luminance(tap.rgb) - center_luminance) /
+                        luminance_scale);
+                sum += tap.rgb * w;
+                variance_sum += tap.a * w * w;
+                weight_sum += w;
+            }
+        }
+        result = vec4(sum / weight_sum,
+            variance_sum / (weight_sum * weight_sum));
+    }
+
+    if (u_remodulate) {
+        result = vec4(result.rgb * texelFetch(u_albedo, pixel, 0).rgb, 1.0);
+    }
+    fragColor = result;
+}
+#endif
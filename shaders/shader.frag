@@ -6,47 +6,121 @@ struct Camera {
     float fov;
 };
 
-out vec4 fragColor;
+// One raw sample per pixel plus the primary hit for the temporal and
+// denoise passes: (position, distance) for surfaces, (direction, 0) for the
+// sky, then the surface normal and albedo. fragColor.a is the sum of the
+// filter weights of the samples averaged into the pixel, about one per
+// sample: 0 for pixels skipped this frame.
+layout(location = 0) out vec4 fragColor;
+layout(location = 1) out vec4 gbuffer;
+layout(location = 2) out vec4 gbuffer_normal;
+layout(location = 3) out vec4 gbuffer_albedo;
 
 uniform vec2 iResolution;
 uniform float iTime;
 uniform Camera u_camera;
-uniform sampler2D u_prev_frame;
-uniform int u_frame_index;
-uniform bool u_use_prev;
 uniform vec3 u_sun_direction;
 uniform vec3 u_sun_color;
 uniform float u_sun_intensity;
 uniform vec3 u_sky_color;
 uniform float u_sky_intensity;
+uniform float u_sun_angular_radius; // degrees
+uniform bool u_env_enabled;            // sky from u_env_map, not the gradient
+uniform sampler2D u_env_map;           // equirectangular radiance
+uniform sampler2D u_env_distribution;  // see EnvironmentDistribution
+uniform ivec2 u_env_cells;             // its grid, 0 x 0 when not sampled
+// GGX directional albedo, GgxAlbedoTable in ggx_albedo.h.
+uniform sampler2D u_ggx_albedo;
+uniform sampler3D u_ggx_dielectric_albedo;
+// Every scene texture as one layer, see TextureArray in texture_array.h.
+uniform sampler2DArray u_textures;
+uniform int u_texture_layers; // 0 when the scene has none or they failed
+uniform int u_interleave;       // pixels per traced sample: 1, 2 or 4,
+                                // 0 to trace none (G-buffer only)
+uniform int u_interleave_phase; // which of them is traced this frame
+uniform int u_samples_per_pixel;
+uniform int u_pixel_filter; // FILTER_*, the reconstruction filter
+// First hits through a fixed set of sample offsets, one layer per offset
+// (see fixed_pixel_filter()), kept while the camera is still. With
+// u_primary_pass set this draw writes layer u_primary_layer instead of
+// tracing; with u_primary_cached set samples cycle through the layers,
+// starting at u_primary_layer, and their paths start from the cached hits.
+uniform bool u_primary_pass;
+uniform bool u_primary_cached;
+uniform int u_primary_layer;
+uniform int u_primary_layers;
+uniform sampler2DArray u_primary_point;   // (point, material), -1: sky
+uniform sampler2DArray u_primary_normal;  // (octahedral normal, uv)
+uniform sampler2DArray u_primary_surface; // (area, radius, uv density, t)
 
 #define M_PI 3.14159265358979323846
 #define FLT_MAX 3.402823466e+38
 
+// Scene sections packed into one texture buffer; u_scene_sections holds the
+// texel offset of each (SceneSection in scene.h).
+uniform samplerBuffer u_scene;
+uniform int u_scene_sections[9];
+uniform int u_num_planes;
+uniform int u_num_instances;
+uniform int u_num_lights;
+
+const int SEC_MATERIALS = 0;
+const int SEC_SPHERES = 1;
+const int SEC_PLANES = 2;
+const int SEC_TRIANGLES = 3;
+const int SEC_PRIMITIVES = 4;
+const int SEC_BLAS_NODES = 5;
+const int SEC_INSTANCES = 6;
+const int SEC_TLAS_NODES = 7;
+const int SEC_LIGHTS = 8;
+
 struct Sphere {
     vec3 center;
     float radius;
-    vec3 color;
+    int material;
 };
 
+// Decoded from one packed texel by fetch_material(); hits carry only the
+// ID, and only shading decodes it.
 struct Material {
     int type;
     vec3 albedo;
     float roughness;
     float ior;
+    vec3 emission;
+    int texture; // layer of u_textures multiplying the albedo, or -1
+    float texture_scale;
 };
 
 struct Plane {
     vec3 point;
     vec3 normal;
-    vec3 color;
+    int material;
+};
+
+struct Triangle {
+    vec3 v0;
+    vec3 e1;
+    vec3 e2;
+    vec2 uv0;
+    vec2 duv1; // uv1 - uv0
+    vec2 duv2; // uv2 - uv0
+    int material;
 };
 
 struct HitRecord {
     vec3 point;
     vec3 normal;
     float t;
-    Material material;
+    // World-space surface area of the primitive hit (0 for planes) and, for
+    // spheres, their radius, so emitter_pdf() need not look the light up.
+    float area;
+    float radius;
+    // Texture coordinates and the uv area per unit of surface area around
+    // them, which sizes a ray cone's footprint in texture space.
+    vec2 uv;
+    float uv_density;
+    int material;
 };
 
 struct Ray {
@@ -54,32 +128,79 @@ struct Ray {
     vec3 direction;
 };
 
-const int NUM_SPHERES = 4;
-
 const int MAT_LAMBERT = 0;
 const int MAT_METAL = 1;
 const int MAT_DIELECTRIC = 2;
 
-Material materials[NUM_SPHERES] = Material[](
-        Material(MAT_METAL, vec3(1.0, 0.0, 0.2), 0.0, 1.0),
-        Material(MAT_METAL, vec3(0.0, 1.0, 0.2), 0.0, 1.0),
-        Material(MAT_LAMBERT, vec3(0.2, 0.2, 1.0), 0.0, 1.0),
-        Material(MAT_DIELECTRIC, vec3(1.0), 0.0, 1.5)
-    );
+vec4 scene_texel(int section, int i) {
+    return texelFetch(u_scene, u_scene_sections[section] + i);
+}
 
-Sphere spheres[NUM_SPHERES] = Sphere[](
-        Sphere(vec3(0.0, 1.0, -3.0), 1.0, vec3(1.0)),
-        Sphere(vec3(2.0, 1.0, -4.0), 1.0, vec3(1.0)),
-        Sphere(vec3(-2.0, 1.0, -4.0), 1.0, vec3(1.0)),
-        Sphere(vec3(0.0, 1.0, -6.0), 1.0, vec3(1.0))
-    );
+// GLSL 4.10 has no unpackHalf2x16. Only finite values are stored.
+float half_to_float(uint h) {
+    uint exponent = (h >> 10) & 0x1fu;
+    float mantissa = float(h & 0x3ffu);
+    float magnitude = exponent == 0u ? mantissa * exp2(-24.0) :
+        (1024.0 + mantissa) * exp2(float(exponent) - 25.0);
+    return (h & 0x8000u) != 0u ? -magnitude : magnitude;
+}
 
-Plane plane = Plane(vec3(0, 0, 0), normalize(vec3(0, 1, 0)), vec3(0.9));
-Material plane_material = Material(MAT_LAMBERT, vec3(1.0), 0.0, 1.0);
+vec3 unpack_rgb9e5(uint p) {
+    return vec3(uvec3(p, p >> 9, p >> 18) & 0x1ffu) *
+        exp2(float(p >> 27) - 24.0);
+}
+
+// See kSectionMaterials in scene.h for the packing.
+Material fetch_material(int id) {
+    uvec4 t = floatBitsToUint(scene_texel(SEC_MATERIALS, id));
+    uint layer = t.w & 0xffffu;
+    return Material(int(t.x >> 24), unpackUnorm4x8(t.x).rgb,
+        half_to_float(t.y & 0xffffu), half_to_float(t.y >> 16),
+        unpack_rgb9e5(t.z), layer == 0xffffu ? -1 : int(layer),
+        half_to_float(t.w >> 16));
+}
+
+Sphere fetch_sphere(int i) {
+    vec4 a = scene_texel(SEC_SPHERES, i * 2);
+    vec4 b = scene_texel(SEC_SPHERES, i * 2 + 1);
+    return Sphere(a.xyz, a.w, floatBitsToInt(b.x));
+}
+
+Plane fetch_plane(int i) {
+    vec4 a = scene_texel(SEC_PLANES, i * 2);
+    vec4 b = scene_texel(SEC_PLANES, i * 2 + 1);
+    return Plane(a.xyz, b.xyz, floatBitsToInt(a.w));
+}
 
+Triangle fetch_triangle(int i) {
+    vec4 a = scene_texel(SEC_TRIANGLES, i * 4);
+    vec4 b = scene_texel(SEC_TRIANGLES, i * 4 + 1);
+    vec4 c = scene_texel(SEC_TRIANGLES, i * 4 + 2);
+    vec4 d = scene_texel(SEC_TRIANGLES, i * 4 + 3);
+    return Triangle(a.xyz, b.xyz, c.xyz, d.xy, d.zw, vec2(b.w, c.w),
+        floatBitsToInt(a.w));
+}
 
-bool hit_sphere(Sphere s, Material material, Ray ray, float t_min, float t_max,
-    out float t_hit, out HitRecord record) {
+int fetch_primitive(int i) {
+    return floatBitsToInt(scene_texel(SEC_PRIMITIVES, i >> 2)[i & 3]);
+}
+
+// Orthonormal basis around n (Duff et al. 2017).
+mat3 basis(vec3 n) {
+    float s = n.z >= 0.0 ? 1.0 : -1.0;
+    float a = -1.0 / (s + n.z);
+    float b = n.x * n.y * a;
+    return mat3(vec3(1.0 + s * n.x * n.x * a, s * b, -s * n.x),
+        vec3(b, s + n.y * n.y * a, -n.y), n);
+}
+
+// Intersection runs in two steps. The hit_* tests below return only a
+// distance (and barycentrics for triangles), which is all traversal keeps
+// for its closest candidate; the *_record functions then build the full
+// HitRecord once, for the winner.
+
+bool hit_sphere(Sphere s, Ray ray, float t_min, float t_max,
+    out float t_hit) {
     vec3 oc = ray.origin - s.center;
     float a = dot(ray.direction, ray.direction);
     float b = dot(oc, ray.direction);
@@ -95,29 +216,400 @@ bool hit_sphere(Sphere s, Material material, Ray ray, float t_min, float t_max,
         if (t < t_min || t > t_max) return false;
     }
 
+    t_hit = t;
+    return true;
+}
+
+HitRecord sphere_record(Sphere s, Ray ray, float t) {
+    HitRecord record;
     record.t = t;
     record.point = ray.origin + t * ray.direction;
     record.normal = (record.point - s.center) * (1.0f / s.radius);
-    record.material = material;
-
-    t_hit = t;
-    return true;
+    record.radius = abs(s.radius);
+    record.area = 4.0 * M_PI * s.radius * s.radius;
+    // Latitude and longitude, with the average density over the sphere.
+    vec3 n = record.normal * sign(s.radius);
+    record.uv = vec2(atan(n.z, n.x) / (2.0 * M_PI) + 0.5,
+        acos(clamp(n.y, -1.0, 1.0)) / M_PI);
+    record.uv_density = 1.0 / record.area;
+    record.material = s.material;
+    return record;
 }
 
-bool hit_plane(Plane p, Ray ray, float t_min, float t_max, out float t_hit, out HitRecord record) {
+bool hit_plane(Plane p, Ray ray, float t_min, float t_max, out float t_hit) {
     float denom = dot(p.normal, ray.direction);
     if (abs(denom) < 1e-6) return false;
     float t = dot(p.point - ray.origin, p.normal) / denom;
     if (t < t_min || t > t_max) return false;
+
+    t_hit = t;
+    return true;
+}
+
+HitRecord plane_record(Plane p, Ray ray, float t) {
+    HitRecord record;
     record.t = t;
     record.point = ray.origin + t * ray.direction;
     record.normal = p.normal;
-    record.material = plane_material;
+    record.area = 0.0;
+    record.radius = 0.0;
+    record.uv = ((record.point - p.point) * basis(p.normal)).xy;
+    record.uv_density = 1.0;
+    record.material = p.material;
+    return record;
+}
+
+// Moller-Trumbore. The normal follows the winding (v0, v1, v2), so closed
+// meshes keep a consistent inside for dielectrics.
+bool hit_triangle(Triangle tri, Ray ray, float t_min, float t_max,
+    out float t_hit, out vec2 barycentrics) {
+    vec3 p = cross(ray.direction, tri.e2);
+    float det = dot(tri.e1, p);
+    if (abs(det) < 1e-10) return false;
+    float inv_det = 1.0 / det;
+
+    vec3 s = ray.origin - tri.v0;
+    float u = dot(s, p) * inv_det;
+    if (u < 0.0 || u > 1.0) return false;
+    vec3 q = cross(s, tri.e1);
+    float v = dot(ray.direction, q) * inv_det;
+    if (v < 0.0 || u + v > 1.0) return false;
+
+    float t = dot(tri.e2, q) * inv_det;
+    if (t < t_min || t > t_max) return false;
 
     t_hit = t;
+    barycentrics = vec2(u, v);
+    return true;
+}
+
+HitRecord triangle_record(Triangle tri, Ray ray, float t, vec2 barycentrics) {
+    HitRecord record;
+    record.t = t;
+    record.point = ray.origin + t * ray.direction;
+    vec3 n = cross(tri.e1, tri.e2);
+    record.normal = normalize(n);
+    record.area = 0.5 * length(n);
+    record.radius = 0.0;
+    record.uv = tri.uv0 + barycentrics.x * tri.duv1 +
+        barycentrics.y * tri.duv2;
+    record.uv_density = abs(tri.duv1.x * tri.duv2.y -
+        tri.duv1.y * tri.duv2.x) / length(n);
+    record.material = tri.material;
+    return record;
+}
+
+// The closest candidate of a traversal: a plane index, or an instance and
+// one of its BLAS primitives (index << 1 | is_triangle).
+struct Hit {
+    float t;
+    int instance; // -1 for planes
+    int primitive;
+    vec2 barycentrics;
+};
+
+// Entry distance of a ray into a box, or FLT_MAX if it misses or enters
+// beyond t_max.
+float hit_aabb(vec3 box_min, vec3 box_max, vec3 origin, vec3 inv_dir,
+    float t_max) {
+    vec3 t0 = (box_min - origin) * inv_dir;
+    vec3 t1 = (box_max - origin) * inv_dir;
+    vec3 near = min(t0, t1);
+    vec3 far = max(t0, t1);
+    float t_enter = max(max(near.x, near.y), max(near.z, 0.0));
+    float t_exit = min(min(far.x, far.y), min(far.z, t_max));
+    return t_enter <= t_exit ? t_enter : FLT_MAX;
+}
+
+// At least kBvhMaxDepth in bvh.h, which build_bvh() never exceeds, so the
+// bound check below is only a guard against overrunning.
+const int BVH_STACK_SIZE = 32;
+
+// Walks one bottom-level BVH with an object-space ray. The direction is not
+// renormalized, so t values stay comparable with the world-space ray.
+bool hit_blas(int root, Ray ray, float t_min, inout float closest_t,
+    bool any_hit, out int closest, out vec2 barycentrics) {
+    vec3 inv_dir = 1.0 / ray.direction;
+    int stack[BVH_STACK_SIZE];
+    int sp = 0;
+    int node = root;
+    bool hit_anything = false;
+    float t;
+
+    while (true) {
+        vec4 a = scene_texel(SEC_BLAS_NODES, node * 2);
+        vec4 b = scene_texel(SEC_BLAS_NODES, node * 2 + 1);
+        int first = floatBitsToInt(a.w);
+        int count = floatBitsToInt(b.w);
+
+        if (count > 0) {
+            for (int i = first; i < first + count; ++i) {
+                int primitive = fetch_primitive(i);
+                int index = primitive >> 1;
+                bool hit;
+                vec2 uv = vec2(0.0);
+                if ((primitive & 1) == 0) {
+                    hit = hit_sphere(fetch_sphere(index), ray, t_min,
+                        closest_t, t);
+                } else {
+                    hit = hit_triangle(fetch_triangle(index), ray, t_min,
+                        closest_t, t, uv);
+                }
+                if (hit) {
+                    closest_t = t;
+                    hit_anything = true;
+                    closest = primitive;
+                    barycentrics = uv;
+                    if (any_hit) return true;
+                }
+            }
+        } else {
+            vec4 la = scene_texel(SEC_BLAS_NODES, first * 2);
+            vec4 lb = scene_texel(SEC_BLAS_NODES, first * 2 + 1);
+            vec4 ra = scene_texel(SEC_BLAS_NODES, first * 2 + 2);
+            vec4 rb = scene_texel(SEC_BLAS_NODES, first * 2 + 3);
+            float t_left = hit_aabb(la.xyz, lb.xyz, ray.origin, inv_dir,
+                closest_t);
+            float t_right = hit_aabb(ra.xyz, rb.xyz, ray.origin, inv_dir,
+                closest_t);
+            int near_node = first;
+            int far_node = first + 1;
+            if (t_right < t_left) {
+                float tmp = t_left;
+                t_left = t_right;
+                t_right = tmp;
+                near_node = first + 1;
+                far_node = first;
+            }
+            if (t_left < FLT_MAX) {
+                if (t_right < FLT_MAX && sp < BVH_STACK_SIZE) {
+                    stack[sp++] = far_node;
+                }
+                node = near_node;
+                continue;
+            }
+        }
+
+        if (sp == 0) break;
+        node = stack[--sp];
+    }
+    return hit_anything;
+}
+
+// Instance i's world-to-object rows and its info texel (BLAS root,
+// material override).
+void fetch_instance(int i, out vec4 r0, out vec4 r1, out vec4 r2,
+    out vec4 info) {
+    r0 = scene_texel(SEC_INSTANCES, i * 4);
+    r1 = scene_texel(SEC_INSTANCES, i * 4 + 1);
+    r2 = scene_texel(SEC_INSTANCES, i * 4 + 2);
+    info = scene_texel(SEC_INSTANCES, i * 4 + 3);
+}
+
+Ray object_ray(Ray ray, vec4 r0, vec4 r1, vec4 r2) {
+    vec4 o = vec4(ray.origin, 1.0);
+    return Ray(vec3(dot(r0, o), dot(r1, o), dot(r2, o)),
+        vec3(dot(r0.xyz, ray.direction), dot(r1.xyz, ray.direction),
+            dot(r2.xyz, ray.direction)));
+}
+
+// Walks the top-level BVH over instances, handing each instance's BLAS a ray
+// transformed into object space.
+bool hit_instances(Ray ray, float t_min, inout float closest_t, bool any_hit,
+    inout Hit hit) {
+    if (u_num_instances == 0) return false;
+
+    vec3 inv_dir = 1.0 / ray.direction;
+    int stack[BVH_STACK_SIZE];
+    int sp = 0;
+    int node = 0;
+    bool hit_anything = false;
+
+    while (true) {
+        vec4 a = scene_texel(SEC_TLAS_NODES, node * 2);
+        vec4 b = scene_texel(SEC_TLAS_NODES, node * 2 + 1);
+        int first = floatBitsToInt(a.w);
+        int count = floatBitsToInt(b.w);
+
+        if (count > 0) {
+            for (int i = first; i < first + count; ++i) {
+                vec4 r0, r1, r2, info;
+                fetch_instance(i, r0, r1, r2, info);
+                int primitive;
+                vec2 barycentrics;
+                if (hit_blas(floatBitsToInt(info.x),
+                    object_ray(ray, r0, r1, r2), t_min, closest_t, any_hit,
+                    primitive, barycentrics)) {
+                    hit_anything = true;
+                    if (any_hit) return true;
+                    hit = Hit(closest_t, i, primitive, barycentrics);
+                }
+            }
+        } else {
+            vec4 la = scene_texel(SEC_TLAS_NODES, first * 2);
+            vec4 lb = scene_texel(SEC_TLAS_NODES, first * 2 + 1);
+            vec4 ra = scene_texel(SEC_TLAS_NODES, first * 2 + 2);
+            vec4 rb = scene_texel(SEC_TLAS_NODES, first * 2 + 3);
+            float t_left = hit_aabb(la.xyz, lb.xyz, ray.origin, inv_dir,
+                closest_t);
+            float t_right = hit_aabb(ra.xyz, rb.xyz, ray.origin, inv_dir,
+                closest_t);
+            int near_node = first;
+            int far_node = first + 1;
+            if (t_right < t_left) {
+                float tmp = t_left;
+                t_left = t_right;
+                t_right = tmp;
+                near_node = first + 1;
+                far_node = first;
+            }
+            if (t_left < FLT_MAX) {
+                if (t_right < FLT_MAX && sp < BVH_STACK_SIZE) {
+                    stack[sp++] = far_node;
+                }
+                node = near_node;
+                continue;
+            }
+        }
+
+        if (sp == 0) break;
+        node = stack[--sp];
+    }
+    return hit_anything;
+}
+
+// The full record of a hit found by traversal, refetching what it needs.
+HitRecord surface_record(Ray ray, Hit hit) {
+    if (hit.instance < 0) {
+        return plane_record(fetch_plane(hit.primitive), ray, hit.t);
+    }
+
+    vec4 r0, r1, r2, info;
+    fetch_instance(hit.instance, r0, r1, r2, info);
+    Ray local = object_ray(ray, r0, r1, r2);
+    int index = hit.primitive >> 1;
+    HitRecord record = (hit.primitive & 1) == 0 ?
+        sphere_record(fetch_sphere(index), local, hit.t) :
+        triangle_record(fetch_triangle(index), local, hit.t,
+            hit.barycentrics);
+
+    // Normals go back through the inverse transpose, which is the
+    // transpose of world-to-object. Areas scale by the length of that over
+    // the determinant; spheres are taken to scale uniformly, as
+    // build_lights() assumes. The uv density scales the other way.
+    vec3 n = record.normal;
+    vec3 world_n = r0.xyz * n.x + r1.xyz * n.y + r2.xyz * n.z;
+    float det = abs(dot(r0.xyz, cross(r1.xyz, r2.xyz)));
+    record.point = ray.origin + hit.t * ray.direction;
+    record.normal = normalize(world_n);
+    float area_scale;
+    if (record.radius > 0.0) {
+        float scale = pow(det, -1.0 / 3.0);
+        record.radius *= scale;
+        area_scale = scale * scale;
+    } else {
+        area_scale = length(world_n) / det;
+    }
+    record.area *= area_scale;
+    record.uv_density /= area_scale;
+    int override_material = floatBitsToInt(info.y);
+    if (override_material >= 0) {
+        record.material = override_material;
+    }
+    return record;
+}
+
+// Closest hit over the whole scene. Traversal carries only a Hit; the
+// record is built once, for the winner.
+bool hit_world(Ray ray, float t_min, float t_max, out HitRecord record) {
+    float t;
+    float closest_t = t_max;
+    Hit hit = Hit(t_max, -1, -1, vec2(0.0));
+
+    for (int i = 0; i < u_num_planes; ++i) {
+        if (hit_plane(fetch_plane(i), ray, t_min, closest_t, t)) {
+            closest_t = t;
+            hit = Hit(t, -1, i, vec2(0.0));
+        }
+    }
+    hit_instances(ray, t_min, closest_t, false, hit);
+
+    if (hit.primitive < 0) {
+        return false;
+    }
+    record = surface_record(ray, hit);
     return true;
 }
 
+// Any-hit query for shadow rays.
+bool occluded(Ray ray, float t_min, float t_max) {
+    float t;
+    for (int i = 0; i < u_num_planes; ++i) {
+        if (hit_plane(fetch_plane(i), ray, t_min, t_max, t))
+            return true;
+    }
+    float closest_t = t_max;
+    Hit hit = Hit(t_max, -1, -1, vec2(0.0));
+    return hit_instances(ray, t_min, closest_t, true, hit);
+}
+
+// Octahedral normal encoding (Cigolle et al. 2014).
+vec2 oct_encode(vec3 n) {
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    vec2 folded = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0,
+        n.y >= 0.0 ? 1.0 : -1.0);
+    return n.z >= 0.0 ? n.xy : folded;
+}
+
+vec3 oct_decode(vec2 e) {
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+    return normalize(n);
+}
+
+// The primary cache target has three attachments, which take the first
+// three outputs. The material is stored as a float: integer bit patterns
+// are denormals that a render target may flush to zero.
+void store_primary(bool hit_anything, HitRecord record) {
+    if (!hit_anything) {
+        fragColor = vec4(0.0, 0.0, 0.0, -1.0);
+        return;
+    }
+    fragColor = vec4(record.point, float(record.material));
+    gbuffer = vec4(oct_encode(record.normal), record.uv);
+    gbuffer_normal = vec4(record.area, record.radius, record.uv_density,
+        record.t);
+}
+
+bool load_primary(int layer, out HitRecord record) {
+    ivec3 texel = ivec3(gl_FragCoord.xy, layer);
+    vec4 a = texelFetch(u_primary_point, texel, 0);
+    if (a.w < 0.0) {
+        return false;
+    }
+    vec4 b = texelFetch(u_primary_normal, texel, 0);
+    vec4 c = texelFetch(u_primary_surface, texel, 0);
+    record.point = a.xyz;
+    record.material = int(a.w);
+    record.normal = oct_decode(b.xy);
+    record.uv = b.zw;
+    record.area = c.x;
+    record.radius = c.y;
+    record.uv_density = c.z;
+    record.t = c.w;
+    return true;
+}
+
+// Closest hit along `ray`, read from primary cache layer `cached` instead
+// when that is not -1.
+bool hit_bounce(Ray ray, int cached, out HitRecord record) {
+    if (cached >= 0) {
+        return load_primary(cached, record);
+    }
+    return hit_world(ray, 0.001, FLT_MAX, record);
+}
+
 vec3 plane_grid_color(vec3 hit_pos) {
     float scale = 1.0;
     vec2 p = hit_pos.xz * scale;
@@ -130,28 +622,125 @@ vec3 plane_grid_color(vec3 hit_pos) {
     return mix(lines, base, mask);
 }
 
-float random(vec2 st) {
-    return fract(sin(dot(st.xy, vec2(12.9898, 78.233))) * 43758.5453123);
+// PCG hash (Jarzynski and Olano 2020). Every path draws from its own
+// stream, seeded per pixel and frame.
+uint pcg(uint v) {
+    uint state = v * 747796405u + 2891336453u;
+    uint word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+    return (word >> 22u) ^ word;
+}
+
+float random(inout uint rng) {
+    rng = pcg(rng);
+    return float(rng >> 8u) * (1.0 / 16777216.0);
+}
+
+vec2 random2(inout uint rng) {
+    float x = random(rng);
+    return vec2(x, random(rng));
+}
+
+// Direction within `cos_max` of `axis`, uniform over the cone's solid angle.
+vec3 sample_cone(vec3 axis, float cos_max, vec2 u) {
+    float cos_theta = 1.0 - u.x * (1.0 - cos_max);
+    float sin_theta = sqrt(max(0.0, 1.0 - cos_theta * cos_theta));
+    float phi = 2.0 * M_PI * u.y;
+    return basis(axis) *
+        vec3(sin_theta * cos(phi), sin_theta * sin(phi), cos_theta);
+}
+
+// Environment: the gradient sky or an HDR map, plus a sun disc of finite
+// angular radius. The sun's radiance is scaled so that a white Lambert
+// surface facing it still reflects u_sun_color * u_sun_intensity, whatever
+// its size.
+
+vec3 sun_direction() {
+    return normalize(u_sun_direction);
+}
+
+float sun_cos_max() {
+    return cos(radians(max(u_sun_angular_radius, 0.01)));
+}
+
+vec3 sun_radiance() {
+    float solid_angle = 2.0 * M_PI * (1.0 - sun_cos_max());
+    return u_sun_color * u_sun_intensity * M_PI / solid_angle;
+}
+
+// Equirectangular mapping: u follows the azimuth from +x towards +z, v the
+// polar angle from +y, with the top row of the map straight up.
+vec2 equirect_uv(vec3 dir) {
+    return vec2(atan(dir.z, dir.x) / (2.0 * M_PI) + 0.5,
+        acos(clamp(dir.y, -1.0, 1.0)) / M_PI);
 }
 
-vec3 random_in_unit_sphere(vec2 rnd_state) {
-    vec3 p;
+vec3 equirect_direction(vec2 uv) {
+    float phi = (uv.x - 0.5) * 2.0 * M_PI;
+    float theta = uv.y * M_PI;
+    return vec3(sin(theta) * cos(phi), cos(theta), sin(theta) * sin(phi));
+}
 
-    for (int i = 0; i < 4; ++i) {
-        p = vec3(
-                random(rnd_state + vec2(1.0, 0.0)),
-                random(rnd_state + vec2(0.0, 1.0)),
-                random(rnd_state + vec2(1.0, 1.0))
-            ) * 2.0 - 1.0;
+vec3 sky_radiance(vec3 dir) {
+    if (u_env_enabled) {
+        return textureLod(u_env_map, equirect_uv(dir), 0.0).rgb *
+            u_sky_intensity;
+    }
+    float t = 0.5 * (dir.y + 1.0);
+    return mix(vec3(1.0), u_sky_color, t) * u_sky_intensity;
+}
 
-        if (dot(p, p) < 1.0)
-            return p;
+// Only HDR maps are worth sampling directly; the gradient is smooth enough
+// that the cosine lobe does better on its own.
+bool sky_sampled() {
+    return u_env_enabled && u_env_cells.x > 0 && u_sky_intensity > 0.0;
+}
+
+// A cell's pmf spread uniformly over its (u, v) rectangle, converted to
+// solid angle.
+float env_cell_pdf(float pmf, float sin_theta) {
+    float cells = float(u_env_cells.x * u_env_cells.y);
+    return sin_theta > 0.0 ? pmf * cells / (2.0 * M_PI * M_PI * sin_theta) :
+        0.0;
+}
+
+// Density of sample_env() in direction `dir`.
+float env_pdf(vec3 dir) {
+    vec2 uv = equirect_uv(dir);
+    ivec2 cell = min(ivec2(uv * vec2(u_env_cells)), u_env_cells - 1);
+    float pmf = texelFetch(u_env_distribution, cell, 0).z;
+    return env_cell_pdf(pmf, sqrt(max(0.0, 1.0 - dir.y * dir.y)));
+}
 
-        rnd_state += 13.37; // decorrelate on retry
+// Picks a row, then a cell within it, from their alias tables (the
+// fraction left over from each pick decides between a slot and its alias),
+// then a point within the cell.
+vec3 sample_env(inout uint rng, out float pdf) {
+    vec2 u = random2(rng) * vec2(u_env_cells.yx);
+    int y = min(int(u.x), u_env_cells.y - 1);
+    vec3 row = texelFetch(u_env_distribution, ivec2(y, u_env_cells.y), 0).xyz;
+    if (u.x - float(y) >= row.x) {
+        y = int(row.y);
     }
+    int x = min(int(u.y), u_env_cells.x - 1);
+    vec3 cell = texelFetch(u_env_distribution, ivec2(x, y), 0).xyz;
+    if (u.y - float(x) >= cell.x) {
+        x = int(cell.y);
+        cell = texelFetch(u_env_distribution, ivec2(x, y), 0).xyz;
+    }
+    vec2 uv = (vec2(x, y) + random2(rng)) / vec2(u_env_cells);
+    vec3 dir = equirect_direction(uv);
+    pdf = env_cell_pdf(cell.z, sin(uv.y * M_PI));
+    return dir;
+}
+
+// Density of sample_cone() over the sun disc.
+float sun_pdf() {
+    return 1.0 / (2.0 * M_PI * (1.0 - sun_cos_max()));
+}
 
-    // fallback to guarantee return
-    return normalize(p) * random(rnd_state + 42.0);
+float power_heuristic(float pdf_a, float pdf_b) {
+    float a = pdf_a * pdf_a;
+    return a / (a + pdf_b * pdf_b);
 }
 
 float schlick(float cosine, float ref_idx) {
@@ -160,144 +749,542 @@ float schlick(float cosine, float ref_idx) {
     return r0 + (1.0 - r0) * pow(1.0 - cosine, 5.0);
 }
 
-bool scatter_lambert(HitRecord record, out vec3 attenuation, out Ray scattered,
-    vec2 rnd_state) {
-    vec3 target = record.point + record.normal + random_in_unit_sphere(rnd_state);
-    scattered = Ray(record.point, target - record.point);
-    attenuation = record.material.albedo;
+// Cosine-weighted, so the sample weight f cos / pdf is just the albedo and
+// the pdf is cos / pi.
+bool scatter_lambert(HitRecord record, vec3 albedo, out vec3 attenuation,
+    out Ray scattered, inout uint rng) {
+    vec2 u = random2(rng);
+    float r = sqrt(u.x);
+    float phi = 2.0 * M_PI * u.y;
+    vec3 local = vec3(r * cos(phi), r * sin(phi), sqrt(max(0.0, 1.0 - u.x)));
+    scattered = Ray(record.point, basis(record.normal) * local);
+    attenuation = albedo;
     return true;
 }
 
-bool scatter_metal(Ray ray_in, HitRecord record, out vec3 attenuation,
-    out Ray scattered, vec2 rnd_state) {
-    vec3 reflected = reflect(normalize(ray_in.direction), record.normal);
-    vec3 roughness_dir = record.material.roughness * random_in_unit_sphere(rnd_state);
-    scattered = Ray(record.point, reflected + roughness_dir);
-    attenuation = record.material.albedo;
-    return dot(scattered.direction, record.normal) > 0.0;
+// Metal and glass are GGX microfacet surfaces with alpha = roughness^2,
+// roughness 0 being all but a mirror. Microfacet normals are drawn from the
+// distribution of those visible from the incoming side, so the sample
+// weight f cos / pdf reduces to F G2 / G1 and no direction is wasted on
+// facets facing away. A single-scattering lobe still loses the light that
+// bounces between facets, more the rougher it is; it is added back by
+// scaling with 1 + F0 (1 / E - 1) (Turquin 2019), E being the lobe's
+// directional albedo from the tables built by ggx_albedo.cpp.
+
+float ggx_alpha(float roughness) {
+    return max(roughness * roughness, 1e-3);
+}
+
+// Smith Lambda, in terms of the cosine to the normal.
+float ggx_lambda(float cos_theta, float alpha) {
+    float cos2 = max(cos_theta * cos_theta, 1e-8);
+    float tan2 = max(1.0 - cos2, 0.0) / cos2;
+    return 0.5 * (sqrt(1.0 + alpha * alpha * tan2) - 1.0);
 }
 
-bool scatter_dielectric(Ray ray_in, HitRecord record, out vec3 attenuation,
-    out Ray scattered, vec2 rnd_state) {
-    attenuation = vec3(1.0);
+// G2 / G1 for the height-correlated masking-shadowing function.
+float ggx_masking(float cos_o, float cos_i, float alpha) {
+    float lambda_o = ggx_lambda(cos_o, alpha);
+    return (1.0 + lambda_o) / (1.0 + lambda_o + ggx_lambda(cos_i, alpha));
+}
+
+// Heitz 2018, "Sampling the GGX Distribution of Visible Normals", with `v`
+// in the local frame of basis(), normal along +z. Keep in step with
+// ggx_albedo.cpp.
+vec3 sample_ggx_vndf(vec3 v, float alpha, vec2 u) {
+    vec3 vh = normalize(vec3(alpha * v.xy, v.z));
+    float lensq = dot(vh.xy, vh.xy);
+    vec3 t1 = lensq > 0.0 ? vec3(-vh.y, vh.x, 0.0) * inversesqrt(lensq)
+        : vec3(1.0, 0.0, 0.0);
+    vec3 t2 = cross(vh, t1);
+    float r = sqrt(u.x);
+    float phi = 2.0 * M_PI * u.y;
+    float p1 = r * cos(phi);
+    float p2 = r * sin(phi);
+    float s = 0.5 * (1.0 + vh.z);
+    p2 = (1.0 - s) * sqrt(max(1.0 - p1 * p1, 0.0)) + s * p2;
+    vec3 nh = p1 * t1 + p2 * t2 +
+        sqrt(max(1.0 - p1 * p1 - p2 * p2, 0.0)) * vh;
+    return normalize(vec3(alpha * nh.xy, max(nh.z, 0.0)));
+}
+
+// The tables' grids include both ends, so lookups go through texel
+// centers.
+float ggx_albedo(float cos_theta, float roughness) {
+    vec2 size = vec2(textureSize(u_ggx_albedo, 0));
+    vec2 uv = (clamp(vec2(cos_theta, roughness), 0.0, 1.0) * (size - 1.0) +
+        0.5) / size;
+    return texture(u_ggx_albedo, uv).r;
+}
+
+// Layers run over log(eta) from 1 / 3 to 3, GgxAlbedoTable::kMaxEta.
+float ggx_dielectric_albedo(float cos_theta, float roughness, float eta) {
+    vec3 size = vec3(textureSize(u_ggx_dielectric_albedo, 0));
+    vec3 uvw = vec3(cos_theta, roughness, 0.5 + 0.5 * log(eta) / log(3.0));
+    uvw = (clamp(uvw, 0.0, 1.0) * (size - 1.0) + 0.5) / size;
+    return texture(u_ggx_dielectric_albedo, uvw).r;
+}
+
+bool scatter_metal(Ray ray_in, HitRecord record, Material material,
+    out vec3 attenuation, out Ray scattered, inout uint rng) {
+    mat3 frame = basis(record.normal);
+    vec3 wo = -normalize(ray_in.direction) * frame;
+    if (wo.z <= 0.0) return false;
+
+    float roughness = material.roughness;
+    float alpha = ggx_alpha(roughness);
+    vec3 m = sample_ggx_vndf(wo, alpha, random2(rng));
+    vec3 wi = reflect(-wo, m);
+    if (wi.z <= 0.0) return false;
+
+    vec3 f0 = material.albedo;
+    vec3 fresnel = f0 + (1.0 - f0) * pow(1.0 - max(dot(wo, m), 0.0), 5.0);
+    vec3 compensation = 1.0 + f0 * (1.0 / ggx_albedo(wo.z, roughness) - 1.0);
+    attenuation = fresnel * ggx_masking(wo.z, wi.z, alpha) * compensation;
+    scattered = Ray(record.point, frame * wi);
+    return true;
+}
+
+// Glass picks reflection or refraction about the sampled microfacet by its
+// Fresnel term, which leaves G2 / G1 as the weight either way. Nothing is
+// absorbed, so the whole of its lost energy comes back: 1 / E.
+bool scatter_dielectric(Ray ray_in, HitRecord record, Material material,
+    out vec3 attenuation, out Ray scattered, inout uint rng) {
     vec3 unit_dir = normalize(ray_in.direction);
+    bool entering = dot(unit_dir, record.normal) < 0.0;
+    float eta = material.ior;
+    float refraction_ratio = entering ? 1.0 / eta : eta;
+    mat3 frame = basis(entering ? record.normal : -record.normal);
+    vec3 wo = -unit_dir * frame;
 
-    float cos_theta = min(dot(-unit_dir, record.normal), 1.0);
+    float roughness = material.roughness;
+    float alpha = ggx_alpha(roughness);
+    vec3 m = sample_ggx_vndf(wo, alpha, random2(rng));
+    float cos_theta = min(dot(wo, m), 1.0);
     float sin_theta = sqrt(max(0.0, 1.0 - cos_theta * cos_theta));
 
-    float eta = record.material.ior;
-    vec3 outward_normal = record.normal;
-    float refraction_ratio = 1.0 / eta;
-    if (dot(unit_dir, record.normal) > 0.0) {
-        outward_normal = -record.normal;
-        refraction_ratio = eta;
-        cos_theta = min(dot(-unit_dir, outward_normal), 1.0);
-    }
-
     bool cannot_refract = refraction_ratio * sin_theta > 1.0;
     float reflect_prob = schlick(cos_theta, refraction_ratio);
 
-    if (cannot_refract || random(rnd_state) < reflect_prob) {
-        vec3 reflected = reflect(unit_dir, record.normal);
-        scattered = Ray(record.point, reflected);
+    vec3 wi;
+    if (cannot_refract || random(rng) < reflect_prob) {
+        wi = reflect(-wo, m);
+        if (wi.z <= 0.0) return false;
     } else {
-        vec3 refracted = refract(unit_dir, outward_normal, refraction_ratio);
-        scattered = Ray(record.point, refracted);
+        wi = refract(-wo, m, refraction_ratio);
+        if (wi.z >= 0.0) return false;
     }
 
+    attenuation = vec3(ggx_masking(wo.z, abs(wi.z), alpha) /
+        ggx_dielectric_albedo(wo.z, roughness, refraction_ratio));
+    scattered = Ray(record.point, frame * wi);
     return true;
 }
 
-bool scatter(Ray ray_in, HitRecord record, out vec3 attenuation, out Ray scattered,
-    vec2 rnd_state) {
-    if (record.material.type == MAT_METAL) {
-        return scatter_metal(ray_in, record, attenuation, scattered, rnd_state);
+bool scatter(Ray ray_in, HitRecord record, Material material,
+    out vec3 attenuation, out Ray scattered, inout uint rng) {
+    if (material.type == MAT_METAL) {
+        return scatter_metal(ray_in, record, material, attenuation,
+            scattered, rng);
+    }
+    if (material.type == MAT_DIELECTRIC) {
+        return scatter_dielectric(ray_in, record, material, attenuation,
+            scattered, rng);
+    }
+
+    return scatter_lambert(record, material.albedo, attenuation, scattered,
+        rng);
+}
+
+// Ray cones (Akenine-Moller et al. 2021, "Improved Shader and Texture Level
+// of Detail Using Ray Cones"): every path carries a cone, starting at the
+// camera with the angle one pixel subtends, whose width where it meets a
+// surface picks the mip level. Bounces widen it by a rough estimate of the
+// lobe they sample, so the blurry incoming light of diffuse and rough
+// surfaces reads small, cache-friendly mips. Surface curvature is ignored.
+
+const float DIFFUSE_CONE_SPREAD = 0.5; // radians added by a Lambert bounce
+
+float pixel_spread_angle() {
+    return atan(2.0 * tan(radians(u_camera.fov) * 0.5) / iResolution.y);
+}
+
+// Multiplies the albedo by the material's texture, filtered over the
+// footprint of a cone `cone_width` wide arriving along `direction`.
+void apply_texture(inout Material material, HitRecord record, vec3 direction,
+    float cone_width) {
+    int layer = material.texture;
+    if (layer < 0 || layer >= u_texture_layers) {
+        return;
+    }
+    float scale = material.texture_scale;
+    float texels = float(textureSize(u_textures, 0).x) * scale;
+    float cos_theta = abs(dot(record.normal, normalize(direction)));
+    float lod = 0.5 * log2(record.uv_density * texels * texels) +
+        log2(cone_width) - log2(max(cos_theta, 1e-4));
+    material.albedo *= textureLod(u_textures,
+        vec3(record.uv * scale, float(layer)), lod).rgb;
+}
+
+struct PrimaryHit {
+    vec4 position;
+    vec3 normal;
+    vec3 albedo; // divided out of the lighting before denoising
+};
+
+PrimaryHit primary_hit(Ray ray, bool hit_anything, HitRecord record,
+    Material material) {
+    if (!hit_anything) {
+        return PrimaryHit(vec4(normalize(ray.direction), 0.0), vec3(0.0),
+            vec3(1.0));
+    }
+    // Emitted light is not modulated by the albedo, so it stays out of the
+    // demodulation too.
+    bool plain = material.type == MAT_DIELECTRIC ||
+        any(greaterThan(material.emission, vec3(0.0)));
+    vec3 albedo = plain ? vec3(1.0) : material.albedo;
+    return PrimaryHit(vec4(record.point, record.t), record.normal, albedo);
+}
+
+// The primary hit alone, for pixels that are not path traced.
+PrimaryHit find_primary(Ray ray, int cached, out HitRecord record,
+    out bool hit_anything) {
+    hit_anything = hit_bounce(ray, cached, record);
+    Material material;
+    if (hit_anything) {
+        material = fetch_material(record.material);
+        apply_texture(material, record, ray.direction,
+            pixel_spread_angle() * record.t);
+    }
+    return primary_hit(ray, hit_anything, record, material);
+}
+
+// Next-event estimation at a Lambert surface: a shadow ray towards a
+// point on the sun disc, with an HDR map one towards a direction drawn
+// from it, and with emissive primitives one towards a point on one of
+// them, each MIS-weighted against the cosine lobe that scatter_lambert()
+// samples. The gradient sky is left to the cosine lobe.
+vec3 light_sample(HitRecord record, vec3 albedo, vec3 dir, float distance,
+    float pdf, vec3 radiance) {
+    float cos_theta = dot(record.normal, dir);
+    if (cos_theta <= 0.0 || pdf <= 0.0) {
+        return vec3(0.0);
+    }
+    Ray shadow_ray = Ray(record.point + record.normal * 0.001, dir);
+    if (occluded(shadow_ray, 0.001, distance)) {
+        return vec3(0.0);
+    }
+    float weight = power_heuristic(pdf, cos_theta / M_PI);
+    return albedo / M_PI * radiance * cos_theta * weight / pdf;
+}
+
+// Emissive spheres and triangles, gathered by build_lights() into world
+// space. One is picked per shading point from an alias table in proportion
+// to its power, so the cost does not grow with the number of lights, then
+// a point on it: uniform over a triangle's area, or uniform over the cone
+// a sphere subtends.
+
+float luminance(vec3 c) {
+    return dot(c, vec3(0.2126, 0.7152, 0.0722));
+}
+
+float light_total_power() {
+    return scene_texel(SEC_LIGHTS, 0).x;
+}
+
+// Probability of picking an emitter, from the same power the alias table
+// was built with.
+float emitter_pick_pdf(vec3 emission, float area) {
+    return luminance(emission) * area * M_PI / light_total_power();
+}
+
+// Solid angle of a sphere seen from a point outside it, written so small,
+// distant spheres keep their precision.
+float sphere_solid_angle(float radius_sq, float distance_sq,
+    out float cos_max) {
+    float sin_sq = radius_sq / distance_sq;
+    cos_max = sqrt(max(0.0, 1.0 - sin_sq));
+    return 2.0 * M_PI * sin_sq / (1.0 + cos_max);
+}
+
+vec3 sample_emitter(HitRecord record, vec3 albedo, inout uint rng) {
+    if (u_num_lights == 0 || light_total_power() <= 0.0) {
+        return vec3(0.0);
     }
-    if (record.material.type == MAT_DIELECTRIC) {
-        return scatter_dielectric(ray_in, record, attenuation, scattered,
-            rnd_state);
+    float f = random(rng) * float(u_num_lights);
+    int i = min(int(f), u_num_lights - 1);
+    vec4 e1 = scene_texel(SEC_LIGHTS, 1 + i * 4 + 1);
+    vec4 e2 = scene_texel(SEC_LIGHTS, 1 + i * 4 + 2);
+    if (f - float(i) >= e1.w) {
+        i = int(e2.w);
+        e1 = scene_texel(SEC_LIGHTS, 1 + i * 4 + 1);
+        e2 = scene_texel(SEC_LIGHTS, 1 + i * 4 + 2);
     }
+    vec4 p = scene_texel(SEC_LIGHTS, 1 + i * 4);
+    vec3 emission = scene_texel(SEC_LIGHTS, 1 + i * 4 + 3).rgb;
 
-    return scatter_lambert(record, attenuation, scattered, rnd_state);
+    vec3 dir;
+    float distance;
+    float pdf;
+    if (p.w > 0.0) {
+        vec3 to_center = p.xyz - record.point;
+        float distance_sq = dot(to_center, to_center);
+        float radius_sq = p.w * p.w;
+        if (distance_sq <= radius_sq) {
+            return vec3(0.0);
+        }
+        float cos_max;
+        float solid_angle = sphere_solid_angle(radius_sq, distance_sq,
+            cos_max);
+        dir = sample_cone(to_center * inversesqrt(distance_sq), cos_max,
+            random2(rng));
+        float b = dot(dir, to_center);
+        distance = b - sqrt(max(0.0, radius_sq - distance_sq + b * b));
+        pdf = emitter_pick_pdf(emission, 4.0 * M_PI * radius_sq) /
+            solid_angle;
+    } else {
+        vec2 u = random2(rng);
+        if (u.x + u.y > 1.0) {
+            u = 1.0 - u;
+        }
+        vec3 to_point = p.xyz + e1.xyz * u.x + e2.xyz * u.y - record.point;
+        distance = length(to_point);
+        dir = to_point / distance;
+        vec3 n = cross(e1.xyz, e2.xyz);
+        float area = 0.5 * length(n);
+        float cos_light = -dot(n, dir) * 0.5 / area;
+        if (cos_light <= 0.0) {
+            return vec3(0.0);
+        }
+        pdf = emitter_pick_pdf(emission, area) * distance * distance /
+            (area * cos_light);
+    }
+    return light_sample(record, albedo, dir, distance * 0.999, pdf,
+        emission);
 }
 
-vec3 trace(Ray ray, vec2 rnd_state) {
+// Density with which sample_emitter(), from `origin`, would have picked
+// the emitter point in `record`; 0 for anything it never samples.
+float emitter_pdf(vec3 origin, HitRecord record, vec3 emission) {
+    if (u_num_lights == 0 || record.area <= 0.0 ||
+        light_total_power() <= 0.0) {
+        return 0.0;
+    }
+    float pick = emitter_pick_pdf(emission, record.area);
+    vec3 to_point = record.point - origin;
+    float distance_sq = dot(to_point, to_point);
+    if (record.radius > 0.0) {
+        vec3 to_center = to_point - record.normal * record.radius;
+        float center_sq = dot(to_center, to_center);
+        float radius_sq = record.radius * record.radius;
+        if (center_sq <= radius_sq) {
+            return 0.0;
+        }
+        float cos_max;
+        return pick / sphere_solid_angle(radius_sq, center_sq, cos_max);
+    }
+    float cos_light = abs(dot(record.normal, to_point)) *
+        inversesqrt(distance_sq);
+    return pick * distance_sq / (record.area * max(cos_light, 1e-6));
+}
+
+vec3 sample_direct(HitRecord record, vec3 albedo, inout uint rng) {
+    vec3 direct = vec3(0.0);
+    if (u_sun_intensity > 0.0) {
+        vec3 dir = sample_cone(sun_direction(), sun_cos_max(), random2(rng));
+        direct += light_sample(record, albedo, dir, FLT_MAX, sun_pdf(),
+            sun_radiance());
+    }
+    if (sky_sampled()) {
+        float pdf;
+        vec3 dir = sample_env(rng, pdf);
+        direct += light_sample(record, albedo, dir, FLT_MAX, pdf,
+            sky_radiance(dir));
+    }
+    direct += sample_emitter(record, albedo, rng);
+    return direct;
+}
+
+// Light leaving the front of an emissive surface towards a ray from
+// `origin`, weighted against sample_emitter() like escaped_radiance()
+// below. Caustics are skipped for the same reason as there.
+vec3 emitted_radiance(vec3 origin, vec3 dir, HitRecord record,
+    vec3 emission, float bsdf_pdf, bool caustic) {
+    if (caustic || dot(dir, record.normal) >= 0.0 ||
+        all(lessThanEqual(emission, vec3(0.0)))) {
+        return vec3(0.0);
+    }
+    if (bsdf_pdf > 0.0) {
+        emission *= power_heuristic(bsdf_pdf,
+            emitter_pdf(origin, record, emission));
+    }
+    return emission;
+}
+
+// Environment light reached by a bounce whose direction had density
+// `bsdf_pdf` (0 for directions sample_direct() cannot produce). Once a path
+// has bounced off a diffuse surface the sun only arrives through
+// sample_direct(): reaching the small, bright disc by way of a mirror or
+// glass would be a caustic, which comes out as fireflies that never settle.
+vec3 escaped_radiance(vec3 dir, float bsdf_pdf, bool caustic) {
+    vec3 radiance = sky_radiance(dir);
+    if (bsdf_pdf > 0.0 && sky_sampled()) {
+        radiance *= power_heuristic(bsdf_pdf, env_pdf(dir));
+    }
+    if (!caustic && dot(dir, sun_direction()) >= sun_cos_max()) {
+        float weight = bsdf_pdf > 0.0 ?
+            power_heuristic(bsdf_pdf, sun_pdf()) : 1.0;
+        radiance += sun_radiance() * weight;
+    }
+    return radiance;
+}
+
+// `cached` is the primary cache layer holding the first hit of `ray`, or
+// -1 to find it.
+vec3 trace(Ray ray, int cached, inout uint rng, out PrimaryHit primary) {
     Ray cur_ray = ray;
     vec3 cur_attenuation = vec3(1.0, 1.0, 1.0);
     vec3 radiance = vec3(0.0);
+    // Density of the last bounce's direction when it came from the cosine
+    // lobe; 0 after the camera and specular bounces, which sample_direct()
+    // cannot stand in for.
+    float bsdf_pdf = 0.0;
+    bool after_diffuse = false;
+    float cone_width = 0.0;
+    float cone_spread = pixel_spread_angle();
 
     for (int i = 0; i < 50; i++) {
         HitRecord record;
-        HitRecord temp_record;
-
-        // hit anything
-        float t;
-        bool hit_anything = false;
-        float closest_t = FLT_MAX;
-
-        for (int i = 0; i < NUM_SPHERES; ++i) {
-            if (hit_sphere(spheres[i], materials[i], cur_ray, 0.001, closest_t,
-                t, temp_record)) {
-                closest_t = t;
-                hit_anything = true;
-                record = temp_record;
-            }
+        Material material;
+        bool hit_anything = hit_bounce(cur_ray, i == 0 ? cached : -1,
+            record);
+        if (hit_anything) {
+            material = fetch_material(record.material);
+            cone_width += cone_spread * record.t;
+            apply_texture(material, record, cur_ray.direction, cone_width);
         }
-        if (hit_plane(plane, cur_ray, 0.001, closest_t, t, temp_record)) {
-            vec3 hit_pos = ray.origin + t * ray.direction;
-            hit_anything = true;
-            record = temp_record;
+        if (i == 0) {
+            primary = primary_hit(cur_ray, hit_anything, record, material);
         }
 
         if (hit_anything) {
-            vec3 direct = vec3(0.0);
-            vec3 sun_dir = normalize(u_sun_direction);
-            Ray shadow_ray = Ray(record.point + record.normal * 0.001, sun_dir);
-            bool in_shadow = false;
-
-            for (int i = 0; i < NUM_SPHERES; ++i) {
-                if (hit_sphere(spheres[i], materials[i], shadow_ray, 0.001,
-                    FLT_MAX, t, temp_record)) {
-                    in_shadow = true;
-                    break;
-                }
-            }
-            if (!in_shadow &&
-                hit_plane(plane, shadow_ray, 0.001, FLT_MAX, t, temp_record)) {
-                in_shadow = true;
-            }
+            radiance += cur_attenuation * emitted_radiance(cur_ray.origin,
+                cur_ray.direction, record, material.emission, bsdf_pdf,
+                after_diffuse && bsdf_pdf == 0.0);
 
-            if (!in_shadow) {
-                float n_dot_l = max(dot(record.normal, sun_dir), 0.0);
-                direct = record.material.albedo * u_sun_color * u_sun_intensity *
-                    n_dot_l;
-                radiance += cur_attenuation * direct;
+            bool diffuse = material.type == MAT_LAMBERT;
+            if (diffuse) {
+                radiance += cur_attenuation *
+                    sample_direct(record, material.albedo, rng);
             }
 
             Ray scattered;
             vec3 attenuation;
-            if (scatter(cur_ray, record, attenuation, scattered, rnd_state)) {
+            if (scatter(cur_ray, record, material, attenuation, scattered,
+                rng)) {
                 cur_attenuation *= attenuation;
                 cur_ray = scattered;
+                bsdf_pdf = diffuse ? max(dot(record.normal,
+                    normalize(scattered.direction)), 0.0) / M_PI : 0.0;
+                after_diffuse = after_diffuse || diffuse;
+                cone_spread += diffuse ? DIFFUSE_CONE_SPREAD :
+                    2.0 * ggx_alpha(material.roughness);
             } else {
                 return radiance;
             }
         } else {
-            vec3 unit_direction = normalize(cur_ray.direction);
-            float t = 0.5f * (unit_direction.y + 1.0f);
-            vec3 sky_bottom = vec3(1.0, 1.0, 1.0);
-            vec3 sky_top = u_sky_color;
-            vec3 c = mix(sky_bottom, sky_top, t) * u_sky_intensity;
-            return radiance + cur_attenuation * c;
+            return radiance + cur_attenuation *
+                escaped_radiance(normalize(cur_ray.direction), bsdf_pdf,
+                    after_diffuse && bsdf_pdf == 0.0);
         }
     }
     return radiance; // exceeded "recursion"
 }
 
-void main() {
-    vec2 rnd_state = gl_FragCoord.xy / iResolution.xy * iTime;
+// Interleaved rendering traces every other pixel in a checkerboard (2) or
+// one pixel of each 2x2 block (4), rotating through them frame by frame.
+bool traced_this_frame(ivec2 pixel) {
+    if (u_interleave == 0) {
+        return false;
+    }
+    if (u_interleave == 2) {
+        return ((pixel.x + pixel.y + u_interleave_phase) & 1) == 0;
+    }
+    if (u_interleave == 4) {
+        return (pixel.x & 1) + 2 * (pixel.y & 1) == u_interleave_phase;
+    }
+    return true;
+}
 
-    vec2 uv = (gl_FragCoord.xy / iResolution) * 2.0 - 1.0;
+// Pixel reconstruction filters. Each sample is offset from the pixel center
+// by a draw from a density p and weighted by filter / p, so the weighted
+// average converges to the filtered image (Ernst et al. 2006). Weights
+// average 1, so the accumulated weight still counts samples. Box and tent
+// are sampled exactly; Blackman-Harris (4 terms, 1.5 pixels wide as in
+// Cycles) by its closest B-spline.
+#define FILTER_CENTER 0 // no jitter: every sample through the pixel center
+#define FILTER_BOX 1
+#define FILTER_TENT 2
+#define FILTER_BLACKMAN_HARRIS 3
+
+const float BLACKMAN_HARRIS_RADIUS = 0.75;
+const float BLACKMAN_HARRIS_INTEGRAL = 0.7175; // over t in [-1, 1]
+
+float blackman_harris(float t) {
+    float x = M_PI * (t + 1.0);
+    return 0.35875 - 0.48829 * cos(x) + 0.14128 * cos(2.0 * x) -
+        0.01168 * cos(3.0 * x);
+}
+
+// Offset in [-1, 1] along one axis with its weight. Most draws are a sum
+// of three uniforms, the quadratic B-spline; 2% are uniform, which caps the
+// weight at 1.3 where the spline's tails fall off faster than the window.
+float sample_blackman_harris(inout uint rng, out float t) {
+    float choice = random(rng);
+    if (choice < 0.02) {
+        t = choice * 100.0 - 1.0;
+    } else {
+        t = (random(rng) + random(rng) + random(rng)) * (2.0 / 3.0) - 1.0;
+    }
+    float u = (t + 1.0) * 1.5;
+    float spline = u < 1.0 ? 0.5 * u * u :
+        u < 2.0 ? 0.75 - (u - 1.5) * (u - 1.5) : 0.5 * (3.0 - u) * (3.0 - u);
+    float pdf = 0.98 * 1.5 * spline + 0.02 * 0.5;
+    return blackman_harris(t) / (BLACKMAN_HARRIS_INTEGRAL * pdf);
+}
+
+float sample_tent(float u) {
+    return u < 0.5 ? sqrt(2.0 * u) - 1.0 : 1.0 - sqrt(2.0 - 2.0 * u);
+}
+
+// Offset of a sample from the pixel center, in pixels; returns its weight.
+float sample_pixel_filter(inout uint rng, out vec2 offset) {
+    offset = vec2(0.0);
+    if (u_pixel_filter == FILTER_BOX) {
+        offset = random2(rng) - 0.5;
+    } else if (u_pixel_filter == FILTER_TENT) {
+        vec2 u = random2(rng);
+        offset = vec2(sample_tent(u.x), sample_tent(u.y));
+    } else if (u_pixel_filter == FILTER_BLACKMAN_HARRIS) {
+        float weight = sample_blackman_harris(rng, offset.x) *
+            sample_blackman_harris(rng, offset.y);
+        offset *= BLACKMAN_HARRIS_RADIUS;
+        return weight;
+    }
+    return 1.0;
+}
+
+// The k-th of a fixed set of offsets and weights, drawn from the filter as
+// above but with a seed that depends on k alone, so every pixel and frame
+// sees the same set and their primary hits can be cached.
+float fixed_pixel_filter(int k, out vec2 offset) {
+    uint rng = pcg(uint(k) + 0x9e3779b9u);
+    return sample_pixel_filter(rng, offset);
+}
+
+// Camera ray through `frag`, a position in pixels.
+Ray camera_ray(vec2 frag) {
+    vec2 uv = (frag / iResolution) * 2.0 - 1.0;
     uv.x *= iResolution.x / iResolution.y;
 
     // setup camera basis (rotation)
@@ -312,15 +1299,83 @@ void main() {
     float z = -1.0 / tan(radians(u_camera.fov) * 0.5);
     vec3 local_ray_dir = normalize(vec3(uv, z));
     // rotate into world space
-    vec3 ray_dir = camera_rotation * local_ray_dir;
+    return Ray(u_camera.position, camera_rotation * local_ray_dir);
+}
+
+#ifdef PREVIEW
+// Cheap stand-in drawn while the full path tracer is still linking: a single
+// closest-hit query shaded by its normal.
+vec3 preview(Ray ray, out PrimaryHit primary) {
+    HitRecord record;
+    bool hit_anything;
+    primary = find_primary(ray, -1, record, hit_anything);
 
-    // finally, trace ray
-    vec3 col = trace(Ray(u_camera.position, ray_dir), rnd_state);
-    if (u_use_prev && u_frame_index > 1) {
-        vec2 prev_uv = gl_FragCoord.xy / iResolution.xy;
-        vec3 prev = texture(u_prev_frame, prev_uv).rgb;
-        float frame = float(u_frame_index);
-        col = (prev * (frame - 1.0) + col) / frame;
+    if (!hit_anything) {
+        return vec3(0.0);
+    }
+    return record.normal * 0.5 + 0.5;
+}
+#endif
+
+void main() {
+    uint rng = pcg(uint(gl_FragCoord.x) +
+        pcg(uint(gl_FragCoord.y) + pcg(floatBitsToUint(iTime))));
+
+    Ray ray = camera_ray(gl_FragCoord.xy);
+
+    PrimaryHit primary;
+#ifdef PREVIEW
+    fragColor = vec4(preview(ray, primary), 1.0);
+#else
+    if (u_primary_pass) {
+        vec2 offset;
+        fixed_pixel_filter(u_primary_layer, offset);
+        HitRecord record;
+        store_primary(hit_world(camera_ray(gl_FragCoord.xy + offset), 0.001,
+            FLT_MAX, record), record);
+        return;
+    }
+    if (traced_this_frame(ivec2(gl_FragCoord.xy))) {
+        // finally, trace rays, each through its own point of the filter;
+        // with the cache, through the fixed points it holds hits for
+        vec3 col = vec3(0.0);
+        float weight = 0.0;
+        for (int i = 0; i < u_samples_per_pixel; ++i) {
+            vec2 offset;
+            float w;
+            int cached = -1;
+            if (u_primary_cached) {
+                cached = (u_primary_layer + i) % u_primary_layers;
+                w = fixed_pixel_filter(cached, offset);
+            } else {
+                w = sample_pixel_filter(rng, offset);
+            }
+            PrimaryHit sample_primary;
+            col += w * trace(camera_ray(gl_FragCoord.xy + offset), cached,
+                rng, sample_primary);
+            weight += w;
+            if (i == 0) {
+                primary = sample_primary;
+            }
+        }
+        fragColor = vec4(col / weight, weight);
+    } else {
+        // Skipped pixels still find their primary hit so reprojection and
+        // the denoiser keep full-resolution guides.
+        HitRecord record;
+        bool hit_anything;
+        if (u_primary_cached) {
+            vec2 offset;
+            fixed_pixel_filter(u_primary_layer, offset);
+            primary = find_primary(camera_ray(gl_FragCoord.xy + offset),
+                u_primary_layer, record, hit_anything);
+        } else {
+            primary = find_primary(ray, -1, record, hit_anything);
+        }
+        fragColor = vec4(0.0);
     }
-    fragColor = vec4(col, 1.0);
+#endif
+    gbuffer = primary.position;
+    gbuffer_normal = vec4(primary.normal, 0.0);
+    gbuffer_albedo = vec4(primary.albedo, 1.0);
 }
@@ -0,0 +1,153 @@
+#version 410 core
+
+// Temporal accumulation. While the camera is still this is a plain running
+// average of the trace pass output. When it moves (or the render size
+// changes), last frame's history is reprojected onto this frame's primary
+// hits, rejected where the surface was not visible before, and clamped to
+// the current neighborhood so stale samples cannot ghost.
+//
+// Alongside the color it keeps the first two moments of the demodulated
+// luminance, from which the denoiser estimates per-pixel variance.
+//
+// Pixels that interleaved rendering skipped carry their history forward
+// unchanged. Without usable history they are filled with the average of
+// the traced neighbors as a zero-weight placeholder, which the next real
+// sample replaces.
+
+// rgb = accumulated color, a = summed filter weights of the samples in the
+// history, about one per sample
+layout(location = 0) out vec4 fragColor;
+// (luminance, luminance^2) of color / albedo
+layout(location = 1) out vec4 moments;
+
+uniform sampler2D u_current;      // trace pass color, a = samples
+uniform sampler2D u_gbuffer;      // trace pass primary hits
+uniform sampler2D u_prev_gbuffer; // last frame's primary hits
+uniform sampler2D u_albedo;       // trace pass primary albedo
+uniform sampler2D u_history;      // last frame's output, linear filtering
+uniform sampler2D u_prev_moments; // last frame's moments, linear filtering
+uniform mat4 u_prev_view_proj;
+uniform vec3 u_prev_camera_position;
+uniform bool u_reset;
+uniform bool u_reproject; // camera or render size changed
+uniform float u_max_history; // history length cap in samples while moving
+
+// Relative difference in distance to the previous camera above which a
+// reprojected sample is treated as a different surface.
+const float DEPTH_TOLERANCE = 0.05;
+
+bool reproject(vec4 hit, out vec2 prev_uv) {
+    // Sky pixels reproject as directions (w = 0) so only rotation counts.
+    vec4 clip = u_prev_view_proj * vec4(hit.xyz, hit.w > 0.0 ? 1.0 : 0.0);
+    if (clip.w <= 0.0) return false;
+    prev_uv = clip.xy / clip.w * 0.5 + 0.5;
+    if (any(lessThan(prev_uv, vec2(0.0))) ||
+        any(greaterThan(prev_uv, vec2(1.0)))) return false;
+
+    ivec2 size = textureSize(u_prev_gbuffer, 0);
+    ivec2 prev_pixel = clamp(ivec2(prev_uv * vec2(size)), ivec2(0), size - 1);
+    vec4 prev_hit = texelFetch(u_prev_gbuffer, prev_pixel, 0);
+    if (hit.w == 0.0) {
+        return prev_hit.w == 0.0;
+    }
+    if (prev_hit.w == 0.0) return false;
+
+    float expected = distance(u_prev_camera_position, hit.xyz);
+    return abs(prev_hit.w - expected) < DEPTH_TOLERANCE * expected;
+}
+
+vec2 sample_moments(vec3 color, ivec2 pixel) {
+    vec3 albedo = texelFetch(u_albedo, pixel, 0).rgb;
+    float l = dot(color / max(albedo, vec3(1e-3)),
+        vec3(0.2126, 0.7152, 0.0722));
+    return vec2(l, l * l);
+}
+
+// Bounds and average of the samples traced this frame in the 3x3 window.
+// Both interleave patterns leave at least one; returns false when there is
+// none (inside a tile not traced this frame), with bounds that clamp
+// nothing.
+bool neighborhood(ivec2 pixel, out vec3 box_min, out vec3 box_max,
+    out vec3 mean, out vec2 mean_moments) {
+    box_min = vec3(3.4e38);
+    box_max = vec3(-3.4e38);
+    mean = vec3(0.0);
+    mean_moments = vec2(0.0);
+    float count = 0.0;
+    ivec2 size = textureSize(u_current, 0);
+    for (int y = -1; y <= 1; ++y) {
+        for (int x = -1; x <= 1; ++x) {
+            ivec2 p = clamp(pixel + ivec2(x, y), ivec2(0), size - 1);
+            vec4 c = texelFetch(u_current, p, 0);
+            if (c.a == 0.0) continue;
+            box_min = min(box_min, c.rgb);
+            box_max = max(box_max, c.rgb);
+            mean += c.rgb;
+            mean_moments += sample_moments(c.rgb, p);
+            count += 1.0;
+        }
+    }
+    if (count == 0.0) {
+        box_min = vec3(-3.4e38);
+        box_max = vec3(3.4e38);
+        return false;
+    }
+    mean /= count;
+    mean_moments /= count;
+    return true;
+}
+
+// Adds a sample of the given weight (its sample count, or 0 for a
+// placeholder) to history that already holds `n` samples.
+void accumulate(vec3 history, vec2 history_moments, float n, vec3 current,
+    vec2 current_moments, float weight) {
+    n += weight;
+    float blend = n > 0.0 ? weight / n : 1.0;
+    fragColor = vec4(mix(history, current, blend), n);
+    moments = vec4(mix(history_moments, current_moments, blend), 0.0, 0.0);
+}
+
+void main() {
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    vec4 traced = texelFetch(u_current, pixel, 0);
+    bool skipped = traced.a == 0.0;
+
+    vec3 box_min, box_max, fill;
+    vec2 fill_moments;
+    if (skipped || u_reproject) {
+        neighborhood(pixel, box_min, box_max, fill, fill_moments);
+    }
+    vec3 current = skipped ? fill : traced.rgb;
+    vec2 current_moments =
+        skipped ? fill_moments : sample_moments(traced.rgb, pixel);
+    float weight = traced.a;
+
+    if (u_reset) {
+        fragColor = vec4(current, weight);
+        moments = vec4(current_moments, 0.0, 0.0);
+        return;
+    }
+
+    if (!u_reproject) {
+        vec4 history = texelFetch(u_history, pixel, 0);
+        vec2 history_moments = texelFetch(u_prev_moments, pixel, 0).xy;
+        accumulate(history.rgb, history_moments, history.a, current,
+            current_moments, weight);
+        return;
+    }
+
+    vec2 prev_uv;
+    vec4 hit = texelFetch(u_gbuffer, pixel, 0);
+    if (!reproject(hit, prev_uv)) {
+        fragColor = vec4(current, weight);
+        moments = vec4(current_moments, 0.0, 0.0);
+        return;
+    }
+
+    // Clamp the history into the box of current samples around it.
+    vec4 history = texture(u_history, prev_uv);
+    vec3 clamped = clamp(history.rgb, box_min, box_max);
+    vec2 history_moments = texture(u_prev_moments, prev_uv).xy;
+    float n = min(history.a, max(u_max_history - weight, 0.0));
+    accumulate(clamped, history_moments, n, current, current_moments, weight);
+}
@@ -0,0 +1,37 @@
+#include "alias_table.h"
+
+#include <cstddef>
+#include <vector>
+
+void build_alias_table(const double *weights, int n, float *threshold,
+                       float *alias, int stride) {
+  double sum = 0.0;
+  for (int i = 0; i < n; ++i)
+    sum += weights[i];
+
+  std::vector<double> scaled(n);
+  std::vector<int> small, large;
+  for (int i = 0; i < n; ++i) {
+    scaled[i] = sum > 0.0 ? weights[i] * n / sum : 1.0;
+    (scaled[i] < 1.0 ? small : large).push_back(i);
+  }
+  while (!small.empty() && !large.empty()) {
+    int s = small.back();
+    int l = large.back();
+    small.pop_back();
+    large.pop_back();
+    threshold[(size_t)s * stride] = (float)scaled[s];
+    alias[(size_t)s * stride] = (float)l;
+    scaled[l] += scaled[s] - 1.0;
+    (scaled[l] < 1.0 ? small : large).push_back(l);
+  }
+  // Whatever is left is 1 up to rounding.
+  for (int i : small) {
+    threshold[(size_t)i * stride] = 1.0f;
+    alias[(size_t)i * stride] = (float)i;
+  }
+  for (int i : large) {
+    threshold[(size_t)i * stride] = 1.0f;
+    alias[(size_t)i * stride] = (float)i;
+  }
+}
@@ -1,42 +1,74 @@
 #include "application.h"
 
+#include "benchmark.h"
+#include "camera.h"
 #include "gl_debug.h"
+#include "profiler.h"
 #include "shader.h"
 
+#include <algorithm>
 #include <cmath>
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <string>
+#include <vector>
 
 #include "imgui.h"
 #include "imgui_impl_glfw.h"
 #include "imgui_impl_opengl3.h"
 
-Application::Application() { initialize(); }
+Application::Application(const AppOptions &options) : options(options) {
+  initialize();
+}
 
 Application::~Application() {
-  if (prev_frame_tex != 0) {
-    glDeleteTextures(1, &prev_frame_tex);
+  if (!options.telemetry_path.empty()) {
+    export_telemetry(options.telemetry_path);
+  }
+  if (recorder) {
+    int width, height;
+    glfwGetFramebufferSize(window, &width, &height);
+    if (recorder->save(options.record_path, width, height)) {
+      fprintf(stderr, "[Benchmark] Wrote camera path to %s\n",
+              options.record_path.c_str());
+    }
   }
+  if (!options.trace_path.empty() &&
+      profiler->write_chrome_trace(options.trace_path)) {
+    fprintf(stderr, "[Profiler] Wrote %s\n", options.trace_path.c_str());
+  }
+  delete benchmark;
+  delete recorder;
+  delete gpu_timer;
+  delete tile_scheduler;
+  delete profiler;
+  delete scene;
+  delete environment;
+  delete ggx_albedo;
+  delete textures;
+  delete thread_pool;
+  delete primary_cache;
+  for (int i = 0; i < 2; ++i) {
+    delete trace_targets[i];
+    delete history[i];
+  }
+  delete temporal_shader;
+  delete denoiser;
   ImGui_ImplOpenGL3_Shutdown();
   ImGui_ImplGlfw_Shutdown();
   ImGui::DestroyContext();
+  delete shader;
+  delete preview_shader;
+  if (worker_window) {
+    glfwDestroyWindow(worker_window);
+  }
   glfwDestroyWindow(window);
   glfwTerminate();
-  exit(EXIT_SUCCESS);
+  exit(exit_code);
 }
 
-struct Camera {
-  float position[3] = {0.0f, 0.5f, 3.0f};
-  float direction[3] = {0.0f, 0.0f, -1.0f};
-  float fov = 45.0f;
-
-  // New: Rotation state
-  float yaw = -90.0f;
-  float pitch = 0.0f;
-};
-
 static bool sun_settings_changed(const float a_dir[3], float a_intensity,
                                  const float a_color[3],
                                  const float b_dir[3], float b_intensity,
@@ -68,6 +100,13 @@ static bool sky_settings_changed(float a_intensity, const float a_color[3],
   return fabsf(a_intensity - b_intensity) > intensity_eps;
 }
 
+// Frames without camera motion before tracing returns to full resolution.
+static const int kStillFrames = 8;
+
+// Quarter-rate interleaving visits the pixels of each 2x2 block
+// diagonally first: (0,0), (1,1), (1,0), (0,1).
+static const int kQuarterOrder[4] = {0, 3, 1, 2};
+
 static bool camera_changed(const Camera &a, const Camera &b) {
   const float pos_eps = 1e-4f;
   const float dir_eps = 1e-4f;
@@ -133,20 +172,7 @@ void update_camera(GLFWwindow *window, Camera &camera, float dt,
     camera.pitch = -89.0f;
 
   // Calculate Direction Vector
-  float yaw_rad = camera.yaw * (3.14159f / 180.0f);
-  float pitch_rad = camera.pitch * (3.14159f / 180.0f);
-
-  camera.direction[0] = cos(yaw_rad) * cos(pitch_rad);
-  camera.direction[1] = sin(pitch_rad);
-  camera.direction[2] = sin(yaw_rad) * cos(pitch_rad);
-
-  // Normalize direction (manual math since we don't have GLM here)
-  float len = sqrt(camera.direction[0] * camera.direction[0] +
-                   camera.direction[1] * camera.direction[1] +
-                   camera.direction[2] * camera.direction[2]);
-  camera.direction[0] /= len;
-  camera.direction[1] /= len;
-  camera.direction[2] /= len;
+  update_camera_direction(camera);
 
   // 3. Keyboard Movement (WASD)
   float speed = 2.5f * dt;
@@ -201,80 +227,130 @@ void Application::run() {
   int width, height;
   float ratio;
 
-  Camera camera;
+  const SceneSettings &settings = scene_blob.header().settings;
+  Camera camera = settings.camera();
   Camera last_camera = camera;
   bool has_last_camera = false;
-  unsigned int frame_index = 1;
 
-  float sun_dir[3] = {0.4f, 0.8f, 0.2f};
-  float sun_color[3] = {1.0f, 0.95f, 0.85f};
-  float sun_intensity = 0.6f;
+  float sun_dir[3];
+  float sun_color[3];
+  float sun_intensity = settings.sun_intensity;
+  float sky_color[3];
+  float sky_intensity = settings.sky_intensity;
+  for (int i = 0; i < 3; ++i) {
+    sun_dir[i] = settings.sun_direction[i];
+    sun_color[i] = settings.sun_color[i];
+    sky_color[i] = settings.sky_color[i];
+  }
   float last_sun_dir[3] = {sun_dir[0], sun_dir[1], sun_dir[2]};
   float last_sun_color[3] = {sun_color[0], sun_color[1], sun_color[2]};
   float last_sun_intensity = sun_intensity;
+  sun_angular_radius = settings.sun_angular_radius;
+  float last_sun_angular_radius = sun_angular_radius;
   bool has_last_sun = false;
-  float sky_color[3] = {0.5f, 0.7f, 1.0f};
-  float sky_intensity = 0.0f;
   float last_sky_color[3] = {sky_color[0], sky_color[1], sky_color[2]};
   float last_sky_intensity = sky_intensity;
   bool has_last_sky = false;
+  int last_pixel_filter = pixel_filter;
 
   bool capture_mouse = false; // State to toggle between UI and Look mode
   bool accumulate_when_still = true;
 
   while (!glfwWindowShouldClose(window)) {
+    PROFILE_SCOPE(profiler, "frame");
+    double frame_start = glfwGetTime();
     glfwGetFramebufferSize(window, &width, &height);
 
-    if (width != prev_frame_width || height != prev_frame_height) {
-      prev_frame_width = width;
-      prev_frame_height = height;
-      prev_frame_valid = false;
-      frame_index = 1;
-
-      GL_CALL(glBindTexture(GL_TEXTURE_2D, prev_frame_tex));
-      GL_CALL(glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, width, height, 0,
-                           GL_RGBA, GL_FLOAT, nullptr));
-    }
-
     // Update performance metrics
     update_performance_metrics(last_time, frame_time, fps);
 
-    update_camera(window, camera, frame_time, capture_mouse);
-
-    ImGui_ImplOpenGL3_NewFrame();
-    ImGui_ImplGlfw_NewFrame();
-    ImGui::NewFrame();
-
-    // Draw imgui components
-    draw_performance_window(fps, frame_time);
+    // Benchmark runs replay the script once the path tracer is ready and
+    // skip the UI entirely so it neither costs time nor ends up in hashes.
+    bool benchmark_frame = benchmark && trace_ready;
+    bool benchmark_reset = false;
+    float shader_time = (float)glfwGetTime();
+    {
+      PROFILE_SCOPE(profiler, "input");
+      if (benchmark_frame) {
+        benchmark_reset = benchmark->begin_frame(camera, shader_time);
+      } else if (!benchmark) {
+        update_camera(window, camera, frame_time, capture_mouse);
+      }
+      if (recorder) {
+        recorder->update(camera, glfwGetTime());
+      }
+    }
 
-    if (!capture_mouse) {
-      draw_settings(camera.fov, sun_dir, sun_intensity, sun_color,
-                    sky_intensity, sky_color, accumulate_when_still);
-    } else {
-      // Show a hint
-      ImGui::SetNextWindowPos(
-          ImVec2(width * 0.5f - 100.0f, (float)height - 50.0f));
-      ImGui::Begin("Msg", NULL,
-                   ImGuiWindowFlags_NoDecoration |
-                       ImGuiWindowFlags_NoBackground);
-      ImGui::TextColored(ImVec4(1, 1, 0, 1), "Press TAB to release mouse");
-      ImGui::End();
+    bool scene_changed = false;
+    if (!benchmark) {
+      PROFILE_SCOPE(profiler, "imgui build");
+      ImGui_ImplOpenGL3_NewFrame();
+      ImGui_ImplGlfw_NewFrame();
+      ImGui::NewFrame();
+
+      // Draw imgui components
+      draw_performance_window(fps, frame_time);
+
+      if (!capture_mouse) {
+        draw_settings(camera.fov, sun_dir, sun_intensity, sun_color,
+                      sky_intensity, sky_color, accumulate_when_still);
+        scene_changed = draw_instance_editor();
+      } else {
+        // Show a hint
+        ImGui::SetNextWindowPos(
+            ImVec2(width * 0.5f - 100.0f, (float)height - 50.0f));
+        ImGui::Begin("Msg", NULL,
+                     ImGuiWindowFlags_NoDecoration |
+                         ImGuiWindowFlags_NoBackground);
+        ImGui::TextColored(ImVec4(1, 1, 0, 1), "Press TAB to release mouse");
+        ImGui::End();
+      }
     }
 
-    glViewport(0, 0, width, height);
-    glClear(GL_COLOR_BUFFER_BIT);
+    gpu_timer->begin();
 
     bool moved = true;
     if (has_last_camera) {
       moved = camera_changed(camera, last_camera);
     }
 
+    // Motion renders at the controller's scale and interleave pattern, a
+    // still camera at full resolution with every pixel traced; a few frames
+    // of grace keep short pauses in mouse input from bouncing between them.
+    still_frames = moved ? 0 : still_frames + 1;
+    bool interacting = !benchmark && still_frames < kStillFrames;
+    bool scaling = dynamic_resolution_enabled && interacting;
+    int pixels_per_sample = interacting ? interleave : 1;
+    int interleave_phase = (int)(interleave_frame++ % pixels_per_sample);
+    if (pixels_per_sample == 4) {
+      interleave_phase = kQuarterOrder[interleave_phase];
+    }
+    float render_scale = scaling ? dynamic_resolution.scale() : 1.0f;
+    int render_width = std::max(1, (int)(width * render_scale + 0.5f));
+    int render_height = std::max(1, (int)(height * render_scale + 0.5f));
+
+    RenderTarget *trace_out = trace_targets[frame_parity];
+    RenderTarget *trace_prev = trace_targets[1 - frame_parity];
+    RenderTarget *history_out = history[frame_parity];
+    RenderTarget *history_prev = history[1 - frame_parity];
+
+    // Only this frame's targets follow the render size. Last frame's keep
+    // theirs and are resampled through reprojection.
+    if (trace_out->width() != render_width ||
+        trace_out->height() != render_height) {
+      trace_out->resize(render_width, render_height);
+      history_out->resize(render_width, render_height);
+    }
+    denoiser->resize(render_width, render_height);
+    bool resampled = history_prev->width() != render_width ||
+                     history_prev->height() != render_height;
+
     bool sun_changed = false;
     if (has_last_sun) {
       sun_changed = sun_settings_changed(
           sun_dir, sun_intensity, sun_color, last_sun_dir, last_sun_intensity,
-          last_sun_color);
+          last_sun_color) ||
+          sun_angular_radius != last_sun_angular_radius;
     }
     bool sky_changed = false;
     if (has_last_sky) {
@@ -282,49 +358,264 @@ void Application::run() {
                                          last_sky_intensity, last_sky_color);
     }
 
+    // Swap in the path tracer as soon as its background link finishes.
+    if (!trace_ready && shader->ready()) {
+      uniforms.resolve(*shader);
+      shader->report_unused_uniforms();
+      trace_ready = true;
+      history_valid = false;
+    }
+    Shader *program = trace_ready ? shader : preview_shader;
+    const TraceUniforms &u = trace_ready ? uniforms : preview_uniforms;
+
+    // Camera motion is absorbed by reprojection; changes that alter shading
+    // everywhere still restart the history.
     bool disable_still_accum = !accumulate_when_still && !moved;
-    bool reset_accum = moved || sun_changed || sky_changed ||
-                       !prev_frame_valid || disable_still_accum;
-    if (reset_accum) {
-      frame_index = 1;
-      prev_frame_valid = false;
-    } else {
-      frame_index += 1;
-    }
-
-    shader->use();
-    shader->set_float("iTime", (float)glfwGetTime());
-    shader->set_vec2("iResolution", (float)width, (float)height);
-    shader->set_int("u_frame_index", (int)frame_index);
-    shader->set_bool("u_use_prev", !reset_accum && prev_frame_valid);
-    shader->set_int("u_prev_frame", 0);
-    GL_CALL(glActiveTexture(GL_TEXTURE0));
-    GL_CALL(glBindTexture(GL_TEXTURE_2D, prev_frame_tex));
-
-    // Pass the updated camera structs
-    shader->set_vec3("u_camera.position", camera.position[0],
-                     camera.position[1], camera.position[2]);
-    shader->set_vec3("u_camera.direction", camera.direction[0],
-                     camera.direction[1], camera.direction[2]);
-    shader->set_float("u_camera.fov", camera.fov);
-    shader->set_vec3("u_sun_direction", sun_dir[0], sun_dir[1], sun_dir[2]);
-    shader->set_vec3("u_sun_color", sun_color[0], sun_color[1], sun_color[2]);
-    shader->set_float("u_sun_intensity", sun_intensity);
-    shader->set_vec3("u_sky_color", sky_color[0], sky_color[1], sky_color[2]);
-    shader->set_float("u_sky_intensity", sky_intensity);
-
-    glBindVertexArray(vao);
-    glDrawArrays(GL_TRIANGLES, 0, 3);
-
-    GL_CALL(glBindTexture(GL_TEXTURE_2D, prev_frame_tex));
-    GL_CALL(glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 0, 0, width, height));
-    prev_frame_valid = true;
-
-    ImGui::Render();
-    ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
-
-    glfwSwapBuffers(window);
-    glfwPollEvents();
+    bool reset_accum = sun_changed || sky_changed || scene_changed ||
+                       pixel_filter != last_pixel_filter ||
+                       !history_valid || disable_still_accum ||
+                       !trace_ready || benchmark_reset ||
+                       ((moved || resampled) && !temporal_reprojection);
+
+    {
+      PROFILE_SCOPE(profiler, "uniform upload");
+      program->use();
+      program->set_float(u.time, shader_time);
+      program->set_vec2(u.resolution, (float)render_width,
+                        (float)render_height);
+
+      // Pass the updated camera structs
+      program->set_vec3(u.camera_position, camera.position[0],
+                        camera.position[1], camera.position[2]);
+      program->set_vec3(u.camera_direction, camera.direction[0],
+                        camera.direction[1], camera.direction[2]);
+      program->set_float(u.camera_fov, camera.fov);
+      program->set_vec3(u.sun_direction, sun_dir[0], sun_dir[1], sun_dir[2]);
+      program->set_vec3(u.sun_color, sun_color[0], sun_color[1],
+                        sun_color[2]);
+      program->set_float(u.sun_intensity, sun_intensity);
+      program->set_float(u.sun_angular_radius, sun_angular_radius);
+      program->set_vec3(u.sky_color, sky_color[0], sky_color[1],
+                        sky_color[2]);
+      program->set_float(u.sky_intensity, sky_intensity);
+      program->set_int(u.interleave, pixels_per_sample);
+      program->set_int(u.interleave_phase, interleave_phase);
+      program->set_int(u.samples_per_pixel, samples_per_pixel);
+      program->set_int(u.pixel_filter, pixel_filter);
+
+      program->set_int(u.scene, 1);
+      program->set_int_array(u.scene_sections, scene->section_bases(),
+                             kSceneGpuSectionCount);
+      program->set_int(u.num_planes, scene->count(kSectionPlanes));
+      program->set_int(u.num_instances, scene->count(kSectionInstances));
+      program->set_int(u.num_lights, scene->count(kSectionLights));
+      scene->bind(1);
+
+      program->set_bool(u.env_enabled, environment != nullptr);
+      program->set_int(u.env_map, 2);
+      program->set_int(u.env_distribution, 3);
+      if (environment) {
+        program->set_ivec2(u.env_cells, environment->cells_x(),
+                           environment->cells_y());
+        environment->bind(2, 3);
+      }
+      program->set_int(u.ggx_albedo, 4);
+      program->set_int(u.ggx_dielectric_albedo, 5);
+      ggx_albedo->bind(4, 5);
+      program->set_int(u.textures, 6);
+      program->set_int(u.texture_layers, textures ? textures->layers() : 0);
+      if (textures) {
+        textures->bind(6);
+      }
+    }
+
+    // The cache needs the path tracer's program and a camera that held
+    // still since the last frame; it is rebuilt by one primary-only draw
+    // per offset the first frame that finds it stale.
+    int cache_layers = pixel_filter == 0 ? 1 : primary_offsets;
+    if (moved || scene_changed || !trace_ready ||
+        pixel_filter != last_pixel_filter ||
+        primary_cache->width() != render_width ||
+        primary_cache->height() != render_height ||
+        primary_cache->layers() != cache_layers) {
+      primary_cache_valid = false;
+    }
+    bool use_primary_cache = cache_primary_hits && trace_ready && !moved;
+    // Set even while the cache is not read: samplers left on unit 0 would
+    // share it with samplers of other types and fail every draw.
+    program->set_int(u.primary_point, 7);
+    program->set_int(u.primary_normal, 8);
+    program->set_int(u.primary_surface, 9);
+    if (use_primary_cache && !primary_cache_valid) {
+      PROFILE_GPU_SCOPE(profiler, "primary cache");
+      primary_cache->resize(render_width, render_height, cache_layers);
+      glBindVertexArray(vao);
+      program->set_bool(u.primary_pass, true);
+      for (int layer = 0; layer < cache_layers; ++layer) {
+        primary_cache->bind(layer);
+        program->set_int(u.primary_layer, layer);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+      }
+      program->set_bool(u.primary_pass, false);
+      primary_cache_valid = true;
+      primary_cache_frame = 0;
+    }
+    program->set_bool(u.primary_cached, use_primary_cache);
+    if (use_primary_cache) {
+      // Consecutive samples take consecutive offsets, so every offset gets
+      // the same share of the accumulated samples.
+      program->set_int(u.primary_layers, cache_layers);
+      program->set_int(u.primary_layer,
+                       (int)(primary_cache_frame * samples_per_pixel %
+                             cache_layers));
+      primary_cache_frame += 1;
+      for (int i = 0; i < 3; ++i) {
+        glActiveTexture(GL_TEXTURE7 + i);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, primary_cache->texture(i));
+      }
+      glActiveTexture(GL_TEXTURE0);
+    }
+
+    // Tiles are scheduled by GPU time, so benchmarks always draw whole
+    // frames. Motion draws whole frames too: a tile left untraced while the
+    // camera moves has no history to fall back on and no traced neighbors
+    // to fill from.
+    bool tiled = tiled_rendering && trace_ready && !benchmark && !interacting;
+    {
+      PROFILE_GPU_SCOPE(profiler, "trace draw");
+      trace_out->bind();
+      glBindVertexArray(vao);
+      if (tiled) {
+        // G-buffer for every pixel, then path trace this frame's tiles. Each
+        // tile is flushed on its own so no single submission runs long
+        // enough to trip a driver watchdog.
+        program->set_int(u.interleave, 0);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        program->set_int(u.interleave, pixels_per_sample);
+        int tiles = tile_scheduler->begin(render_width, render_height);
+        glEnable(GL_SCISSOR_TEST);
+        for (int i = 0; i < tiles; ++i) {
+          int rect[4];
+          tile_scheduler->rect(i, rect);
+          glScissor(rect[0], rect[1], rect[2], rect[3]);
+          glDrawArrays(GL_TRIANGLES, 0, 3);
+          glFlush();
+        }
+        glDisable(GL_SCISSOR_TEST);
+        tile_scheduler->end();
+      } else {
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+      }
+    }
+
+    {
+      PROFILE_GPU_SCOPE(profiler, "temporal");
+      const TemporalUniforms &t = temporal_uniforms;
+      history_out->bind();
+      temporal_shader->use();
+      temporal_shader->set_int(t.current, 0);
+      temporal_shader->set_int(t.gbuffer, 1);
+      temporal_shader->set_int(t.prev_gbuffer, 2);
+      temporal_shader->set_int(t.history, 3);
+      temporal_shader->set_int(t.albedo, 4);
+      temporal_shader->set_int(t.prev_moments, 5);
+      temporal_shader->set_mat4(t.prev_view_proj, prev_view_proj);
+      temporal_shader->set_vec3(t.prev_camera_position,
+                                prev_camera_position[0],
+                                prev_camera_position[1],
+                                prev_camera_position[2]);
+      temporal_shader->set_bool(t.reset, reset_accum);
+      temporal_shader->set_bool(t.reproject, moved || resampled);
+      temporal_shader->set_float(t.max_history, max_history);
+
+      GLuint inputs[6] = {trace_out->texture(0),   trace_out->texture(1),
+                          trace_prev->texture(1),  history_prev->texture(0),
+                          trace_out->texture(3),   history_prev->texture(1)};
+      for (int i = 0; i < 6; ++i) {
+        glActiveTexture(GL_TEXTURE0 + i);
+        glBindTexture(GL_TEXTURE_2D, inputs[i]);
+      }
+      glActiveTexture(GL_TEXTURE0);
+      glDrawArrays(GL_TRIANGLES, 0, 3);
+    }
+
+    // The preview shading is not worth filtering.
+    const RenderTarget *output = history_out;
+    if (denoise && trace_ready) {
+      PROFILE_GPU_SCOPE(profiler, "denoise");
+      DenoiseInputs inputs = {history_out->texture(0),
+                              history_out->texture(1), trace_out->texture(1),
+                              trace_out->texture(2), trace_out->texture(3)};
+      float pixel_spread =
+          2.0f * tanf(camera.fov * (3.14159265f / 180.0f) * 0.5f) /
+          (float)render_height;
+      output = &denoiser->run(inputs, denoise_settings, pixel_spread);
+    }
+
+    {
+      // Bilinear upscale when tracing below the output resolution.
+      PROFILE_GPU_SCOPE(profiler, "present");
+      glBindFramebuffer(GL_READ_FRAMEBUFFER, output->fbo());
+      glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+      glBlitFramebuffer(0, 0, render_width, render_height, 0, 0, width, height,
+                        GL_COLOR_BUFFER_BIT,
+                        render_scale < 1.0f ? GL_LINEAR : GL_NEAREST);
+      glBindFramebuffer(GL_FRAMEBUFFER, 0);
+      glViewport(0, 0, width, height);
+    }
+
+    if (benchmark_frame) {
+      benchmark->end_frame(output->fbo(), width, height);
+    }
+
+    camera_view_projection(camera, (float)width / (float)height,
+                           prev_view_proj);
+    for (int i = 0; i < 3; ++i) {
+      prev_camera_position[i] = camera.position[i];
+    }
+    frame_parity = 1 - frame_parity;
+    history_valid = true;
+
+    if (!benchmark) {
+      PROFILE_GPU_SCOPE(profiler, "imgui render");
+      ImGui::Render();
+      ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+    }
+    gpu_timer->end();
+
+    double present_start = glfwGetTime();
+    {
+      PROFILE_SCOPE(profiler, "swap");
+      glfwSwapBuffers(window);
+    }
+    double present_end = glfwGetTime();
+    profiler->end_frame();
+
+    bool gpu_ms_ready = gpu_timer->poll(last_gpu_ms);
+    if (!scaling) {
+      dynamic_resolution.hold();
+    } else if (gpu_ms_ready) {
+      dynamic_resolution.update(last_gpu_ms);
+    }
+    FrameSample sample;
+    sample.frame_ms = frame_time * 1000.0f;
+    sample.cpu_ms = (float)((present_start - frame_start) * 1000.0);
+    sample.gpu_ms = last_gpu_ms;
+    sample.present_ms = (float)((present_end - present_start) * 1000.0);
+    // Input is sampled by the poll at the end of the previous iteration.
+    sample.input_latency_ms = (float)((present_end - last_poll_time) * 1000.0);
+    telemetry.record(sample);
+
+    if (benchmark && benchmark->finished()) {
+      finish_benchmark();
+      glfwSetWindowShouldClose(window, GLFW_TRUE);
+    }
+
+    {
+      PROFILE_SCOPE(profiler, "poll events");
+      glfwPollEvents();
+    }
+    last_poll_time = glfwGetTime();
 
     last_camera = camera;
     has_last_camera = true;
@@ -333,12 +624,14 @@ void Application::run() {
       last_sun_color[i] = sun_color[i];
     }
     last_sun_intensity = sun_intensity;
+    last_sun_angular_radius = sun_angular_radius;
     has_last_sun = true;
     for (int i = 0; i < 3; ++i) {
       last_sky_color[i] = sky_color[i];
     }
     last_sky_intensity = sky_intensity;
     has_last_sky = true;
+    last_pixel_filter = pixel_filter;
   }
 }
 
@@ -347,23 +640,52 @@ void Application::initialize() {
   glfwSetErrorCallback(error_callback);
 
   if (!glfwInit())
-    exit(EXIT_FAILURE);
+    exit(kExitNoContext);
 
   glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
   glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 1);
   glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
-  window = glfwCreateWindow(1024, 768, "OpenGL Ray Tracer", NULL, NULL);
+  int window_width = 1024;
+  int window_height = 768;
+  if (!options.benchmark_script.empty()) {
+    BenchmarkScript script;
+    if (!load_benchmark_script(options.benchmark_script, script))
+      exit(EXIT_FAILURE);
+    window_width = script.width;
+    window_height = script.height;
+    benchmark = new BenchmarkRunner(script);
+    benchmark->set_capture(!options.save_image_path.empty() ||
+                           !options.compare_image_path.empty());
+    // Pinned so a script renders the same work whatever the defaults are;
+    // benchmarks skip the settings window, so nothing changes them later.
+    samples_per_pixel = script.samples_per_pixel;
+    pixel_filter = script.pixel_filter;
+    denoise = script.denoise_iterations > 0;
+    denoise_settings = DenoiseSettings();
+    if (denoise)
+      denoise_settings.iterations = script.denoise_iterations;
+  }
+  if (!options.record_path.empty()) {
+    recorder = new CameraRecorder();
+  }
+
+  if (options.headless) {
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+  }
+  window = glfwCreateWindow(window_width, window_height, "OpenGL Ray Tracer",
+                            NULL, NULL);
   if (!window) {
     glfwTerminate();
-    exit(EXIT_FAILURE);
+    exit(kExitNoContext);
   }
 
   glfwSetKeyCallback(window, key_callback);
   glfwMakeContextCurrent(window);
 
   gladLoadGL(glfwGetProcAddress);
-  glfwSwapInterval(1);
+  // Benchmarks measure the renderer, not the display refresh rate.
+  glfwSwapInterval(benchmark ? 0 : 1);
 
   // ImGui setup
   IMGUI_CHECKVERSION();
@@ -393,23 +715,188 @@ void Application::initialize() {
   GL_CALL(glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float),
                                 (void *)0));
 
-  // Shader setup
-  shader = new Shader("shaders/shader.vert", "shaders/shader.frag");
+  if (!load_scene(options.scene_path, scene_blob))
+    exit(EXIT_FAILURE);
+  scene = new SceneGpu();
+  if (!scene->upload(scene_blob))
+    exit(EXIT_FAILURE);
+
+  thread_pool = new ThreadPool();
+  ggx_albedo = new GgxAlbedoLut(*thread_pool);
+  const char *sky_map = scene_blob.header().settings.sky_map;
+  if (sky_map[0] != '\0') {
+    environment = new EnvironmentMap();
+    if (!environment->load(sky_map, *thread_pool)) {
+      fprintf(stderr, "[Environment] Falling back to the gradient sky\n");
+      delete environment;
+      environment = nullptr;
+    }
+  }
+  std::vector<std::string> texture_paths = read_texture_paths(scene_blob);
+  if (!texture_paths.empty()) {
+    textures = new TextureArray();
+    if (!textures->load(texture_paths, *thread_pool)) {
+      fprintf(stderr, "[Textures] Rendering without textures\n");
+      delete textures;
+      textures = nullptr;
+    }
+  }
 
+  // Shader setup. The preview variant compiles in a fraction of the time and
+  // covers the first frames while the path tracer links in the background.
+  ShaderOptions preview_options;
+  preview_options.defines.push_back("PREVIEW");
+  preview_shader =
+      new Shader("shaders/shader.vert", "shaders/shader.frag", preview_options);
+  preview_uniforms.resolve(*preview_shader);
+
+  ShaderOptions trace_options;
+  trace_options.async = true;
+  if (!Shader::supports_parallel_compile()) {
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    worker_window = glfwCreateWindow(1, 1, "", NULL, window);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_TRUE);
+    trace_options.worker_context = worker_window;
+  }
+  shader =
+      new Shader("shaders/shader.vert", "shaders/shader.frag", trace_options);
+
+  gpu_timer = new GpuTimer();
+  tile_scheduler = new TileScheduler();
+  profiler = new Profiler();
+  profiler->set_recording(!options.trace_path.empty());
+  last_time = glfwGetTime();
+  last_poll_time = last_time;
+
+  temporal_shader =
+      new Shader("shaders/shader.vert", "shaders/temporal.frag");
+  temporal_uniforms.resolve(*temporal_shader);
+
+  denoiser = new Denoiser();
+
+  // Trace output: color and the primary hit's position, normal and albedo
+  // (G-buffer). History (color and luminance moments) is sampled bilinearly
+  // when reprojected.
   int width, height;
   glfwGetFramebufferSize(window, &width, &height);
-  prev_frame_width = width;
-  prev_frame_height = height;
-  prev_frame_valid = false;
-
-  GL_CALL(glGenTextures(1, &prev_frame_tex));
-  GL_CALL(glBindTexture(GL_TEXTURE_2D, prev_frame_tex));
-  GL_CALL(glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, width, height, 0, GL_RGBA,
-                       GL_FLOAT, nullptr));
-  GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST));
-  GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST));
-  GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
-  GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
+  for (int i = 0; i < 2; ++i) {
+    trace_targets[i] = new RenderTarget(
+        {GL_RGBA32F, GL_RGBA32F, GL_RGBA16F, GL_RGBA16F});
+    trace_targets[i]->resize(width, height);
+    history[i] = new RenderTarget({GL_RGBA32F, GL_RGBA32F}, true);
+    history[i]->resize(width, height);
+  }
+  denoiser->resize(width, height);
+  history_valid = false;
+  primary_cache =
+      new RenderTarget({GL_RGBA32F, GL_RGBA32F, GL_RGBA32F}, false, true);
+}
+
+void TraceUniforms::resolve(const Shader &shader) {
+  time = shader.uniform("iTime", GL_FLOAT);
+  resolution = shader.uniform("iResolution", GL_FLOAT_VEC2);
+  camera_position = shader.uniform("u_camera.position", GL_FLOAT_VEC3);
+  camera_direction = shader.uniform("u_camera.direction", GL_FLOAT_VEC3);
+  camera_fov = shader.uniform("u_camera.fov", GL_FLOAT);
+  sun_direction = shader.uniform("u_sun_direction", GL_FLOAT_VEC3);
+  sun_color = shader.uniform("u_sun_color", GL_FLOAT_VEC3);
+  sun_intensity = shader.uniform("u_sun_intensity", GL_FLOAT);
+  sun_angular_radius = shader.uniform("u_sun_angular_radius", GL_FLOAT);
+  sky_color = shader.uniform("u_sky_color", GL_FLOAT_VEC3);
+  sky_intensity = shader.uniform("u_sky_intensity", GL_FLOAT);
+  env_enabled = shader.uniform("u_env_enabled", GL_BOOL);
+  env_map = shader.uniform("u_env_map", GL_SAMPLER_2D);
+  env_distribution = shader.uniform("u_env_distribution", GL_SAMPLER_2D);
+  env_cells = shader.uniform("u_env_cells", GL_INT_VEC2);
+  ggx_albedo = shader.uniform("u_ggx_albedo", GL_SAMPLER_2D);
+  ggx_dielectric_albedo =
+      shader.uniform("u_ggx_dielectric_albedo", GL_SAMPLER_3D);
+  textures = shader.uniform("u_textures", GL_SAMPLER_2D_ARRAY);
+  texture_layers = shader.uniform("u_texture_layers", GL_INT);
+  interleave = shader.uniform("u_interleave", GL_INT);
+  interleave_phase = shader.uniform("u_interleave_phase", GL_INT);
+  samples_per_pixel = shader.uniform("u_samples_per_pixel", GL_INT);
+  pixel_filter = shader.uniform("u_pixel_filter", GL_INT);
+  primary_pass = shader.uniform("u_primary_pass", GL_BOOL);
+  primary_cached = shader.uniform("u_primary_cached", GL_BOOL);
+  primary_layer = shader.uniform("u_primary_layer", GL_INT);
+  primary_layers = shader.uniform("u_primary_layers", GL_INT);
+  primary_point = shader.uniform("u_primary_point", GL_SAMPLER_2D_ARRAY);
+  primary_normal = shader.uniform("u_primary_normal", GL_SAMPLER_2D_ARRAY);
+  primary_surface =
+      shader.uniform("u_primary_surface", GL_SAMPLER_2D_ARRAY);
+  scene = shader.uniform("u_scene", GL_SAMPLER_BUFFER);
+  scene_sections = shader.uniform("u_scene_sections", GL_INT);
+  num_planes = shader.uniform("u_num_planes", GL_INT);
+  num_instances = shader.uniform("u_num_instances", GL_INT);
+  num_lights = shader.uniform("u_num_lights", GL_INT);
+}
+
+void TemporalUniforms::resolve(const Shader &shader) {
+  current = shader.uniform("u_current", GL_SAMPLER_2D);
+  gbuffer = shader.uniform("u_gbuffer", GL_SAMPLER_2D);
+  prev_gbuffer = shader.uniform("u_prev_gbuffer", GL_SAMPLER_2D);
+  albedo = shader.uniform("u_albedo", GL_SAMPLER_2D);
+  history = shader.uniform("u_history", GL_SAMPLER_2D);
+  prev_moments = shader.uniform("u_prev_moments", GL_SAMPLER_2D);
+  prev_view_proj = shader.uniform("u_prev_view_proj", GL_FLOAT_MAT4);
+  prev_camera_position =
+      shader.uniform("u_prev_camera_position", GL_FLOAT_VEC3);
+  reset = shader.uniform("u_reset", GL_BOOL);
+  reproject = shader.uniform("u_reproject", GL_BOOL);
+  max_history = shader.uniform("u_max_history", GL_FLOAT);
+}
+
+void Application::finish_benchmark() {
+  benchmark->report();
+
+  const Image &image = benchmark->captured_image();
+  double render_ms = benchmark->elapsed_ms();
+  ImageAttributes attributes = {
+      {"renderTimeMs", (float)render_ms},
+      {"frames", (float)benchmark->frame_count()},
+  };
+
+  if (!options.save_image_path.empty()) {
+    if (write_exr(options.save_image_path, image, attributes)) {
+      printf("regression: wrote %s\n", options.save_image_path.c_str());
+    } else {
+      exit_code = EXIT_FAILURE;
+    }
+  }
+
+  if (!options.compare_image_path.empty()) {
+    Image golden;
+    ImageAttributes golden_attributes;
+    ImageDiff diff;
+    if (!read_exr(options.compare_image_path, golden, &golden_attributes)) {
+      exit_code = EXIT_FAILURE;
+      return;
+    }
+    if (!compare_images(image, golden, diff)) {
+      printf("regression: FAIL size %dx%d does not match golden %dx%d\n",
+             image.width, image.height, golden.width, golden.height);
+      exit_code = EXIT_FAILURE;
+      return;
+    }
+
+    bool pass = diff.rmse <= options.rmse_threshold;
+    printf("regression: %s rmse %.5f (threshold %.5f), psnr %.2f dB, "
+           "max error %.4f\n",
+           pass ? "PASS" : "FAIL", diff.rmse, options.rmse_threshold,
+           diff.psnr_db, diff.max_abs_error);
+
+    for (const auto &attribute : golden_attributes) {
+      if (attribute.first == "renderTimeMs" && attribute.second > 0.0f) {
+        double delta = (render_ms - attribute.second) / attribute.second;
+        printf("regression: render %.1f ms vs golden %.1f ms (%+.1f%%)\n",
+               render_ms, attribute.second, delta * 100.0);
+      }
+    }
+    if (!pass) {
+      exit_code = EXIT_FAILURE;
+    }
+  }
 }
 
 void Application::error_callback(int error, const char *description) {
@@ -432,7 +919,7 @@ void Application::update_performance_metrics(double &last_time,
 
 void Application::draw_performance_window(float fps, float frame_time) {
   ImGui::SetNextWindowPos(ImVec2(10, 10), ImGuiCond_FirstUseEver);
-  ImGui::SetNextWindowSize(ImVec2(200, 80), ImGuiCond_FirstUseEver);
+  ImGui::SetNextWindowSize(ImVec2(260, 270), ImGuiCond_FirstUseEver);
   ImGui::Begin("Performance", nullptr,
                ImGuiWindowFlags_NoDecoration | ImGuiWindowFlags_NoMove |
                    ImGuiWindowFlags_NoInputs | ImGuiWindowFlags_NoNav |
@@ -447,9 +934,53 @@ void Application::draw_performance_window(float fps, float frame_time) {
 
   ImGui::Text("FPS: %s", fps_str);
   ImGui::Text("Frame Time: %s ms", frame_time_str);
+
+  // Percentiles over the whole ring are refreshed twice a second; the plots
+  // show the most recent frames.
+  double now = glfwGetTime();
+  if (now - telemetry_stats_time > 0.5) {
+    telemetry_stats = FrameTelemetry::compute_stats(telemetry.snapshot());
+    telemetry_stats_time = now;
+  }
+
+  const int plot_count = 240;
+  std::vector<FrameSample> recent = telemetry.snapshot(plot_count);
+  float frame_values[plot_count];
+  float gpu_values[plot_count];
+  int n = (int)recent.size();
+  for (int i = 0; i < n; ++i) {
+    frame_values[i] = recent[i].frame_ms;
+    gpu_values[i] = recent[i].gpu_ms;
+  }
+
+  const MetricStats &frame_stats = telemetry_stats.frame_ms;
+  ImGui::Text("p50/p95/p99: %.1f / %.1f / %.1f ms", frame_stats.p50,
+              frame_stats.p95, frame_stats.p99);
+  ImGui::Text("1%% low: %.1f FPS", telemetry_stats.low_1pct_fps);
+  ImGui::PlotLines("##frame_ms", frame_values, n, 0, "frame ms", 0.0f, 50.0f,
+                   ImVec2(240, 50));
+  ImGui::Text("GPU p50/p99: %.2f / %.2f ms", telemetry_stats.gpu_ms.p50,
+              telemetry_stats.gpu_ms.p99);
+  ImGui::Text("Trace/temporal: %.2f / %.2f ms",
+              profiler->last_gpu_ms("trace draw"),
+              profiler->last_gpu_ms("temporal"));
+  if (denoise) {
+    ImGui::Text("Denoise: %.2f ms (%d iterations)",
+                profiler->last_gpu_ms("denoise"), denoise_settings.iterations);
+  }
+  ImGui::PlotLines("##gpu_ms", gpu_values, n, 0, "gpu ms", 0.0f, 50.0f,
+                   ImVec2(240, 50));
   ImGui::End();
 }
 
+void Application::export_telemetry(const std::string &prefix) const {
+  if (telemetry.write_csv(prefix + ".csv") &&
+      telemetry.write_json(prefix + ".json")) {
+    fprintf(stderr, "[Telemetry] Wrote %s.csv and %s.json\n", prefix.c_str(),
+            prefix.c_str());
+  }
+}
+
 void Application::draw_settings(float &fov, float sun_dir[3],
                                 float &sun_intensity, float sun_color[3],
                                 float &sky_intensity, float sky_color[3],
@@ -463,13 +994,117 @@ void Application::draw_settings(float &fov, float sun_dir[3],
   ImGui::SliderFloat3("Direction", sun_dir, -1.0f, 1.0f);
   ImGui::SliderFloat("Intensity##Sun", &sun_intensity, 0.0f, 10.0f);
   ImGui::ColorEdit3("Color##Sun", sun_color);
+  ImGui::SliderFloat("Angular radius (deg)", &sun_angular_radius, 0.0f,
+                     10.0f);
   ImGui::Separator();
   ImGui::Text("Sky Light");
   ImGui::SliderFloat("Intensity##Sky", &sky_intensity, 0.0f, 5.0f);
-  ImGui::ColorEdit3("Color##Sky", sky_color);
+  if (environment) {
+    ImGui::Text("Map: %dx%d, %dx%d sampling cells", environment->width(),
+                environment->height(), environment->cells_x(),
+                environment->cells_y());
+  } else {
+    ImGui::ColorEdit3("Color##Sky", sky_color);
+  }
+  if (scene->count(kSectionLights) > 0) {
+    ImGui::Separator();
+    ImGui::Text("Emitters: %d, sampled by power",
+                scene->count(kSectionLights));
+  }
+  if (textures) {
+    ImGui::Text("Textures: %d, %dx%d with mips", textures->layers(),
+                textures->size(), textures->size());
+  }
   ImGui::Separator();
   ImGui::Text("Accumulation");
   ImGui::Checkbox("Accumulate when still", &accumulate_when_still);
+  ImGui::Checkbox("Temporal reprojection", &temporal_reprojection);
+  ImGui::SliderFloat("Max history (moving)", &max_history, 1.0f, 64.0f,
+                     "%.0f frames");
+  ImGui::Separator();
+  ImGui::Text("While Moving");
+  ImGui::Checkbox("Dynamic resolution", &dynamic_resolution_enabled);
+  ImGui::SliderFloat("GPU budget (ms)", &dynamic_resolution.target_ms, 4.0f,
+                     50.0f);
+  ImGui::SliderFloat("Min scale", &dynamic_resolution.min_scale, 0.25f,
+                     1.0f);
+  ImGui::Text("Scale while moving: %.0f%%",
+              dynamic_resolution.scale() * 100.0f);
+  ImGui::Text("Pixels traced while moving");
+  ImGui::RadioButton("All", &interleave, 1);
+  ImGui::SameLine();
+  ImGui::RadioButton("1/2", &interleave, 2);
+  ImGui::SameLine();
+  ImGui::RadioButton("1/4", &interleave, 4);
+  ImGui::Separator();
+  ImGui::Text("Progressive");
+  if (ImGui::SliderInt("Samples per pixel", &samples_per_pixel, 1, 64)) {
+    tile_scheduler->reset_estimate();
+  }
+  const char *filters[] = {"Pixel center", "Box", "Tent", "Blackman-Harris"};
+  ImGui::Combo("Pixel filter", &pixel_filter, filters, 4);
+  ImGui::Checkbox("Tiled rendering", &tiled_rendering);
+  ImGui::Checkbox("Cache primary hits when still", &cache_primary_hits);
+  if (cache_primary_hits && pixel_filter != 0) {
+    // Fewer offsets save memory and cache builds but resolve the filter
+    // at fewer points.
+    ImGui::SliderInt("Cached jitter offsets", &primary_offsets, 1, 8);
+  }
+  if (cache_primary_hits && primary_cache_valid) {
+    double bytes = (double)primary_cache->width() * primary_cache->height() *
+                   primary_cache->layers() * 3 * 16;
+    ImGui::Text("Primary cache: %d offsets, %.0f MB",
+                primary_cache->layers(), bytes / (1024.0 * 1024.0));
+  }
+  if (tiled_rendering) {
+    ImGui::SliderInt("Tile size", &tile_scheduler->tile_size, 32, 512);
+    ImGui::SliderFloat("Tile budget (ms)", &tile_scheduler->budget_ms, 1.0f,
+                       50.0f);
+    ImGui::Text("%d of %d tiles per frame, %.2f ms each",
+                tile_scheduler->tiles_this_frame(),
+                tile_scheduler->tile_count(), tile_scheduler->tile_ms());
+  }
+  ImGui::Separator();
+  ImGui::Text("Denoiser");
+  ImGui::Checkbox("Enabled##Denoiser", &denoise);
+  ImGui::SliderInt("Iterations", &denoise_settings.iterations, 1, 5);
+  ImGui::SliderFloat("Color tolerance", &denoise_settings.phi_color, 0.5f,
+                     16.0f);
+  ImGui::SliderFloat("Normal exponent", &denoise_settings.phi_normal, 1.0f,
+                     256.0f);
+  ImGui::SliderFloat("Depth tolerance", &denoise_settings.phi_depth, 0.1f,
+                     8.0f);
+  ImGui::Separator();
+  ImGui::Text("Telemetry");
+  if (ImGui::Button("Export CSV/JSON")) {
+    export_telemetry(options.telemetry_path.empty() ? "telemetry"
+                                                    : options.telemetry_path);
+  }
 
   ImGui::End(); 
 }
+
+bool Application::draw_instance_editor() {
+  if (scene->instance_count() == 0)
+    return false;
+
+  ImGui::Begin("Instances");
+  ImGui::SliderInt("Instance", &selected_instance, 0,
+                   scene->instance_count() - 1);
+
+  // Moving an instance only rebuilds the top-level BVH.
+  float transform[12];
+  memcpy(transform, scene->instance(selected_instance).transform,
+         sizeof(transform));
+  float position[3] = {transform[3], transform[7], transform[11]};
+  bool changed = ImGui::DragFloat3("Position", position, 0.05f);
+  if (changed) {
+    transform[3] = position[0];
+    transform[7] = position[1];
+    transform[11] = position[2];
+    scene->move_instance(selected_instance, transform);
+  }
+
+  ImGui::End();
+  return changed;
+}
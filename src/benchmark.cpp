@@ -0,0 +1,270 @@
+#include "benchmark.h"
+
+#include <glad/gl.h>
+#define GLFW_INCLUDE_NONE
+#include <GLFW/glfw3.h>
+
+#include <algorithm>
+#include <cinttypes>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdio.h>
+
+bool load_benchmark_script(const std::string &path, BenchmarkScript &script) {
+  std::ifstream file(path);
+  if (!file.is_open()) {
+    std::cerr << "[Benchmark] Failed to open script: " << path << std::endl;
+    return false;
+  }
+
+  std::string line;
+  int line_number = 0;
+  while (std::getline(file, line)) {
+    line_number += 1;
+    size_t comment = line.find('#');
+    if (comment != std::string::npos)
+      line.erase(comment);
+
+    std::istringstream in(line);
+    std::string directive;
+    if (!(in >> directive))
+      continue;
+
+    bool ok = true;
+    if (directive == "resolution") {
+      ok = static_cast<bool>(in >> script.width >> script.height);
+    } else if (directive == "frames") {
+      ok = static_cast<bool>(in >> script.frames);
+    } else if (directive == "warmup") {
+      ok = static_cast<bool>(in >> script.warmup);
+    } else if (directive == "seed") {
+      ok = static_cast<bool>(in >> script.seed);
+    } else if (directive == "hash_every") {
+      ok = static_cast<bool>(in >> script.hash_every);
+    } else if (directive == "samples_per_pixel") {
+      ok = static_cast<bool>(in >> script.samples_per_pixel) &&
+           script.samples_per_pixel >= 1;
+    } else if (directive == "pixel_filter") {
+      ok = static_cast<bool>(in >> script.pixel_filter) &&
+           script.pixel_filter >= 0 && script.pixel_filter <= 3;
+    } else if (directive == "denoise") {
+      ok = static_cast<bool>(in >> script.denoise_iterations) &&
+           script.denoise_iterations >= 0 && script.denoise_iterations <= 5;
+    } else if (directive == "key") {
+      CameraKey key;
+      ok = static_cast<bool>(in >> key.time >> key.position[0] >>
+                             key.position[1] >> key.position[2] >> key.yaw >>
+                             key.pitch >> key.fov);
+      script.keys.push_back(key);
+    } else {
+      ok = false;
+    }
+
+    if (!ok) {
+      std::cerr << "[Benchmark] " << path << ":" << line_number
+                << ": cannot parse '" << line << "'" << std::endl;
+      return false;
+    }
+  }
+
+  if (script.keys.empty()) {
+    std::cerr << "[Benchmark] " << path << ": no camera keys" << std::endl;
+    return false;
+  }
+  if (script.frames < 1) {
+    std::cerr << "[Benchmark] " << path << ": frames must be positive"
+              << std::endl;
+    return false;
+  }
+  return true;
+}
+
+bool save_benchmark_script(const std::string &path,
+                           const BenchmarkScript &script) {
+  FILE *file = fopen(path.c_str(), "w");
+  if (!file) {
+    fprintf(stderr, "[Benchmark] Failed to open %s\n", path.c_str());
+    return false;
+  }
+
+  fprintf(file, "resolution %d %d\n", script.width, script.height);
+  fprintf(file, "frames %d\n", script.frames);
+  fprintf(file, "warmup %d\n", script.warmup);
+  fprintf(file, "seed %u\n", script.seed);
+  fprintf(file, "hash_every %d\n", script.hash_every);
+  fprintf(file, "samples_per_pixel %d\n", script.samples_per_pixel);
+  fprintf(file, "pixel_filter %d\n", script.pixel_filter);
+  fprintf(file, "denoise %d\n", script.denoise_iterations);
+  fprintf(file, "# key time x y z yaw pitch fov\n");
+  for (const CameraKey &key : script.keys) {
+    fprintf(file, "key %.4f %.5f %.5f %.5f %.4f %.4f %.3f\n", key.time,
+            key.position[0], key.position[1], key.position[2], key.yaw,
+            key.pitch, key.fov);
+  }
+
+  fclose(file);
+  return true;
+}
+
+Camera evaluate_camera_path(const std::vector<CameraKey> &keys, float time) {
+  size_t next = 0;
+  while (next < keys.size() && keys[next].time < time)
+    next += 1;
+
+  const CameraKey &a = keys[next == 0 ? 0 : next - 1];
+  const CameraKey &b = keys[next < keys.size() ? next : keys.size() - 1];
+  float span = b.time - a.time;
+  float s = span > 0.0f ? (time - a.time) / span : 0.0f;
+
+  Camera camera;
+  for (int i = 0; i < 3; ++i)
+    camera.position[i] = a.position[i] + (b.position[i] - a.position[i]) * s;
+  camera.yaw = a.yaw + (b.yaw - a.yaw) * s;
+  camera.pitch = a.pitch + (b.pitch - a.pitch) * s;
+  camera.fov = a.fov + (b.fov - a.fov) * s;
+  update_camera_direction(camera);
+  return camera;
+}
+
+// FNV-1a over the 8-bit framebuffer; stable as long as the rendered image
+// is bit-identical.
+static uint64_t hash_framebuffer(int width, int height) {
+  std::vector<unsigned char> pixels((size_t)width * height * 4);
+  glPixelStorei(GL_PACK_ALIGNMENT, 1);
+  glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+
+  uint64_t hash = 1469598103934665603ull;
+  for (unsigned char byte : pixels) {
+    hash ^= byte;
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+// The unquantized color the frame was presented from.
+static Image read_framebuffer(GLuint framebuffer, int width, int height) {
+  std::vector<float> rgb((size_t)width * height * 3);
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+  glReadBuffer(GL_COLOR_ATTACHMENT0);
+  glPixelStorei(GL_PACK_ALIGNMENT, 1);
+  glReadPixels(0, 0, width, height, GL_RGB, GL_FLOAT, rgb.data());
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+
+  // GL rows start at the bottom, Image rows at the top.
+  Image image;
+  image.width = width;
+  image.height = height;
+  image.pixels.resize(rgb.size());
+  size_t row = (size_t)width * 3;
+  for (int y = 0; y < height; ++y) {
+    std::copy(rgb.begin() + (size_t)(height - 1 - y) * row,
+              rgb.begin() + (size_t)(height - y) * row,
+              image.pixels.begin() + (size_t)y * row);
+  }
+  return image;
+}
+
+BenchmarkRunner::BenchmarkRunner(const BenchmarkScript &script)
+    : script(script) {}
+
+bool BenchmarkRunner::begin_frame(Camera &camera, float &shader_time) {
+  int measured = frame - script.warmup;
+  if (measured == 0) {
+    glFinish();
+    start_time = glfwGetTime();
+  }
+
+  // Warmup frames sit on the first key.
+  float t = 0.0f;
+  if (measured > 0 && script.frames > 1) {
+    float duration = script.keys.back().time;
+    t = duration * (float)measured / (float)(script.frames - 1);
+  }
+  camera = evaluate_camera_path(script.keys, t);
+  shader_time = (float)script.seed + (float)frame * (1.0f / 60.0f);
+  return frame == 0;
+}
+
+void BenchmarkRunner::end_frame(GLuint output, int width, int height) {
+  int measured = frame - script.warmup;
+  frame += 1;
+  if (measured < 0)
+    return;
+
+  measured_width = width;
+  measured_height = height;
+
+  bool last = measured == script.frames - 1;
+  bool periodic = script.hash_every > 0 && measured % script.hash_every == 0;
+  if (last || periodic) {
+    // Readback stalls the pipeline, so it is kept out of the timed region.
+    double pause_start = glfwGetTime();
+    hashes.push_back({measured, hash_framebuffer(width, height)});
+    if (last && capture)
+      image = read_framebuffer(output, width, height);
+    start_time += glfwGetTime() - pause_start;
+  }
+
+  if (last) {
+    glFinish();
+    end_time = glfwGetTime();
+  }
+}
+
+bool BenchmarkRunner::finished() const {
+  return frame >= script.warmup + script.frames;
+}
+
+void BenchmarkRunner::report() const {
+  double seconds = end_time - start_time;
+  double fps = seconds > 0.0 ? script.frames / seconds : 0.0;
+  // samples_per_pixel primary paths per pixel per frame.
+  double paths = (double)measured_width * measured_height *
+                 script.samples_per_pixel * script.frames;
+  double mpaths = seconds > 0.0 ? paths / seconds * 1e-6 : 0.0;
+
+  printf("benchmark: %d frames at %dx%d, %d spp, filter %d, denoise %d "
+         "in %.3f s\n",
+         script.frames, measured_width, measured_height,
+         script.samples_per_pixel, script.pixel_filter,
+         script.denoise_iterations, seconds);
+  printf("benchmark: %.2f frames/s, %.2f Mpaths/s\n", fps, mpaths);
+  for (const auto &entry : hashes) {
+    printf("benchmark: frame %d hash %016" PRIx64 "\n", entry.first,
+           entry.second);
+  }
+}
+
+void CameraRecorder::update(const Camera &camera, double now) {
+  const double interval = 0.1;
+  if (start_time < 0.0) {
+    start_time = now;
+  } else if (now - last_sample < interval) {
+    return;
+  }
+  last_sample = now;
+
+  CameraKey key;
+  key.time = (float)(now - start_time);
+  for (int i = 0; i < 3; ++i)
+    key.position[i] = camera.position[i];
+  key.yaw = camera.yaw;
+  key.pitch = camera.pitch;
+  key.fov = camera.fov;
+  keys.push_back(key);
+}
+
+bool CameraRecorder::save(const std::string &path, int width,
+                          int height) const {
+  if (keys.empty())
+    return false;
+
+  BenchmarkScript script;
+  script.width = width;
+  script.height = height;
+  // Replay at 60 frames per recorded second.
+  script.frames = std::max(1, (int)(keys.back().time * 60.0f));
+  script.keys = keys;
+  return save_benchmark_script(path, script);
+}
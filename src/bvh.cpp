@@ -0,0 +1,225 @@
+#include "bvh.h"
+
+#include <algorithm>
+#include <cmath>
+
+void Aabb::grow(const float p[3]) {
+  for (int i = 0; i < 3; ++i) {
+    min[i] = std::min(min[i], p[i]);
+    max[i] = std::max(max[i], p[i]);
+  }
+}
+
+void Aabb::grow(const Aabb &other) {
+  if (other.empty())
+    return;
+  grow(other.min);
+  grow(other.max);
+}
+
+float Aabb::area() const {
+  if (empty())
+    return 0.0f;
+  float dx = max[0] - min[0];
+  float dy = max[1] - min[1];
+  float dz = max[2] - min[2];
+  return 2.0f * (dx * dy + dy * dz + dz * dx);
+}
+
+namespace {
+
+const int kBins = 12;
+const int kMaxLeafSize = 4;
+
+struct Builder {
+  const std::vector<Aabb> &items;
+  std::vector<float> centroids; // 3 per item
+  std::vector<BvhNode> &nodes;
+  std::vector<int> &order;
+
+  Builder(const std::vector<Aabb> &items, std::vector<BvhNode> &nodes,
+          std::vector<int> &order)
+      : items(items), nodes(nodes), order(order) {}
+
+  void build() {
+    nodes.clear();
+    order.resize(items.size());
+    centroids.resize(items.size() * 3);
+    for (size_t i = 0; i < items.size(); ++i) {
+      order[i] = (int)i;
+      for (int k = 0; k < 3; ++k)
+        centroids[i * 3 + k] = 0.5f * (items[i].min[k] + items[i].max[k]);
+    }
+
+    nodes.reserve(items.empty() ? 1 : items.size() * 2);
+    nodes.emplace_back();
+    nodes[0].first = 0;
+    nodes[0].count = (int)items.size();
+    update_bounds(0);
+    if (items.size() > (size_t)kMaxLeafSize)
+      subdivide(0, 0);
+  }
+
+  // Levels of median splits below a node of `count` items before leaves
+  // fit kMaxLeafSize.
+  static int median_levels(int count) {
+    int levels = 0;
+    while (count > kMaxLeafSize) {
+      count = (count + 1) / 2;
+      levels += 1;
+    }
+    return levels;
+  }
+
+  void update_bounds(int index) {
+    BvhNode &node = nodes[index];
+    node.bounds = Aabb();
+    for (int i = node.first; i < node.first + node.count; ++i)
+      node.bounds.grow(items[order[i]]);
+  }
+
+  // Returns the SAH cost of the best split, or infinity if none helps.
+  float find_split(const BvhNode &node, int &best_axis, float &best_pos) {
+    float best_cost = INFINITY;
+    for (int axis = 0; axis < 3; ++axis) {
+      float lo = INFINITY;
+      float hi = -INFINITY;
+      for (int i = node.first; i < node.first + node.count; ++i) {
+        float c = centroids[order[i] * 3 + axis];
+        lo = std::min(lo, c);
+        hi = std::max(hi, c);
+      }
+      if (hi <= lo)
+        continue;
+
+      Aabb bin_bounds[kBins];
+      int bin_counts[kBins] = {0};
+      float scale = kBins / (hi - lo);
+      for (int i = node.first; i < node.first + node.count; ++i) {
+        int item = order[i];
+        int bin = std::min(kBins - 1,
+                           (int)((centroids[item * 3 + axis] - lo) * scale));
+        bin_counts[bin] += 1;
+        bin_bounds[bin].grow(items[item]);
+      }
+
+      // Sweep from both sides to get the cost of every bin boundary.
+      float left_area[kBins - 1];
+      int left_count[kBins - 1];
+      Aabb left;
+      int count = 0;
+      for (int i = 0; i < kBins - 1; ++i) {
+        left.grow(bin_bounds[i]);
+        count += bin_counts[i];
+        left_area[i] = left.area();
+        left_count[i] = count;
+      }
+      Aabb right;
+      count = 0;
+      for (int i = kBins - 1; i > 0; --i) {
+        right.grow(bin_bounds[i]);
+        count += bin_counts[i];
+        float cost = left_count[i - 1] * left_area[i - 1] +
+                     count * right.area();
+        if (left_count[i - 1] > 0 && count > 0 && cost < best_cost) {
+          best_cost = cost;
+          best_axis = axis;
+          best_pos = lo + i / scale;
+        }
+      }
+    }
+    return best_cost;
+  }
+
+  void subdivide(int index, int depth) {
+    int first = nodes[index].first;
+    int last = first + nodes[index].count;
+    int mid = first;
+
+    // SAH may peel off a few items per level; once only median splits
+    // still bottom out within kBvhMaxDepth, split at the median centroid
+    // along the widest axis instead.
+    if (depth + median_levels(last - first) >= kBvhMaxDepth) {
+      const Aabb &bounds = nodes[index].bounds;
+      int axis = 0;
+      for (int k = 1; k < 3; ++k) {
+        if (bounds.max[k] - bounds.min[k] >
+            bounds.max[axis] - bounds.min[axis])
+          axis = k;
+      }
+      mid = first + (last - first) / 2;
+      std::nth_element(order.data() + first, order.data() + mid,
+                       order.data() + last, [&](int a, int b) {
+                         return centroids[a * 3 + axis] <
+                                centroids[b * 3 + axis];
+                       });
+      split(index, mid, depth);
+      return;
+    }
+
+    int axis = 0;
+    float pos = 0.0f;
+    float split_cost = find_split(nodes[index], axis, pos);
+    float leaf_cost = nodes[index].count * nodes[index].bounds.area();
+    if (!(split_cost < leaf_cost) && nodes[index].count <= 2 * kMaxLeafSize)
+      return;
+
+    if (split_cost < INFINITY) {
+      int *divider = std::partition(
+          order.data() + first, order.data() + last,
+          [&](int item) { return centroids[item * 3 + axis] < pos; });
+      mid = (int)(divider - order.data());
+    }
+    // Degenerate centroids: fall back to an even split.
+    if (mid == first || mid == last)
+      mid = first + (last - first) / 2;
+    split(index, mid, depth);
+  }
+
+  // Turns a node into an interior node over [first, mid) and [mid, last)
+  // of its items and subdivides both halves.
+  void split(int index, int mid, int depth) {
+    int first = nodes[index].first;
+    int last = first + nodes[index].count;
+    int left = (int)nodes.size();
+    nodes.emplace_back();
+    nodes.emplace_back();
+    nodes[left].first = first;
+    nodes[left].count = mid - first;
+    nodes[left + 1].first = mid;
+    nodes[left + 1].count = last - mid;
+    nodes[index].first = left;
+    nodes[index].count = 0;
+
+    for (int child = left; child <= left + 1; ++child) {
+      update_bounds(child);
+      if (nodes[child].count > kMaxLeafSize)
+        subdivide(child, depth + 1);
+    }
+  }
+};
+
+} // namespace
+
+void build_bvh(const std::vector<Aabb> &items, std::vector<BvhNode> &nodes,
+               std::vector<int> &order) {
+  Builder builder(items, nodes, order);
+  builder.build();
+}
+
+Aabb transform_aabb(const Aabb &box, const float m[12]) {
+  Aabb result;
+  if (box.empty())
+    return result;
+  for (int corner = 0; corner < 8; ++corner) {
+    float p[3] = {corner & 1 ? box.max[0] : box.min[0],
+                  corner & 2 ? box.max[1] : box.min[1],
+                  corner & 4 ? box.max[2] : box.min[2]};
+    float q[3];
+    for (int r = 0; r < 3; ++r)
+      q[r] = m[r * 4] * p[0] + m[r * 4 + 1] * p[1] + m[r * 4 + 2] * p[2] +
+             m[r * 4 + 3];
+    result.grow(q);
+  }
+  return result;
+}
@@ -0,0 +1,341 @@
+#include "cpu_tracer.h"
+
+#include <algorithm>
+#include <cstdint>
+
+namespace cpu {
+
+static Scene with_default_lighting(Scene scene) {
+  scene.plane =
+      Plane{{0.0f, 0.0f, 0.0f}, {0.0f, 1.0f, 0.0f}, {0.9f, 0.9f, 0.9f}};
+  scene.plane_material = Material{MAT_LAMBERT, {1.0f, 1.0f, 1.0f}, 0.0f, 1.0f};
+  scene.sun_direction = {0.4f, 0.8f, 0.2f};
+  scene.sun_color = {1.0f, 0.95f, 0.85f};
+  scene.sun_intensity = 0.6f;
+  scene.sky_color = {0.5f, 0.7f, 1.0f};
+  scene.sky_intensity = 0.0f;
+  return scene;
+}
+
+Scene default_scene() {
+  Scene scene;
+  scene.materials = {
+      {MAT_METAL, {1.0f, 0.0f, 0.2f}, 0.0f, 1.0f},
+      {MAT_METAL, {0.0f, 1.0f, 0.2f}, 0.0f, 1.0f},
+      {MAT_LAMBERT, {0.2f, 0.2f, 1.0f}, 0.0f, 1.0f},
+      {MAT_DIELECTRIC, {1.0f, 1.0f, 1.0f}, 0.0f, 1.5f},
+  };
+  scene.spheres = {
+      {{0.0f, 1.0f, -3.0f}, 1.0f, {1.0f, 1.0f, 1.0f}},
+      {{2.0f, 1.0f, -4.0f}, 1.0f, {1.0f, 1.0f, 1.0f}},
+      {{-2.0f, 1.0f, -4.0f}, 1.0f, {1.0f, 1.0f, 1.0f}},
+      {{0.0f, 1.0f, -6.0f}, 1.0f, {1.0f, 1.0f, 1.0f}},
+  };
+  return with_default_lighting(scene);
+}
+
+Scene sphere_grid_scene(int count) {
+  Scene scene;
+  for (int z = 0; z < count; ++z) {
+    for (int x = 0; x < count; ++x) {
+      float cx = ((float)x - 0.5f * (float)(count - 1)) * 1.2f;
+      float cz = -3.0f - (float)z * 1.2f;
+      scene.spheres.push_back({{cx, 0.5f, cz}, 0.5f, {1.0f, 1.0f, 1.0f}});
+
+      int type = (x + z) % 3;
+      Vec3 albedo = {0.3f + 0.7f * (float)x / (float)count, 0.5f,
+                     0.3f + 0.7f * (float)z / (float)count};
+      scene.materials.push_back(
+          {type, albedo, type == MAT_METAL ? 0.2f : 0.0f, 1.5f});
+    }
+  }
+  return with_default_lighting(scene);
+}
+
+bool hit_scene(const Scene &scene, const Ray &ray, float t_min,
+               HitRecord &record) {
+  HitRecord temp_record;
+  float t;
+  bool hit_anything = false;
+  float closest_t = kFltMax;
+
+  for (size_t i = 0; i < scene.spheres.size(); ++i) {
+    if (hit_sphere(scene.spheres[i], scene.materials[i], ray, t_min,
+                   closest_t, t, temp_record)) {
+      closest_t = t;
+      hit_anything = true;
+      record = temp_record;
+    }
+  }
+  if (hit_plane(scene.plane, scene.plane_material, ray, t_min, closest_t, t,
+                temp_record)) {
+    hit_anything = true;
+    record = temp_record;
+  }
+  return hit_anything;
+}
+
+static bool occluded(const Scene &scene, const Ray &shadow_ray) {
+  HitRecord temp_record;
+  float t;
+  for (size_t i = 0; i < scene.spheres.size(); ++i) {
+    if (hit_sphere(scene.spheres[i], scene.materials[i], shadow_ray, 0.001f,
+                   kFltMax, t, temp_record))
+      return true;
+  }
+  return hit_plane(scene.plane, scene.plane_material, shadow_ray, 0.001f,
+                   kFltMax, t, temp_record);
+}
+
+static Vec3 sky_radiance(const Scene &scene, const Ray &ray) {
+  Vec3 unit_direction = normalize(ray.direction);
+  float t = 0.5f * (unit_direction.y + 1.0f);
+  Vec3 sky_bottom = {1.0f, 1.0f, 1.0f};
+  return mix(sky_bottom, scene.sky_color, t) * scene.sky_intensity;
+}
+
+// Sun light reaching a hit, after one shadow ray.
+static Vec3 sun_direct(const Scene &scene, const HitRecord &record,
+                       Vec3 sun_dir) {
+  Ray shadow_ray = {record.point + record.normal * 0.001f, sun_dir};
+  if (occluded(scene, shadow_ray))
+    return {0.0f, 0.0f, 0.0f};
+  float n_dot_l = std::fmax(dot(record.normal, sun_dir), 0.0f);
+  return record.material.albedo * scene.sun_color * scene.sun_intensity *
+         n_dot_l;
+}
+
+Vec3 trace(const Scene &scene, const Ray &ray, Vec2 rnd_state,
+           long *ray_count) {
+  Ray cur_ray = ray;
+  Vec3 cur_attenuation = {1.0f, 1.0f, 1.0f};
+  Vec3 radiance = {0.0f, 0.0f, 0.0f};
+  Vec3 sun_dir = normalize(scene.sun_direction);
+  long rays = 0;
+
+  for (int i = 0; i < 50; i++) {
+    HitRecord record;
+    rays += 1;
+    if (!hit_scene(scene, cur_ray, 0.001f, record)) {
+      if (ray_count)
+        *ray_count += rays;
+      return radiance + cur_attenuation * sky_radiance(scene, cur_ray);
+    }
+
+    rays += 1;
+    radiance += cur_attenuation * sun_direct(scene, record, sun_dir);
+
+    Ray scattered;
+    Vec3 attenuation;
+    if (!scatter(cur_ray, record, attenuation, scattered, rnd_state))
+      break;
+    cur_attenuation *= attenuation;
+    cur_ray = scattered;
+  }
+
+  if (ray_count)
+    *ray_count += rays;
+  return radiance; // absorbed or exceeded "recursion"
+}
+
+namespace {
+
+// One path of a stream between bounces.
+struct PathState {
+  Ray ray;
+  Vec3 attenuation;
+  Vec3 radiance;
+  Vec2 rnd_state;
+  int index; // into the caller's arrays
+};
+
+} // namespace
+
+// Spreads the low 10 bits of v out to every third bit.
+static uint32_t spread_bits(uint32_t v) {
+  v &= 0x3ffu;
+  v = (v | (v << 16)) & 0x030000ffu;
+  v = (v | (v << 8)) & 0x0300f00fu;
+  v = (v | (v << 4)) & 0x030c30c3u;
+  v = (v | (v << 2)) & 0x09249249u;
+  return v;
+}
+
+// Sorts paths by the octant of their direction, then by the Morton code of
+// their origin quantized to 10 bits per axis over the stream's bounds. Keys
+// carry the path's position in their low half, so one sort of 64-bit
+// integers orders them and a gather moves the paths.
+static void sort_paths(std::vector<PathState> &paths,
+                       std::vector<PathState> &scratch,
+                       std::vector<uint64_t> &keys) {
+  Vec3 lo = {kFltMax, kFltMax, kFltMax};
+  Vec3 hi = {-kFltMax, -kFltMax, -kFltMax};
+  for (const PathState &path : paths) {
+    const Vec3 &o = path.ray.origin;
+    lo = {std::min(lo.x, o.x), std::min(lo.y, o.y), std::min(lo.z, o.z)};
+    hi = {std::max(hi.x, o.x), std::max(hi.y, o.y), std::max(hi.z, o.z)};
+  }
+  Vec3 extent = hi - lo;
+  Vec3 scale = {1023.0f / std::max(extent.x, 1e-6f),
+                1023.0f / std::max(extent.y, 1e-6f),
+                1023.0f / std::max(extent.z, 1e-6f)};
+
+  keys.resize(paths.size());
+  for (size_t i = 0; i < paths.size(); ++i) {
+    Vec3 q = (paths[i].ray.origin - lo) * scale;
+    const Vec3 &d = paths[i].ray.direction;
+    uint32_t octant = (d.x < 0.0f ? 1u : 0u) | (d.y < 0.0f ? 2u : 0u) |
+                      (d.z < 0.0f ? 4u : 0u);
+    uint32_t morton = spread_bits((uint32_t)q.x) |
+                      spread_bits((uint32_t)q.y) << 1 |
+                      spread_bits((uint32_t)q.z) << 2;
+    // 3 octant bits, 30 Morton bits, 31 index bits.
+    keys[i] = (uint64_t)octant << 61 | (uint64_t)morton << 31 | (uint64_t)i;
+  }
+  std::sort(keys.begin(), keys.end());
+
+  scratch.resize(paths.size());
+  for (size_t i = 0; i < keys.size(); ++i)
+    scratch[i] = paths[keys[i] & 0x7fffffff];
+  paths.swap(scratch);
+}
+
+// Distance to a sphere along a ray, the same root hit_sphere() picks.
+static bool sphere_distance(const Sphere &s, const Ray &ray, float t_min,
+                            float t_max, float &t_hit) {
+  Vec3 oc = ray.origin - s.center;
+  float a = dot(ray.direction, ray.direction);
+  float b = dot(oc, ray.direction);
+  float c = dot(oc, oc) - s.radius * s.radius;
+  float d = b * b - a * c;
+  if (d < 0.0f)
+    return false;
+
+  float sqrtd = std::sqrt(d);
+  float t = (-b - sqrtd) / a;
+  if (t < t_min || t > t_max) {
+    t = (-b + sqrtd) / a;
+    if (t < t_min || t > t_max)
+      return false;
+  }
+  t_hit = t;
+  return true;
+}
+
+// Closest hits for a packet of paths, one sphere at a time across the
+// packet rather than one ray at a time across the scene. Only distances are
+// kept while searching; each ray's record is filled in once at the end.
+// Matches hit_scene() ray by ray.
+static void hit_packet(const Scene &scene, const PathState *paths, int count,
+                       float t_min, HitRecord *records, bool *hits) {
+  float closest_t[kPacketSize];
+  int closest[kPacketSize];
+  for (int i = 0; i < count; ++i) {
+    closest_t[i] = kFltMax;
+    closest[i] = -1;
+  }
+
+  for (size_t s = 0; s < scene.spheres.size(); ++s) {
+    const Sphere &sphere = scene.spheres[s];
+    for (int i = 0; i < count; ++i) {
+      if (sphere_distance(sphere, paths[i].ray, t_min, closest_t[i],
+                          closest_t[i]))
+        closest[i] = (int)s;
+    }
+  }
+
+  float t;
+  for (int i = 0; i < count; ++i) {
+    hits[i] = closest[i] >= 0;
+    if (hits[i]) {
+      hit_sphere(scene.spheres[closest[i]], scene.materials[closest[i]],
+                 paths[i].ray, t_min, closest_t[i], t, records[i]);
+    }
+    if (hit_plane(scene.plane, scene.plane_material, paths[i].ray, t_min,
+                  closest_t[i], t, records[i]))
+      hits[i] = true;
+  }
+}
+
+void trace_stream(const Scene &scene, const std::vector<Ray> &rays,
+                  const std::vector<Vec2> &rnd_states, bool sort_rays,
+                  std::vector<Vec3> &radiance, long *ray_count) {
+  Vec3 sun_dir = normalize(scene.sun_direction);
+  radiance.assign(rays.size(), Vec3{0.0f, 0.0f, 0.0f});
+
+  std::vector<PathState> paths(rays.size());
+  for (size_t i = 0; i < rays.size(); ++i) {
+    paths[i] = PathState{rays[i], {1.0f, 1.0f, 1.0f}, {0.0f, 0.0f, 0.0f},
+                         rnd_states[i], (int)i};
+  }
+  std::vector<PathState> scratch;
+  std::vector<uint64_t> keys;
+  HitRecord records[kPacketSize];
+  bool hits[kPacketSize];
+  long rays_cast = 0;
+
+  for (int bounce = 0; bounce < 50 && !paths.empty(); ++bounce) {
+    if (sort_rays && bounce > 0)
+      sort_paths(paths, scratch, keys);
+
+    // Surviving paths are compacted in place; a path is only ever written
+    // over one already read.
+    size_t live = 0;
+    for (size_t base = 0; base < paths.size(); base += kPacketSize) {
+      int count = (int)std::min(paths.size() - base, (size_t)kPacketSize);
+      hit_packet(scene, &paths[base], count, 0.001f, records, hits);
+      rays_cast += count;
+
+      for (int i = 0; i < count; ++i) {
+        PathState path = paths[base + i];
+        if (!hits[i]) {
+          radiance[path.index] =
+              path.radiance + path.attenuation * sky_radiance(scene, path.ray);
+          continue;
+        }
+
+        const HitRecord &record = records[i];
+        rays_cast += 1;
+        path.radiance += path.attenuation * sun_direct(scene, record, sun_dir);
+
+        Ray scattered;
+        Vec3 attenuation;
+        if (!scatter(path.ray, record, attenuation, scattered,
+                     path.rnd_state)) {
+          radiance[path.index] = path.radiance;
+          continue;
+        }
+        path.attenuation *= attenuation;
+        path.ray = scattered;
+        paths[live++] = path;
+      }
+    }
+    paths.resize(live);
+  }
+
+  for (const PathState &path : paths)
+    radiance[path.index] = path.radiance; // exceeded "recursion"
+  if (ray_count)
+    *ray_count += rays_cast;
+}
+
+Ray camera_ray(const Vec3 &position, const Vec3 &direction, float fov, int x,
+               int y, int width, int height) {
+  // gl_FragCoord is the pixel center.
+  float u = ((float)x + 0.5f) / (float)width * 2.0f - 1.0f;
+  float v = ((float)y + 0.5f) / (float)height * 2.0f - 1.0f;
+  u *= (float)width / (float)height;
+
+  Vec3 world_up = {0.0f, 1.0f, 0.0f};
+  Vec3 fwd = normalize(direction);
+  Vec3 right = normalize(cross(fwd, world_up));
+  Vec3 up = normalize(cross(right, fwd));
+
+  float z = -1.0f / std::tan(fov * (3.14159265f / 180.0f) * 0.5f);
+  Vec3 local = normalize(Vec3{u, v, z});
+  // mat3(right, up, -fwd) * local
+  Vec3 dir = right * local.x + up * local.y - fwd * local.z;
+  return Ray{position, dir};
+}
+
+} // namespace cpu
@@ -0,0 +1,106 @@
+#include "denoiser.h"
+
+#include <algorithm>
+
+// Texture units shared by both passes.
+enum DenoiseUnit {
+  kUnitGbuffer = 0,
+  kUnitNormal,
+  kUnitAlbedo,
+  kUnitInput, // history in the variance pass
+  kUnitMoments,
+};
+
+static void bind_texture(int unit, GLuint texture) {
+  glActiveTexture(GL_TEXTURE0 + unit);
+  glBindTexture(GL_TEXTURE_2D, texture);
+}
+
+Denoiser::Denoiser() {
+  ShaderOptions variance_options;
+  variance_options.defines.push_back("VARIANCE");
+  variance_shader = new Shader("shaders/shader.vert", "shaders/denoise.frag",
+                               variance_options);
+  atrous_shader = new Shader("shaders/shader.vert", "shaders/denoise.frag");
+
+  const Shader &v = *variance_shader;
+  variance_uniforms.gbuffer = v.uniform("u_gbuffer", GL_SAMPLER_2D);
+  variance_uniforms.normal = v.uniform("u_normal", GL_SAMPLER_2D);
+  variance_uniforms.albedo = v.uniform("u_albedo", GL_SAMPLER_2D);
+  variance_uniforms.history = v.uniform("u_history", GL_SAMPLER_2D);
+  variance_uniforms.moments = v.uniform("u_moments", GL_SAMPLER_2D);
+
+  const Shader &a = *atrous_shader;
+  atrous_uniforms.gbuffer = a.uniform("u_gbuffer", GL_SAMPLER_2D);
+  atrous_uniforms.normal = a.uniform("u_normal", GL_SAMPLER_2D);
+  atrous_uniforms.albedo = a.uniform("u_albedo", GL_SAMPLER_2D);
+  atrous_uniforms.input = a.uniform("u_input", GL_SAMPLER_2D);
+  atrous_uniforms.step = a.uniform("u_step", GL_INT);
+  atrous_uniforms.remodulate = a.uniform("u_remodulate", GL_BOOL);
+  atrous_uniforms.phi_color = a.uniform("u_phi_color", GL_FLOAT);
+  atrous_uniforms.phi_normal = a.uniform("u_phi_normal", GL_FLOAT);
+  atrous_uniforms.phi_depth = a.uniform("u_phi_depth", GL_FLOAT);
+  atrous_uniforms.pixel_spread = a.uniform("u_pixel_spread", GL_FLOAT);
+
+  for (int i = 0; i < 2; ++i) {
+    targets[i] = new RenderTarget({GL_RGBA32F});
+  }
+}
+
+Denoiser::~Denoiser() {
+  delete variance_shader;
+  delete atrous_shader;
+  delete targets[0];
+  delete targets[1];
+}
+
+void Denoiser::resize(int width, int height) {
+  if (width == targets[0]->width() && height == targets[0]->height())
+    return;
+  targets[0]->resize(width, height);
+  targets[1]->resize(width, height);
+}
+
+const RenderTarget &Denoiser::run(const DenoiseInputs &inputs,
+                                  const DenoiseSettings &settings,
+                                  float pixel_spread) {
+  bind_texture(kUnitGbuffer, inputs.gbuffer);
+  bind_texture(kUnitNormal, inputs.normal);
+  bind_texture(kUnitAlbedo, inputs.albedo);
+  bind_texture(kUnitInput, inputs.history);
+  bind_texture(kUnitMoments, inputs.moments);
+
+  const VarianceUniforms &v = variance_uniforms;
+  targets[0]->bind();
+  variance_shader->use();
+  variance_shader->set_int(v.gbuffer, kUnitGbuffer);
+  variance_shader->set_int(v.normal, kUnitNormal);
+  variance_shader->set_int(v.albedo, kUnitAlbedo);
+  variance_shader->set_int(v.history, kUnitInput);
+  variance_shader->set_int(v.moments, kUnitMoments);
+  glDrawArrays(GL_TRIANGLES, 0, 3);
+
+  const AtrousUniforms &a = atrous_uniforms;
+  atrous_shader->use();
+  atrous_shader->set_int(a.gbuffer, kUnitGbuffer);
+  atrous_shader->set_int(a.normal, kUnitNormal);
+  atrous_shader->set_int(a.albedo, kUnitAlbedo);
+  atrous_shader->set_int(a.input, kUnitInput);
+  atrous_shader->set_float(a.phi_color, settings.phi_color);
+  atrous_shader->set_float(a.phi_normal, settings.phi_normal);
+  atrous_shader->set_float(a.phi_depth, settings.phi_depth);
+  atrous_shader->set_float(a.pixel_spread, pixel_spread);
+
+  // At least one iteration, since the last one restores the albedo.
+  int iterations = std::max(settings.iterations, 1);
+  for (int i = 0; i < iterations; ++i) {
+    bind_texture(kUnitInput, targets[i % 2]->texture(0));
+    targets[(i + 1) % 2]->bind();
+    atrous_shader->set_int(a.step, 1 << i);
+    atrous_shader->set_bool(a.remodulate, i == iterations - 1);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+  }
+  glActiveTexture(GL_TEXTURE0);
+
+  return *targets[iterations % 2];
+}
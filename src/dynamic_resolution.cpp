@@ -0,0 +1,43 @@
+#include "dynamic_resolution.h"
+
+#include "gpu_timer.h"
+
+#include <algorithm>
+#include <cmath>
+
+// Scales snap to multiples of this so timing noise does not reallocate the
+// render targets every frame.
+static const float kScaleStep = 1.0f / 16.0f;
+// Measured frame times within this fraction of the budget are left alone.
+static const float kDeadband = 0.1f;
+// Measurements averaged before acting on them.
+static const int kMinSamples = 4;
+static const int kSettleFrames = GpuTimer::kLatency + 1;
+
+void DynamicResolution::update(float gpu_ms) {
+  if (settle_frames > 0) {
+    --settle_frames;
+    return;
+  }
+
+  smoothed_ms = samples == 0 ? gpu_ms : smoothed_ms * 0.75f + gpu_ms * 0.25f;
+  if (++samples < kMinSamples || smoothed_ms <= 0.0f)
+    return;
+
+  float ratio = target_ms / smoothed_ms;
+  if (fabsf(ratio - 1.0f) < kDeadband)
+    return;
+
+  float desired = roundf(current_scale * sqrtf(ratio) / kScaleStep) *
+                  kScaleStep;
+  desired = std::min(std::max(desired, min_scale), 1.0f);
+  if (desired != current_scale) {
+    current_scale = desired;
+    hold();
+  }
+}
+
+void DynamicResolution::hold() {
+  settle_frames = kSettleFrames;
+  samples = 0;
+}
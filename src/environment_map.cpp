@@ -0,0 +1,164 @@
+#include "environment_map.h"
+
+#include "alias_table.h"
+#include "gl_debug.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+
+static float luminance(const float *rgb) {
+  return 0.2126f * rgb[0] + 0.7152f * rgb[1] + 0.0722f * rgb[2];
+}
+
+void build_environment_distribution(const Image &image, ThreadPool &pool,
+                                    EnvironmentDistribution &distribution) {
+  int factor = 1;
+  while (image.width / factor > EnvironmentDistribution::kMaxWidth)
+    factor *= 2;
+  int width = std::max(image.width / factor, 1);
+  int height = std::max(image.height / factor, 1);
+  int stride = std::max(width, height);
+  distribution.width = width;
+  distribution.height = height;
+  distribution.stride = stride;
+  distribution.texels.assign((size_t)stride * (height + 1) * 3, 0.0f);
+
+  // Rows are independent: each averages its cells and builds its own table.
+  std::vector<double> row_sums(height);
+  pool.parallel_for(height, [&](int y) {
+    std::vector<double> weights(width);
+    float theta = ((float)y + 0.5f) / (float)height * 3.14159265f;
+    float sin_theta = std::sin(theta);
+    int y0 = y * image.height / height;
+    int y1 = std::max((y + 1) * image.height / height, y0 + 1);
+    for (int x = 0; x < width; ++x) {
+      int x0 = x * image.width / width;
+      int x1 = std::max((x + 1) * image.width / width, x0 + 1);
+      double sum = 0.0;
+      for (int py = y0; py < y1; ++py)
+        for (int px = x0; px < x1; ++px)
+          sum += std::max(luminance(image.at(px, py)), 0.0f);
+      weights[x] = sum / ((double)(x1 - x0) * (y1 - y0)) * sin_theta;
+    }
+
+    float *row = &distribution.texels[(size_t)y * stride * 3];
+    build_alias_table(weights.data(), width, row, row + 1, 3);
+    double row_sum = 0.0;
+    for (int x = 0; x < width; ++x) {
+      row[x * 3 + 2] = (float)weights[x];
+      row_sum += weights[x];
+    }
+    row_sums[y] = row_sum;
+  });
+
+  double total = 0.0;
+  for (double sum : row_sums)
+    total += sum;
+  distribution.total = (float)total;
+  if (total <= 0.0)
+    return;
+
+  float *marginal = &distribution.texels[(size_t)height * stride * 3];
+  build_alias_table(row_sums.data(), height, marginal, marginal + 1, 3);
+  for (int y = 0; y < height; ++y)
+    marginal[y * 3 + 2] = (float)(row_sums[y] / total);
+
+  pool.parallel_for(height, [&](int y) {
+    float *row = &distribution.texels[(size_t)y * stride * 3];
+    for (int x = 0; x < width; ++x)
+      row[x * 3 + 2] = (float)(row[x * 3 + 2] / total);
+  });
+}
+
+EnvironmentMap::~EnvironmentMap() {
+  glDeleteTextures(1, &radiance);
+  glDeleteTextures(1, &distribution);
+}
+
+bool EnvironmentMap::load(const std::string &path, ThreadPool &pool) {
+  auto start = std::chrono::steady_clock::now();
+
+  Image image;
+  std::string extension = std::filesystem::path(path).extension().string();
+  std::transform(extension.begin(), extension.end(), extension.begin(),
+                 [](unsigned char c) { return (char)tolower(c); });
+  if (extension == ".hdr") {
+    if (!read_hdr(path, image))
+      return false;
+  } else if (extension == ".exr") {
+    if (!read_exr(path, image))
+      return false;
+  } else {
+    fprintf(stderr, "[Environment] %s: expected a .hdr or .exr file\n",
+            path.c_str());
+    return false;
+  }
+
+  GLint max_size = 0;
+  glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_size);
+  if (image.width > max_size || image.height > max_size) {
+    fprintf(stderr, "[Environment] %s: %dx%d exceeds the %d texel limit\n",
+            path.c_str(), image.width, image.height, max_size);
+    return false;
+  }
+
+  std::vector<uint32_t> packed((size_t)image.width * image.height);
+  pool.parallel_for(image.height, [&](int y) {
+    for (int x = 0; x < image.width; ++x)
+      packed[(size_t)y * image.width + x] = pack_rgb9e5(image.at(x, y));
+  });
+
+  EnvironmentDistribution tables;
+  build_environment_distribution(image, pool, tables);
+
+  image_width = image.width;
+  image_height = image.height;
+
+  // Rows go up top first, so t = theta / pi.
+  GL_CALL(glGenTextures(1, &radiance));
+  GL_CALL(glBindTexture(GL_TEXTURE_2D, radiance));
+  GL_CALL(glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB9_E5, image.width,
+                       image.height, 0, GL_RGB, GL_UNSIGNED_INT_5_9_9_9_REV,
+                       packed.data()));
+  GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR));
+  GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
+  GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT));
+  GL_CALL(
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
+
+  if (tables.total > 0.0f) {
+    cells[0] = tables.width;
+    cells[1] = tables.height;
+    GL_CALL(glGenTextures(1, &distribution));
+    GL_CALL(glBindTexture(GL_TEXTURE_2D, distribution));
+    GL_CALL(glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB32F, tables.stride,
+                         tables.height + 1, 0, GL_RGB, GL_FLOAT,
+                         tables.texels.data()));
+    GL_CALL(
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST));
+    GL_CALL(
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST));
+  }
+  GL_CALL(glBindTexture(GL_TEXTURE_2D, 0));
+
+  float ms = std::chrono::duration<float, std::milli>(
+                 std::chrono::steady_clock::now() - start)
+                 .count();
+  fprintf(stderr,
+          "[Environment] Loaded %s in %.1f ms: %dx%d, %dx%d sampling cells, "
+          "%d threads\n",
+          path.c_str(), ms, image.width, image.height, cells[0], cells[1],
+          pool.size());
+  return true;
+}
+
+void EnvironmentMap::bind(int radiance_unit, int distribution_unit) const {
+  glActiveTexture(GL_TEXTURE0 + radiance_unit);
+  glBindTexture(GL_TEXTURE_2D, radiance);
+  glActiveTexture(GL_TEXTURE0 + distribution_unit);
+  glBindTexture(GL_TEXTURE_2D, distribution);
+  glActiveTexture(GL_TEXTURE0);
+}
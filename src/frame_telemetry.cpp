@@ -0,0 +1,135 @@
+#include "frame_telemetry.h"
+
+#include <algorithm>
+#include <cinttypes>
+#include <stdio.h>
+
+void FrameTelemetry::record(const FrameSample &sample) {
+  FrameSample &slot = samples[head % kCapacity];
+  slot = sample;
+  slot.frame = head;
+  head += 1;
+}
+
+std::vector<FrameSample> FrameTelemetry::snapshot(size_t max_count) const {
+  uint64_t end = head;
+  uint64_t count = std::min<uint64_t>({end, kCapacity, max_count});
+
+  std::vector<FrameSample> result;
+  result.reserve(count);
+  for (uint64_t i = end - count; i < end; ++i) {
+    result.push_back(samples[i % kCapacity]);
+  }
+  return result;
+}
+
+static MetricStats percentiles(std::vector<float> &values) {
+  MetricStats stats;
+  if (values.empty())
+    return stats;
+
+  std::sort(values.begin(), values.end());
+  auto rank = [&](float p) {
+    size_t index = (size_t)(p * (float)(values.size() - 1) + 0.5f);
+    return values[index];
+  };
+  stats.p50 = rank(0.50f);
+  stats.p95 = rank(0.95f);
+  stats.p99 = rank(0.99f);
+  return stats;
+}
+
+FrameStats
+FrameTelemetry::compute_stats(const std::vector<FrameSample> &samples) {
+  FrameStats stats;
+  stats.count = samples.size();
+  if (samples.empty())
+    return stats;
+
+  std::vector<float> values(samples.size());
+  auto metric = [&](float FrameSample::*field) {
+    for (size_t i = 0; i < samples.size(); ++i)
+      values[i] = samples[i].*field;
+    return percentiles(values);
+  };
+
+  stats.cpu_ms = metric(&FrameSample::cpu_ms);
+  stats.gpu_ms = metric(&FrameSample::gpu_ms);
+  stats.present_ms = metric(&FrameSample::present_ms);
+  stats.input_latency_ms = metric(&FrameSample::input_latency_ms);
+  // Last, so `values` is left sorted by frame time for the averages below.
+  stats.frame_ms = metric(&FrameSample::frame_ms);
+
+  double total_ms = 0.0;
+  for (float v : values)
+    total_ms += v;
+
+  size_t low_count = std::max<size_t>(1, values.size() / 100);
+  double low_ms = 0.0;
+  for (size_t i = values.size() - low_count; i < values.size(); ++i)
+    low_ms += values[i];
+
+  if (total_ms > 0.0)
+    stats.avg_fps = (float)(1000.0 * values.size() / total_ms);
+  if (low_ms > 0.0)
+    stats.low_1pct_fps = (float)(1000.0 * low_count / low_ms);
+  return stats;
+}
+
+bool FrameTelemetry::write_csv(const std::string &path) const {
+  FILE *file = fopen(path.c_str(), "w");
+  if (!file) {
+    fprintf(stderr, "[Telemetry] Failed to open %s\n", path.c_str());
+    return false;
+  }
+
+  fprintf(file, "frame,frame_ms,cpu_ms,gpu_ms,present_ms,input_latency_ms\n");
+  for (const FrameSample &s : snapshot()) {
+    fprintf(file, "%" PRIu64 ",%.4f,%.4f,%.4f,%.4f,%.4f\n", s.frame,
+            s.frame_ms, s.cpu_ms, s.gpu_ms, s.present_ms, s.input_latency_ms);
+  }
+
+  fclose(file);
+  return true;
+}
+
+static void write_metric(FILE *file, const char *name, const MetricStats &m,
+                         bool last = false) {
+  fprintf(file,
+          "    \"%s\": {\"p50\": %.4f, \"p95\": %.4f, \"p99\": %.4f}%s\n",
+          name, m.p50, m.p95, m.p99, last ? "" : ",");
+}
+
+bool FrameTelemetry::write_json(const std::string &path) const {
+  FILE *file = fopen(path.c_str(), "w");
+  if (!file) {
+    fprintf(stderr, "[Telemetry] Failed to open %s\n", path.c_str());
+    return false;
+  }
+
+  std::vector<FrameSample> frames = snapshot();
+  FrameStats stats = compute_stats(frames);
+
+  fprintf(file, "{\n  \"frames\": %zu,\n", stats.count);
+  fprintf(file, "  \"avg_fps\": %.2f,\n", stats.avg_fps);
+  fprintf(file, "  \"low_1pct_fps\": %.2f,\n", stats.low_1pct_fps);
+  fprintf(file, "  \"stats\": {\n");
+  write_metric(file, "frame_ms", stats.frame_ms);
+  write_metric(file, "cpu_ms", stats.cpu_ms);
+  write_metric(file, "gpu_ms", stats.gpu_ms);
+  write_metric(file, "present_ms", stats.present_ms);
+  write_metric(file, "input_latency_ms", stats.input_latency_ms, true);
+  fprintf(file, "  },\n  \"samples\": [\n");
+  for (size_t i = 0; i < frames.size(); ++i) {
+    const FrameSample &s = frames[i];
+    fprintf(file, "    [%" PRIu64 ", %.4f, %.4f, %.4f, %.4f, %.4f]%s\n",
+            s.frame, s.frame_ms, s.cpu_ms, s.gpu_ms, s.present_ms,
+            s.input_latency_ms, i + 1 < frames.size() ? "," : "");
+  }
+  fprintf(file, "  ],\n  \"sample_fields\": [\"frame\", \"frame_ms\", "
+                "\"cpu_ms\", \"gpu_ms\", \"present_ms\", "
+                "\"input_latency_ms\"]\n}\n");
+
+  fclose(file);
+  return true;
+}
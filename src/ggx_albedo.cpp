@@ -0,0 +1,206 @@
+#include "ggx_albedo.h"
+
+#include "gl_debug.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+
+// Shared with shader.frag: roughness 0 is kept just shy of a perfect
+// mirror so one code path covers both.
+static float ggx_alpha(float roughness) {
+  return std::max(roughness * roughness, 1e-3f);
+}
+
+// Smith Lambda for GGX, in terms of the cosine to the normal.
+static float ggx_lambda(float cos_theta, float alpha) {
+  float cos2 = std::max(cos_theta * cos_theta, 1e-8f);
+  float tan2 = std::max(1.0f - cos2, 0.0f) / cos2;
+  return 0.5f * (std::sqrt(1.0f + alpha * alpha * tan2) - 1.0f);
+}
+
+// Heitz 2018, "Sampling the GGX Distribution of Visible Normals". `v` is
+// in the local frame with the normal along +z.
+static void sample_ggx_vndf(const float v[3], float alpha, float u1,
+                            float u2, float m[3]) {
+  float vh[3] = {alpha * v[0], alpha * v[1], v[2]};
+  float inv = 1.0f / std::sqrt(vh[0] * vh[0] + vh[1] * vh[1] + vh[2] * vh[2]);
+  for (float &c : vh)
+    c *= inv;
+  float lensq = vh[0] * vh[0] + vh[1] * vh[1];
+  float t1[3] = {1.0f, 0.0f, 0.0f};
+  if (lensq > 0.0f) {
+    float s = 1.0f / std::sqrt(lensq);
+    t1[0] = -vh[1] * s;
+    t1[1] = vh[0] * s;
+  }
+  float t2[3] = {vh[1] * t1[2] - vh[2] * t1[1], vh[2] * t1[0] - vh[0] * t1[2],
+                 vh[0] * t1[1] - vh[1] * t1[0]};
+
+  float r = std::sqrt(u1);
+  float phi = 2.0f * 3.14159265f * u2;
+  float p1 = r * std::cos(phi);
+  float p2 = r * std::sin(phi);
+  float s = 0.5f * (1.0f + vh[2]);
+  p2 = (1.0f - s) * std::sqrt(std::max(1.0f - p1 * p1, 0.0f)) + s * p2;
+  float p3 = std::sqrt(std::max(1.0f - p1 * p1 - p2 * p2, 0.0f));
+
+  float nh[3];
+  for (int k = 0; k < 3; ++k)
+    nh[k] = p1 * t1[k] + p2 * t2[k] + p3 * vh[k];
+  m[0] = alpha * nh[0];
+  m[1] = alpha * nh[1];
+  m[2] = std::max(nh[2], 0.0f);
+  inv = 1.0f / std::sqrt(m[0] * m[0] + m[1] * m[1] + m[2] * m[2]);
+  for (int k = 0; k < 3; ++k)
+    m[k] *= inv;
+}
+
+static float dot3(const float a[3], const float b[3]) {
+  return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+// Height-correlated G2 / G1, the weight of a visible-normal sample.
+static float ggx_masking(float cos_o, float cos_i, float alpha) {
+  float lambda_o = ggx_lambda(cos_o, alpha);
+  return (1.0f + lambda_o) / (1.0f + lambda_o + ggx_lambda(cos_i, alpha));
+}
+
+// As in shader.frag.
+static float schlick(float cosine, float ref_idx) {
+  float r0 = (1.0f - ref_idx) / (1.0f + ref_idx);
+  r0 = r0 * r0;
+  return r0 + (1.0f - r0) * std::pow(1.0f - cosine, 5.0f);
+}
+
+static float conductor_albedo(float cos_o, float alpha) {
+  const int samples = GgxAlbedoTable::kConductorSamples;
+  float v[3] = {std::sqrt(1.0f - cos_o * cos_o), 0.0f, cos_o};
+  double sum = 0.0;
+  for (int j = 0; j < samples; ++j) {
+    for (int i = 0; i < samples; ++i) {
+      float m[3];
+      sample_ggx_vndf(v, alpha, (i + 0.5f) / samples, (j + 0.5f) / samples,
+                      m);
+      float cos_i = 2.0f * dot3(v, m) * m[2] - v[2];
+      if (cos_i > 0.0f)
+        sum += ggx_masking(cos_o, cos_i, alpha);
+    }
+  }
+  return (float)(sum / ((double)samples * samples));
+}
+
+// Both branches of scatter_dielectric() weighted by how often it takes
+// them, rather than flipping the coin.
+static float dielectric_albedo(float cos_o, float alpha, float eta) {
+  const int samples = GgxAlbedoTable::kDielectricSamples;
+  float v[3] = {std::sqrt(1.0f - cos_o * cos_o), 0.0f, cos_o};
+  double sum = 0.0;
+  for (int j = 0; j < samples; ++j) {
+    for (int i = 0; i < samples; ++i) {
+      float m[3];
+      sample_ggx_vndf(v, alpha, (i + 0.5f) / samples, (j + 0.5f) / samples,
+                      m);
+      float cos_theta = std::min(dot3(v, m), 1.0f);
+      float sin_theta = std::sqrt(std::max(0.0f, 1.0f - cos_theta * cos_theta));
+      float reflect_prob =
+          eta * sin_theta > 1.0f ? 1.0f : schlick(cos_theta, eta);
+
+      float reflected = 2.0f * cos_theta * m[2] - v[2];
+      if (reflected > 0.0f)
+        sum += reflect_prob * ggx_masking(cos_o, reflected, alpha);
+
+      // refract(-v, m, eta) from GLSL, z component only.
+      float k = 1.0f - eta * eta * (1.0f - cos_theta * cos_theta);
+      if (reflect_prob < 1.0f && k >= 0.0f) {
+        float refracted = -eta * v[2] - (std::sqrt(k) - eta * cos_theta) * m[2];
+        if (refracted < 0.0f) {
+          sum += (1.0f - reflect_prob) *
+                 ggx_masking(cos_o, -refracted, alpha);
+        }
+      }
+    }
+  }
+  return (float)(sum / ((double)samples * samples));
+}
+
+void build_ggx_albedo_table(ThreadPool &pool, GgxAlbedoTable &table) {
+  const int n = GgxAlbedoTable::kSize;
+  const int layers = GgxAlbedoTable::kLayers;
+  table.conductor.assign((size_t)n * n, 0.0f);
+  table.dielectric.assign((size_t)n * n * layers, 0.0f);
+
+  // One item per row of every table, conductor rows first.
+  pool.parallel_for(n * (layers + 1), [&](int item) {
+    int row = item % n;
+    int layer = item / n - 1;
+    float alpha = ggx_alpha((float)row / (n - 1));
+    float log_eta = std::log(GgxAlbedoTable::kMaxEta) *
+                    (2.0f * layer / (layers - 1) - 1.0f);
+    for (int col = 0; col < n; ++col) {
+      float cos_o = std::max((float)col / (n - 1), 1e-3f);
+      if (layer < 0) {
+        table.conductor[(size_t)row * n + col] =
+            conductor_albedo(cos_o, alpha);
+      } else {
+        table.dielectric[((size_t)layer * n + row) * n + col] =
+            dielectric_albedo(cos_o, alpha, std::exp(log_eta));
+      }
+    }
+  });
+}
+
+GgxAlbedoLut::GgxAlbedoLut(ThreadPool &pool) {
+  auto start = std::chrono::steady_clock::now();
+  GgxAlbedoTable table;
+  build_ggx_albedo_table(pool, table);
+
+  const int n = GgxAlbedoTable::kSize;
+  GL_CALL(glGenTextures(1, &conductor));
+  GL_CALL(glBindTexture(GL_TEXTURE_2D, conductor));
+  GL_CALL(glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, n, n, 0, GL_RED, GL_FLOAT,
+                       table.conductor.data()));
+  GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR));
+  GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
+  GL_CALL(
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
+  GL_CALL(
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
+  GL_CALL(glBindTexture(GL_TEXTURE_2D, 0));
+
+  GL_CALL(glGenTextures(1, &dielectric));
+  GL_CALL(glBindTexture(GL_TEXTURE_3D, dielectric));
+  GL_CALL(glTexImage3D(GL_TEXTURE_3D, 0, GL_R32F, n, n,
+                       GgxAlbedoTable::kLayers, 0, GL_RED, GL_FLOAT,
+                       table.dielectric.data()));
+  GL_CALL(glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR));
+  GL_CALL(glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
+  GL_CALL(
+      glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
+  GL_CALL(
+      glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
+  GL_CALL(
+      glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE));
+  GL_CALL(glBindTexture(GL_TEXTURE_3D, 0));
+
+  float ms = std::chrono::duration<float, std::milli>(
+                 std::chrono::steady_clock::now() - start)
+                 .count();
+  fprintf(stderr,
+          "[Materials] Built the GGX albedo tables in %.1f ms, %d threads\n",
+          ms, pool.size());
+}
+
+GgxAlbedoLut::~GgxAlbedoLut() {
+  glDeleteTextures(1, &conductor);
+  glDeleteTextures(1, &dielectric);
+}
+
+void GgxAlbedoLut::bind(int conductor_unit, int dielectric_unit) const {
+  glActiveTexture(GL_TEXTURE0 + conductor_unit);
+  glBindTexture(GL_TEXTURE_2D, conductor);
+  glActiveTexture(GL_TEXTURE0 + dielectric_unit);
+  glBindTexture(GL_TEXTURE_3D, dielectric);
+  glActiveTexture(GL_TEXTURE0);
+}
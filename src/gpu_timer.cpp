@@ -0,0 +1,41 @@
+#include "gpu_timer.h"
+
+GpuTimer::GpuTimer() { glGenQueries(kLatency * 2, &queries[0][0]); }
+
+GpuTimer::~GpuTimer() { glDeleteQueries(kLatency * 2, &queries[0][0]); }
+
+void GpuTimer::begin() {
+  // All slots in flight: drop the oldest result rather than stalling.
+  if (pending == kLatency) {
+    read_index = (read_index + 1) % kLatency;
+    pending -= 1;
+  }
+  glQueryCounter(queries[write_index][0], GL_TIMESTAMP);
+}
+
+void GpuTimer::end() {
+  glQueryCounter(queries[write_index][1], GL_TIMESTAMP);
+  write_index = (write_index + 1) % kLatency;
+  pending += 1;
+}
+
+bool GpuTimer::poll(float &elapsed_ms) {
+  if (pending == 0)
+    return false;
+
+  GLuint available = GL_FALSE;
+  glGetQueryObjectuiv(queries[read_index][1], GL_QUERY_RESULT_AVAILABLE,
+                      &available);
+  if (!available)
+    return false;
+
+  GLuint64 start = 0;
+  GLuint64 stop = 0;
+  glGetQueryObjectui64v(queries[read_index][0], GL_QUERY_RESULT, &start);
+  glGetQueryObjectui64v(queries[read_index][1], GL_QUERY_RESULT, &stop);
+  elapsed_ms = (float)((double)(stop - start) * 1e-6);
+
+  read_index = (read_index + 1) % kLatency;
+  pending -= 1;
+  return true;
+}
@@ -0,0 +1,574 @@
+#include "image_io.h"
+
+#include "packing.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+// Layout reference: "Technical Introduction to OpenEXR" / OpenEXR file
+// layout. Everything is little endian.
+
+static const uint32_t kExrMagic = 20000630;
+static const int kPixelHalf = 1;
+static const int kPixelFloat = 2;
+
+static void put_u32(std::string &out, uint32_t v) {
+  for (int i = 0; i < 4; ++i)
+    out.push_back((char)((v >> (8 * i)) & 0xff));
+}
+
+static void put_u64(std::string &out, uint64_t v) {
+  for (int i = 0; i < 8; ++i)
+    out.push_back((char)((v >> (8 * i)) & 0xff));
+}
+
+static void put_f32(std::string &out, float v) {
+  uint32_t bits;
+  memcpy(&bits, &v, 4);
+  put_u32(out, bits);
+}
+
+static void put_attribute(std::string &out, const char *name,
+                          const char *type, const std::string &value) {
+  out.append(name).push_back('\0');
+  out.append(type).push_back('\0');
+  put_u32(out, (uint32_t)value.size());
+  out.append(value);
+}
+
+bool write_exr(const std::string &path, const Image &image,
+               const ImageAttributes &attributes) {
+  std::string out;
+  put_u32(out, kExrMagic);
+  put_u32(out, 2); // version 2, single-part scanline
+
+  // Channels must be listed in alphabetical order.
+  std::string channels;
+  for (const char *name : {"B", "G", "R"}) {
+    channels.append(name).push_back('\0');
+    put_u32(channels, kPixelFloat);
+    put_u32(channels, 0); // pLinear + reserved
+    put_u32(channels, 1); // x sampling
+    put_u32(channels, 1); // y sampling
+  }
+  channels.push_back('\0');
+  put_attribute(out, "channels", "chlist", channels);
+  put_attribute(out, "compression", "compression", std::string(1, '\0'));
+
+  std::string window;
+  put_u32(window, 0);
+  put_u32(window, 0);
+  put_u32(window, (uint32_t)(image.width - 1));
+  put_u32(window, (uint32_t)(image.height - 1));
+  put_attribute(out, "dataWindow", "box2i", window);
+  put_attribute(out, "displayWindow", "box2i", window);
+  put_attribute(out, "lineOrder", "lineOrder", std::string(1, '\0'));
+
+  std::string value;
+  put_f32(value, 1.0f);
+  put_attribute(out, "pixelAspectRatio", "float", value);
+  value.clear();
+  put_f32(value, 0.0f);
+  put_f32(value, 0.0f);
+  put_attribute(out, "screenWindowCenter", "v2f", value);
+  value.clear();
+  put_f32(value, 1.0f);
+  put_attribute(out, "screenWindowWidth", "float", value);
+
+  for (const auto &attribute : attributes) {
+    value.clear();
+    put_f32(value, attribute.second);
+    put_attribute(out, attribute.first.c_str(), "float", value);
+  }
+  out.push_back('\0');
+
+  // One scanline per block: offset table, then (y, size, B row, G row, R row).
+  size_t row_bytes = (size_t)image.width * 3 * 4;
+  size_t block_bytes = 8 + row_bytes;
+  size_t table_start = out.size();
+  size_t data_start = table_start + (size_t)image.height * 8;
+  for (int y = 0; y < image.height; ++y)
+    put_u64(out, data_start + (size_t)y * block_bytes);
+
+  for (int y = 0; y < image.height; ++y) {
+    put_u32(out, (uint32_t)y);
+    put_u32(out, (uint32_t)row_bytes);
+    for (int c = 2; c >= 0; --c) {
+      for (int x = 0; x < image.width; ++x)
+        put_f32(out, image.at(x, y)[c]);
+    }
+  }
+
+  std::ofstream file(path, std::ios::binary);
+  if (!file.is_open()) {
+    std::cerr << "[Image] Failed to open " << path << " for writing"
+              << std::endl;
+    return false;
+  }
+  file.write(out.data(), (std::streamsize)out.size());
+  return file.good();
+}
+
+namespace {
+
+struct Reader {
+  const std::string &data;
+  size_t pos = 0;
+  bool ok = true;
+
+  explicit Reader(const std::string &data) : data(data) {}
+
+  bool need(size_t n) {
+    if (pos + n > data.size())
+      ok = false;
+    return ok;
+  }
+  uint32_t u32() {
+    if (!need(4))
+      return 0;
+    uint32_t v = 0;
+    for (int i = 0; i < 4; ++i)
+      v |= (uint32_t)(unsigned char)data[pos + i] << (8 * i);
+    pos += 4;
+    return v;
+  }
+  uint64_t u64() {
+    uint64_t lo = u32();
+    uint64_t hi = u32();
+    return lo | (hi << 32);
+  }
+  std::string cstr() {
+    size_t end = data.find('\0', pos);
+    if (end == std::string::npos) {
+      ok = false;
+      return "";
+    }
+    std::string s = data.substr(pos, end - pos);
+    pos = end + 1;
+    return s;
+  }
+};
+
+} // namespace
+
+bool read_exr(const std::string &path, Image &image,
+              ImageAttributes *attributes) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file.is_open()) {
+    std::cerr << "[Image] Failed to open " << path << std::endl;
+    return false;
+  }
+  std::string data((std::istreambuf_iterator<char>(file)),
+                   std::istreambuf_iterator<char>());
+
+  Reader in(data);
+  if (in.u32() != kExrMagic || (in.u32() & 0xff) != 2) {
+    std::cerr << "[Image] " << path << " is not an OpenEXR file" << std::endl;
+    return false;
+  }
+
+  struct Channel {
+    std::string name;
+    int type;
+  };
+  std::vector<Channel> channels;
+  int compression = -1;
+  int32_t window[4] = {0, 0, -1, -1};
+
+  while (in.ok) {
+    std::string name = in.cstr();
+    if (name.empty())
+      break;
+    std::string type = in.cstr();
+    uint32_t size = in.u32();
+    if (!in.need(size))
+      break;
+    size_t value_end = in.pos + size;
+
+    if (name == "channels") {
+      while (in.pos < value_end) {
+        std::string channel = in.cstr();
+        if (channel.empty())
+          break;
+        int pixel_type = (int)in.u32();
+        in.pos += 12; // pLinear, reserved, sampling
+        channels.push_back({channel, pixel_type});
+      }
+    } else if (name == "compression") {
+      compression = (unsigned char)data[in.pos];
+    } else if (name == "dataWindow") {
+      for (int i = 0; i < 4; ++i)
+        window[i] = (int32_t)in.u32();
+    } else if (attributes && type == "float" && size == 4) {
+      uint32_t bits = in.u32();
+      float value;
+      memcpy(&value, &bits, 4);
+      attributes->push_back({name, value});
+    }
+    in.pos = value_end;
+  }
+
+  if (!in.ok || compression != 0) {
+    std::cerr << "[Image] " << path
+              << ": only uncompressed scanline EXRs are supported" << std::endl;
+    return false;
+  }
+
+  image.width = window[2] - window[0] + 1;
+  image.height = window[3] - window[1] + 1;
+  if (image.width <= 0 || image.height <= 0) {
+    std::cerr << "[Image] " << path << ": empty data window" << std::endl;
+    return false;
+  }
+  image.pixels.assign((size_t)image.width * image.height * 3, 0.0f);
+
+  std::vector<uint64_t> offsets(image.height);
+  for (int y = 0; y < image.height; ++y)
+    offsets[y] = in.u64();
+
+  for (int row = 0; row < image.height && in.ok; ++row) {
+    in.pos = (size_t)offsets[row];
+    int y = (int32_t)in.u32() - window[1];
+    in.u32(); // data size
+    if (y < 0 || y >= image.height) {
+      in.ok = false;
+      break;
+    }
+
+    for (const Channel &channel : channels) {
+      int component = channel.name == "R"   ? 0
+                      : channel.name == "G" ? 1
+                      : channel.name == "B" ? 2
+                                            : -1;
+      int bytes = channel.type == kPixelHalf ? 2 : 4;
+      if (!in.need((size_t)bytes * image.width))
+        break;
+      for (int x = 0; x < image.width; ++x) {
+        float value = 0.0f;
+        if (channel.type == kPixelHalf) {
+          uint16_t h = (uint16_t)((unsigned char)data[in.pos] |
+                                  ((unsigned char)data[in.pos + 1] << 8));
+          value = half_to_float(h);
+        } else if (channel.type == kPixelFloat) {
+          uint32_t bits = (uint32_t)(unsigned char)data[in.pos] |
+                          (uint32_t)(unsigned char)data[in.pos + 1] << 8 |
+                          (uint32_t)(unsigned char)data[in.pos + 2] << 16 |
+                          (uint32_t)(unsigned char)data[in.pos + 3] << 24;
+          memcpy(&value, &bits, 4);
+        }
+        in.pos += bytes;
+        if (component >= 0)
+          image.at(x, y)[component] = value;
+      }
+    }
+  }
+
+  if (!in.ok) {
+    std::cerr << "[Image] " << path << ": truncated pixel data" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+// Radiance RGBE: a text header ending in a blank line, a resolution line,
+// then one scanline per row, flat or run-length encoded per component.
+bool read_hdr(const std::string &path, Image &image) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file.is_open()) {
+    std::cerr << "[Image] Failed to open " << path << std::endl;
+    return false;
+  }
+  std::string data((std::istreambuf_iterator<char>(file)),
+                   std::istreambuf_iterator<char>());
+
+  size_t pos = 0;
+  auto line = [&](std::string &out) {
+    size_t end = data.find('\n', pos);
+    if (end == std::string::npos)
+      return false;
+    out = data.substr(pos, end - pos);
+    pos = end + 1;
+    return true;
+  };
+
+  std::string text;
+  if (!line(text) || text.compare(0, 2, "#?") != 0) {
+    std::cerr << "[Image] " << path << " is not a Radiance HDR file"
+              << std::endl;
+    return false;
+  }
+  float exposure = 1.0f;
+  while (line(text) && !text.empty()) {
+    if (text.compare(0, 7, "FORMAT=") == 0 &&
+        text != "FORMAT=32-bit_rle_rgbe") {
+      std::cerr << "[Image] " << path << ": unsupported " << text
+                << std::endl;
+      return false;
+    }
+    if (text.compare(0, 9, "EXPOSURE=") == 0)
+      exposure *= (float)atof(text.c_str() + 9);
+  }
+
+  // Only the standard top-to-bottom, left-to-right orientation.
+  int width = 0, height = 0;
+  if (!line(text) ||
+      sscanf(text.c_str(), "-Y %d +X %d", &height, &width) != 2 ||
+      width <= 0 || height <= 0) {
+    std::cerr << "[Image] " << path << ": unsupported resolution line"
+              << std::endl;
+    return false;
+  }
+
+  image.width = width;
+  image.height = height;
+  image.pixels.assign((size_t)width * height * 3, 0.0f);
+
+  std::vector<unsigned char> row((size_t)width * 4);
+  const unsigned char *bytes = (const unsigned char *)data.data();
+  bool ok = true;
+  for (int y = 0; y < height && ok; ++y) {
+    bool rle = width >= 8 && width < 32768 && pos + 4 <= data.size() &&
+               bytes[pos] == 2 && bytes[pos + 1] == 2 &&
+               ((bytes[pos + 2] << 8) | bytes[pos + 3]) == width;
+    if (!rle) {
+      ok = pos + row.size() <= data.size();
+      if (ok)
+        memcpy(row.data(), bytes + pos, row.size());
+      pos += row.size();
+    } else {
+      pos += 4;
+      // Components are stored one after another, each as runs (count > 128
+      // repeats the next byte) and literals.
+      for (int c = 0; c < 4 && ok; ++c) {
+        int x = 0;
+        while (x < width && ok) {
+          if (pos >= data.size()) {
+            ok = false;
+            break;
+          }
+          int count = bytes[pos++];
+          bool run = count > 128;
+          if (run)
+            count -= 128;
+          ok = count > 0 && x + count <= width &&
+               pos + (run ? 1 : count) <= data.size();
+          for (int i = 0; ok && i < count; ++i)
+            row[(size_t)(x + i) * 4 + c] = bytes[run ? pos : pos + i];
+          pos += run ? 1 : count;
+          x += count;
+        }
+      }
+    }
+
+    for (int x = 0; x < width && ok; ++x) {
+      const unsigned char *rgbe = &row[(size_t)x * 4];
+      float *out = image.at(x, y);
+      if (rgbe[3] == 0)
+        continue;
+      float scale = std::ldexp(1.0f, (int)rgbe[3] - (128 + 8)) / exposure;
+      for (int c = 0; c < 3; ++c)
+        out[c] = ((float)rgbe[c] + 0.5f) * scale;
+    }
+  }
+
+  if (!ok) {
+    std::cerr << "[Image] " << path << ": truncated pixel data" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+static float srgb_to_linear(float c) {
+  return c <= 0.04045f ? c / 12.92f
+                       : std::pow((c + 0.055f) / 1.055f, 2.4f);
+}
+
+static bool read_file(const std::string &path, std::string &data) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file.is_open()) {
+    std::cerr << "[Image] Failed to open " << path << std::endl;
+    return false;
+  }
+  data.assign((std::istreambuf_iterator<char>(file)),
+              std::istreambuf_iterator<char>());
+  return true;
+}
+
+// Netpbm P6: "P6", width, height and maxval as whitespace-separated text
+// (with # comments), one whitespace byte, then RGB bytes top to bottom.
+bool read_ppm(const std::string &path, Image &image) {
+  std::string data;
+  if (!read_file(path, data))
+    return false;
+
+  size_t pos = 2;
+  auto next_number = [&](int &value) {
+    while (pos < data.size()) {
+      if (data[pos] == '#') {
+        while (pos < data.size() && data[pos] != '\n')
+          ++pos;
+      } else if (isspace((unsigned char)data[pos])) {
+        ++pos;
+      } else {
+        break;
+      }
+    }
+    if (pos >= data.size() || !isdigit((unsigned char)data[pos]))
+      return false;
+    value = 0;
+    while (pos < data.size() && isdigit((unsigned char)data[pos]))
+      value = value * 10 + (data[pos++] - '0');
+    return true;
+  };
+
+  int width = 0, height = 0, maxval = 0;
+  if (data.compare(0, 2, "P6") != 0 || !next_number(width) ||
+      !next_number(height) || !next_number(maxval) || width <= 0 ||
+      height <= 0 || maxval <= 0 || maxval > 255) {
+    std::cerr << "[Image] " << path << " is not a binary 8-bit PPM file"
+              << std::endl;
+    return false;
+  }
+  ++pos;
+
+  size_t count = (size_t)width * height * 3;
+  if (pos + count > data.size()) {
+    std::cerr << "[Image] " << path << ": truncated pixel data" << std::endl;
+    return false;
+  }
+  float table[256];
+  for (int i = 0; i <= maxval; ++i)
+    table[i] = srgb_to_linear((float)i / (float)maxval);
+
+  image.width = width;
+  image.height = height;
+  image.pixels.resize(count);
+  const unsigned char *bytes = (const unsigned char *)data.data() + pos;
+  for (size_t i = 0; i < count; ++i)
+    image.pixels[i] = table[std::min((int)bytes[i], maxval)];
+  return true;
+}
+
+// TGA: an 18-byte header, an optional image ID, then BGR(A) pixels, rows
+// bottom to top unless bit 5 of the descriptor is set. Image type 2 is flat,
+// 10 run-length encoded in packets that may cross rows.
+bool read_tga(const std::string &path, Image &image) {
+  std::string data;
+  if (!read_file(path, data))
+    return false;
+  const unsigned char *bytes = (const unsigned char *)data.data();
+  if (data.size() < 18) {
+    std::cerr << "[Image] " << path << " is not a TGA file" << std::endl;
+    return false;
+  }
+
+  int id_length = bytes[0];
+  int color_map = bytes[1];
+  int type = bytes[2];
+  int width = bytes[12] | (bytes[13] << 8);
+  int height = bytes[14] | (bytes[15] << 8);
+  int depth = bytes[16];
+  bool top_down = (bytes[17] & 0x20) != 0;
+  if (color_map != 0 || (type != 2 && type != 10) ||
+      (depth != 24 && depth != 32) || width <= 0 || height <= 0) {
+    std::cerr << "[Image] " << path
+              << ": only 24 or 32 bit truecolor TGA files are supported"
+              << std::endl;
+    return false;
+  }
+
+  size_t pos = 18 + id_length;
+  int stride = depth / 8;
+  size_t count = (size_t)width * height;
+  std::vector<unsigned char> pixels(count * 3);
+  bool ok = true;
+  if (type == 2) {
+    ok = pos + count * stride <= data.size();
+    for (size_t i = 0; ok && i < count; ++i)
+      memcpy(&pixels[i * 3], bytes + pos + i * stride, 3);
+  } else {
+    size_t i = 0;
+    while (i < count && ok) {
+      ok = pos < data.size();
+      if (!ok)
+        break;
+      int header = bytes[pos++];
+      size_t run = (size_t)(header & 0x7f) + 1;
+      bool repeat = (header & 0x80) != 0;
+      ok = i + run <= count &&
+           pos + (repeat ? 1 : run) * stride <= data.size();
+      for (size_t k = 0; ok && k < run; ++k)
+        memcpy(&pixels[(i + k) * 3], bytes + pos + (repeat ? 0 : k) * stride,
+               3);
+      pos += (repeat ? 1 : run) * stride;
+      i += run;
+    }
+  }
+  if (!ok) {
+    std::cerr << "[Image] " << path << ": truncated pixel data" << std::endl;
+    return false;
+  }
+
+  float table[256];
+  for (int i = 0; i < 256; ++i)
+    table[i] = srgb_to_linear((float)i / 255.0f);
+
+  image.width = width;
+  image.height = height;
+  image.pixels.resize(count * 3);
+  for (int y = 0; y < height; ++y) {
+    int row = top_down ? y : height - 1 - y;
+    for (int x = 0; x < width; ++x) {
+      const unsigned char *bgr = &pixels[((size_t)row * width + x) * 3];
+      float *out = image.at(x, y);
+      out[0] = table[bgr[2]];
+      out[1] = table[bgr[1]];
+      out[2] = table[bgr[0]];
+    }
+  }
+  return true;
+}
+
+bool read_image(const std::string &path, Image &image) {
+  std::string extension = std::filesystem::path(path).extension().string();
+  std::transform(extension.begin(), extension.end(), extension.begin(),
+                 [](unsigned char c) { return (char)tolower(c); });
+  if (extension == ".ppm")
+    return read_ppm(path, image);
+  if (extension == ".tga")
+    return read_tga(path, image);
+  if (extension == ".hdr")
+    return read_hdr(path, image);
+  if (extension == ".exr")
+    return read_exr(path, image);
+  std::cerr << "[Image] " << path
+            << ": expected a .ppm, .tga, .hdr or .exr file" << std::endl;
+  return false;
+}
+
+bool compare_images(const Image &a, const Image &b, ImageDiff &diff) {
+  if (a.width != b.width || a.height != b.height)
+    return false;
+
+  double sum_sq = 0.0;
+  float max_abs = 0.0f;
+  for (size_t i = 0; i < a.pixels.size(); ++i) {
+    float d = a.pixels[i] - b.pixels[i];
+    sum_sq += (double)d * d;
+    max_abs = std::fmax(max_abs, std::fabs(d));
+  }
+
+  double mse = a.pixels.empty() ? 0.0 : sum_sq / (double)a.pixels.size();
+  diff.rmse = (float)std::sqrt(mse);
+  diff.psnr_db = mse > 0.0 ? (float)(10.0 * std::log10(1.0 / mse)) : INFINITY;
+  diff.max_abs_error = max_abs;
+  return true;
+}
@@ -0,0 +1,263 @@
+#include "json.h"
+
+#include <cstdlib>
+#include <cstring>
+
+const JsonValue *JsonValue::find(const std::string &key) const {
+  if (type != Object)
+    return nullptr;
+  for (const auto &member : object) {
+    if (member.first == key)
+      return &member.second;
+  }
+  return nullptr;
+}
+
+namespace {
+
+class Parser {
+public:
+  explicit Parser(const std::string &text) : text(text) {}
+
+  bool parse(JsonValue &value, std::string &error) {
+    skip_whitespace();
+    if (!parse_value(value, 0)) {
+      error = location() + message;
+      return false;
+    }
+    skip_whitespace();
+    if (pos != text.size()) {
+      error = location() + "unexpected trailing characters";
+      return false;
+    }
+    return true;
+  }
+
+private:
+  const std::string &text;
+  size_t pos = 0;
+  std::string message;
+
+  static const int kMaxDepth = 64;
+
+  bool fail(const char *what) {
+    message = what;
+    return false;
+  }
+
+  std::string location() const {
+    int line = 1;
+    int column = 1;
+    for (size_t i = 0; i < pos && i < text.size(); ++i) {
+      if (text[i] == '\n') {
+        line += 1;
+        column = 1;
+      } else {
+        column += 1;
+      }
+    }
+    return std::to_string(line) + ":" + std::to_string(column) + ": ";
+  }
+
+  void skip_whitespace() {
+    while (pos < text.size() && (text[pos] == ' ' || text[pos] == '\t' ||
+                                 text[pos] == '\r' || text[pos] == '\n'))
+      pos += 1;
+  }
+
+  bool consume(const char *literal) {
+    size_t n = strlen(literal);
+    if (text.compare(pos, n, literal) != 0)
+      return false;
+    pos += n;
+    return true;
+  }
+
+  bool parse_value(JsonValue &value, int depth) {
+    if (depth > kMaxDepth)
+      return fail("nesting too deep");
+    if (pos >= text.size())
+      return fail("unexpected end of input");
+
+    char c = text[pos];
+    if (c == '{')
+      return parse_object(value, depth);
+    if (c == '[')
+      return parse_array(value, depth);
+    if (c == '"') {
+      value.type = JsonValue::String;
+      return parse_string(value.string);
+    }
+    if (c == '-' || (c >= '0' && c <= '9'))
+      return parse_number(value);
+    if (consume("true")) {
+      value.type = JsonValue::Bool;
+      value.boolean = true;
+      return true;
+    }
+    if (consume("false")) {
+      value.type = JsonValue::Bool;
+      value.boolean = false;
+      return true;
+    }
+    if (consume("null")) {
+      value.type = JsonValue::Null;
+      return true;
+    }
+    return fail("unexpected character");
+  }
+
+  bool parse_object(JsonValue &value, int depth) {
+    value.type = JsonValue::Object;
+    pos += 1; // '{'
+    skip_whitespace();
+    if (pos < text.size() && text[pos] == '}') {
+      pos += 1;
+      return true;
+    }
+
+    while (true) {
+      skip_whitespace();
+      if (pos >= text.size() || text[pos] != '"')
+        return fail("expected object key");
+      std::string key;
+      if (!parse_string(key))
+        return false;
+
+      skip_whitespace();
+      if (pos >= text.size() || text[pos] != ':')
+        return fail("expected ':'");
+      pos += 1;
+      skip_whitespace();
+
+      value.object.emplace_back(key, JsonValue());
+      if (!parse_value(value.object.back().second, depth + 1))
+        return false;
+
+      skip_whitespace();
+      if (pos < text.size() && text[pos] == ',') {
+        pos += 1;
+        continue;
+      }
+      if (pos < text.size() && text[pos] == '}') {
+        pos += 1;
+        return true;
+      }
+      return fail("expected ',' or '}'");
+    }
+  }
+
+  bool parse_array(JsonValue &value, int depth) {
+    value.type = JsonValue::Array;
+    pos += 1; // '['
+    skip_whitespace();
+    if (pos < text.size() && text[pos] == ']') {
+      pos += 1;
+      return true;
+    }
+
+    while (true) {
+      skip_whitespace();
+      value.array.emplace_back();
+      if (!parse_value(value.array.back(), depth + 1))
+        return false;
+
+      skip_whitespace();
+      if (pos < text.size() && text[pos] == ',') {
+        pos += 1;
+        continue;
+      }
+      if (pos < text.size() && text[pos] == ']') {
+        pos += 1;
+        return true;
+      }
+      return fail("expected ',' or ']'");
+    }
+  }
+
+  static void append_utf8(std::string &out, unsigned int cp) {
+    if (cp < 0x80) {
+      out.push_back((char)cp);
+    } else if (cp < 0x800) {
+      out.push_back((char)(0xc0 | (cp >> 6)));
+      out.push_back((char)(0x80 | (cp & 0x3f)));
+    } else {
+      out.push_back((char)(0xe0 | (cp >> 12)));
+      out.push_back((char)(0x80 | ((cp >> 6) & 0x3f)));
+      out.push_back((char)(0x80 | (cp & 0x3f)));
+    }
+  }
+
+  bool parse_string(std::string &out) {
+    pos += 1; // opening quote
+    while (pos < text.size()) {
+      char c = text[pos++];
+      if (c == '"')
+        return true;
+      if (c != '\\') {
+        out.push_back(c);
+        continue;
+      }
+      if (pos >= text.size())
+        break;
+      char e = text[pos++];
+      switch (e) {
+      case '"':
+      case '\\':
+      case '/':
+        out.push_back(e);
+        break;
+      case 'b':
+        out.push_back('\b');
+        break;
+      case 'f':
+        out.push_back('\f');
+        break;
+      case 'n':
+        out.push_back('\n');
+        break;
+      case 'r':
+        out.push_back('\r');
+        break;
+      case 't':
+        out.push_back('\t');
+        break;
+      case 'u': {
+        if (pos + 4 > text.size())
+          return fail("truncated \\u escape");
+        char *end = nullptr;
+        std::string hex = text.substr(pos, 4);
+        unsigned long cp = strtoul(hex.c_str(), &end, 16);
+        if (end != hex.c_str() + 4)
+          return fail("invalid \\u escape");
+        append_utf8(out, (unsigned int)cp);
+        pos += 4;
+        break;
+      }
+      default:
+        return fail("invalid escape sequence");
+      }
+    }
+    return fail("unterminated string");
+  }
+
+  bool parse_number(JsonValue &value) {
+    const char *start = text.c_str() + pos;
+    char *end = nullptr;
+    value.number = strtod(start, &end);
+    if (end == start)
+      return fail("invalid number");
+    value.type = JsonValue::Number;
+    pos += (size_t)(end - start);
+    return true;
+  }
+};
+
+} // namespace
+
+bool parse_json(const std::string &text, JsonValue &value,
+                std::string &error) {
+  Parser parser(text);
+  value = JsonValue();
+  return parser.parse(value, error);
+}
@@ -1,7 +1,51 @@
 #include "application.h"
 
-int main() {
-  Application app = Application();
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+int main(int argc, char **argv) {
+  AppOptions options;
+
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "--scene") == 0 && i + 1 < argc) {
+      options.scene_path = argv[++i];
+    } else if (strcmp(argv[i], "--telemetry") == 0 && i + 1 < argc) {
+      options.telemetry_path = argv[++i];
+    } else if (strcmp(argv[i], "--benchmark") == 0 && i + 1 < argc) {
+      options.benchmark_script = argv[++i];
+    } else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+      options.record_path = argv[++i];
+    } else if (strcmp(argv[i], "--save-image") == 0 && i + 1 < argc) {
+      options.save_image_path = argv[++i];
+    } else if (strcmp(argv[i], "--compare") == 0 && i + 1 < argc) {
+      options.compare_image_path = argv[++i];
+    } else if (strcmp(argv[i], "--rmse-threshold") == 0 && i + 1 < argc) {
+      options.rmse_threshold = (float)atof(argv[++i]);
+    } else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+      options.trace_path = argv[++i];
+    } else if (strcmp(argv[i], "--headless") == 0) {
+      options.headless = true;
+    } else {
+      fprintf(stderr,
+              "Usage: %s [--scene <json>] [--telemetry <path prefix>]\n"
+              "          [--benchmark <script>]\n"
+              "          [--record <script>] [--trace <json>] [--headless]\n"
+              "          [--save-image <exr>] [--compare <exr>]\n"
+              "          [--rmse-threshold <value>]\n",
+              argv[0]);
+      return 1;
+    }
+  }
+
+  bool wants_image =
+      !options.save_image_path.empty() || !options.compare_image_path.empty();
+  if (wants_image && options.benchmark_script.empty()) {
+    fprintf(stderr, "--save-image and --compare need --benchmark <script>\n");
+    return 1;
+  }
+
+  Application app = Application(options);
   app.run();
   return 0;
 }
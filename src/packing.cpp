@@ -0,0 +1,106 @@
+#include "packing.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+// Follows the RGB9_E5 conversion in the OpenGL specification (section
+// 8.5.2, "Encoding of Special Internal Formats").
+uint32_t pack_rgb9e5(const float rgb[3]) {
+  const int kMantissaBits = 9;
+  const int kBias = 15;
+  const int kMaxExponent = 31;
+  const float kMaxValue = (float)((1 << kMantissaBits) - 1) /
+                          (float)(1 << kMantissaBits) *
+                          (float)(1 << (kMaxExponent - kBias));
+
+  float c[3];
+  for (int i = 0; i < 3; ++i) {
+    // NaN fails both comparisons and ends up as zero.
+    c[i] = rgb[i] > 0.0f ? std::min(rgb[i], kMaxValue) : 0.0f;
+  }
+  float max_c = std::max(c[0], std::max(c[1], c[2]));
+
+  int floor_log2 = max_c > 0.0f ? (int)std::floor(std::log2(max_c)) : 0;
+  int exponent = std::max(-kBias - 1, floor_log2) + 1 + kBias;
+  float scale = std::ldexp(1.0f, exponent - kBias - kMantissaBits);
+  if ((int)std::floor(max_c / scale + 0.5f) == (1 << kMantissaBits)) {
+    ++exponent;
+    scale *= 2.0f;
+  }
+
+  uint32_t packed = (uint32_t)exponent << 27;
+  for (int i = 0; i < 3; ++i) {
+    uint32_t mantissa = (uint32_t)std::floor(c[i] / scale + 0.5f);
+    packed |= std::min(mantissa, 511u) << (kMantissaBits * i);
+  }
+  return packed;
+}
+
+void unpack_rgb9e5(uint32_t packed, float rgb[3]) {
+  float scale = std::ldexp(1.0f, (int)(packed >> 27) - 15 - 9);
+  for (int i = 0; i < 3; ++i)
+    rgb[i] = (float)((packed >> (9 * i)) & 0x1ff) * scale;
+}
+
+uint16_t float_to_half(float value) {
+  uint32_t bits;
+  memcpy(&bits, &value, 4);
+  uint16_t sign = (uint16_t)((bits >> 16) & 0x8000);
+  uint32_t exponent = (bits >> 23) & 0xff;
+  uint32_t mantissa = bits & 0x7fffff;
+
+  if (exponent == 0xff)
+    return sign | 0x7c00 | (mantissa ? 0x200 : 0);
+  int e = (int)exponent - 127 + 15;
+  if (e >= 31)
+    return sign | 0x7c00;
+  if (e <= 0) {
+    // Subnormal: shift the full significand into place, rounding to even.
+    if (e < -10)
+      return sign;
+    mantissa |= 0x800000;
+    int shift = 14 - e;
+    uint32_t half = mantissa >> shift;
+    uint32_t rest = mantissa & ((1u << shift) - 1);
+    uint32_t midpoint = 1u << (shift - 1);
+    if (rest > midpoint || (rest == midpoint && (half & 1)))
+      ++half;
+    return sign | (uint16_t)half;
+  }
+  // A carry out of the mantissa correctly bumps the exponent.
+  uint32_t half = ((uint32_t)e << 10) | (mantissa >> 13);
+  uint32_t rest = mantissa & 0x1fff;
+  if (rest > 0x1000 || (rest == 0x1000 && (half & 1)))
+    ++half;
+  return sign | (uint16_t)half;
+}
+
+float half_to_float(uint16_t h) {
+  uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+  uint32_t exponent = (h >> 10) & 0x1f;
+  uint32_t mantissa = h & 0x3ff;
+  float value;
+  if (exponent == 0) {
+    value = std::ldexp((float)mantissa, -24);
+  } else if (exponent == 31) {
+    value = mantissa ? NAN : INFINITY;
+  } else {
+    value = std::ldexp((float)(mantissa | 0x400), (int)exponent - 25);
+  }
+  uint32_t bits;
+  memcpy(&bits, &value, 4);
+  bits |= sign;
+  memcpy(&value, &bits, 4);
+  return value;
+}
+
+uint32_t pack_unorm4x8(const float v[4]) {
+  uint32_t packed = 0;
+  for (int i = 0; i < 4; ++i) {
+    // NaN fails both comparisons and ends up as zero.
+    float c = v[i] > 0.0f ? std::min(v[i], 1.0f) : 0.0f;
+    packed |= (uint32_t)std::lround(c * 255.0f) << (8 * i);
+  }
+  return packed;
+}
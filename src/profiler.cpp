@@ -0,0 +1,147 @@
+#include "profiler.h"
+
+#define GLFW_INCLUDE_NONE
+#include <GLFW/glfw3.h>
+
+#include <stdio.h>
+#include <string.h>
+
+// Plenty for a frame's worth of spans several frames deep.
+static const int kQueryPoolSize = 256;
+
+// Bounds memory when recording for a long time (~40 MB).
+static const size_t kMaxEvents = 1 << 20;
+
+Profiler::Profiler() {
+  free_queries.resize(kQueryPoolSize);
+  glGenQueries(kQueryPoolSize, free_queries.data());
+  calibrate();
+}
+
+Profiler::~Profiler() {
+  for (const GpuSpan &span : pending)
+    glDeleteQueries(2, span.queries);
+  glDeleteQueries((GLsizei)free_queries.size(), free_queries.data());
+}
+
+double Profiler::now_us() const { return glfwGetTime() * 1e6; }
+
+void Profiler::calibrate() {
+  GLint64 gpu_now = 0;
+  glGetInteger64v(GL_TIMESTAMP, &gpu_now);
+  gpu_reference_ns = gpu_now;
+  cpu_reference_us = now_us();
+  last_calibration_us = cpu_reference_us;
+}
+
+void Profiler::add_cpu_span(const char *name, double start_us,
+                            double end_us) {
+  if (recording && events.size() < kMaxEvents)
+    events.push_back({name, start_us, end_us - start_us, 0});
+}
+
+int Profiler::gpu_begin(const char *name) {
+  if (free_queries.size() < 2)
+    return -1;
+
+  GpuSpan span;
+  span.name = name;
+  span.queries[0] = free_queries.back();
+  free_queries.pop_back();
+  span.queries[1] = free_queries.back();
+  free_queries.pop_back();
+  span.ended = false;
+
+  glQueryCounter(span.queries[0], GL_TIMESTAMP);
+  pending.push_back(span);
+  return (int)pending.size() - 1;
+}
+
+void Profiler::gpu_end(int span) {
+  if (span < 0)
+    return;
+  glQueryCounter(pending[span].queries[1], GL_TIMESTAMP);
+  pending[span].ended = true;
+}
+
+void Profiler::end_frame() {
+  // Spans finish in submission order, so stop at the first unfinished one.
+  size_t resolved = 0;
+  for (; resolved < pending.size(); ++resolved) {
+    GpuSpan &span = pending[resolved];
+    if (!span.ended)
+      break;
+
+    GLuint available = GL_FALSE;
+    glGetQueryObjectuiv(span.queries[1], GL_QUERY_RESULT_AVAILABLE,
+                        &available);
+    if (!available)
+      break;
+
+    GLuint64 start = 0;
+    GLuint64 stop = 0;
+    glGetQueryObjectui64v(span.queries[0], GL_QUERY_RESULT, &start);
+    glGetQueryObjectui64v(span.queries[1], GL_QUERY_RESULT, &stop);
+
+    float ms = (float)((double)(stop - start) * 1e-6);
+    bool found = false;
+    for (LastGpu &last : last_gpu) {
+      if (last.name == span.name) {
+        last.ms = ms;
+        found = true;
+      }
+    }
+    if (!found)
+      last_gpu.push_back({span.name, ms});
+
+    if (recording && events.size() < kMaxEvents) {
+      double start_us =
+          cpu_reference_us +
+          (double)((int64_t)start - gpu_reference_ns) * 1e-3;
+      events.push_back({span.name, start_us, (double)(stop - start) * 1e-3, 1});
+    }
+
+    free_queries.push_back(span.queries[0]);
+    free_queries.push_back(span.queries[1]);
+  }
+  pending.erase(pending.begin(), pending.begin() + resolved);
+
+  // The two clocks drift apart slowly; re-anchor once a second.
+  if (now_us() - last_calibration_us > 1e6)
+    calibrate();
+}
+
+float Profiler::last_gpu_ms(const char *name) const {
+  for (const LastGpu &last : last_gpu) {
+    if (last.name == name || strcmp(last.name, name) == 0)
+      return last.ms;
+  }
+  return 0.0f;
+}
+
+bool Profiler::write_chrome_trace(const std::string &path) const {
+  FILE *file = fopen(path.c_str(), "w");
+  if (!file) {
+    fprintf(stderr, "[Profiler] Failed to open %s\n", path.c_str());
+    return false;
+  }
+
+  fprintf(file, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+  fprintf(file, "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 1, "
+                "\"args\": {\"name\": \"raytracer\"}},\n");
+  fprintf(file, "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, "
+                "\"tid\": 1, \"args\": {\"name\": \"CPU\"}},\n");
+  fprintf(file, "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, "
+                "\"tid\": 2, \"args\": {\"name\": \"GPU\"}}");
+  for (const Event &event : events) {
+    fprintf(file,
+            ",\n{\"name\": \"%s\", \"cat\": \"%s\", \"ph\": \"X\", "
+            "\"ts\": %.3f, \"dur\": %.3f, \"pid\": 1, \"tid\": %d}",
+            event.name, event.track == 0 ? "cpu" : "gpu", event.start_us,
+            event.duration_us, event.track + 1);
+  }
+  fprintf(file, "\n]}\n");
+
+  fclose(file);
+  return true;
+}
@@ -0,0 +1,71 @@
+#include "render_target.h"
+
+#include "gl_debug.h"
+
+#include <cstdio>
+
+RenderTarget::RenderTarget(const std::vector<GLenum> &formats, bool linear,
+                           bool layered)
+    : textures(formats.size(), 0), formats(formats), layered(layered) {
+  GLint filter = linear ? GL_LINEAR : GL_NEAREST;
+  GL_CALL(glGenTextures((GLsizei)textures.size(), textures.data()));
+  for (GLuint texture : textures) {
+    GL_CALL(glBindTexture(target(), texture));
+    GL_CALL(glTexParameteri(target(), GL_TEXTURE_MIN_FILTER, filter));
+    GL_CALL(glTexParameteri(target(), GL_TEXTURE_MAG_FILTER, filter));
+    GL_CALL(glTexParameteri(target(), GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
+    GL_CALL(glTexParameteri(target(), GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
+  }
+  GL_CALL(glGenFramebuffers(1, &framebuffer));
+}
+
+RenderTarget::~RenderTarget() {
+  glDeleteFramebuffers(1, &framebuffer);
+  glDeleteTextures((GLsizei)textures.size(), textures.data());
+}
+
+void RenderTarget::resize(int width, int height, int layers) {
+  target_width = width;
+  target_height = height;
+  target_layers = layered ? layers : 1;
+
+  GL_CALL(glBindFramebuffer(GL_FRAMEBUFFER, framebuffer));
+  for (size_t i = 0; i < textures.size(); ++i) {
+    GLenum attachment = GL_COLOR_ATTACHMENT0 + (GLenum)i;
+    GL_CALL(glBindTexture(target(), textures[i]));
+    if (layered) {
+      GL_CALL(glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, formats[i], width, height,
+                           target_layers, 0, GL_RGBA, GL_FLOAT, nullptr));
+      GL_CALL(glFramebufferTextureLayer(GL_FRAMEBUFFER, attachment,
+                                        textures[i], 0, 0));
+    } else {
+      GL_CALL(glTexImage2D(GL_TEXTURE_2D, 0, formats[i], width, height, 0,
+                           GL_RGBA, GL_FLOAT, nullptr));
+      GL_CALL(glFramebufferTexture2D(GL_FRAMEBUFFER, attachment,
+                                     GL_TEXTURE_2D, textures[i], 0));
+    }
+  }
+
+  GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+  if (status != GL_FRAMEBUFFER_COMPLETE) {
+    fprintf(stderr, "[RenderTarget] Framebuffer incomplete: 0x%x\n", status);
+  }
+  GL_CALL(glBindFramebuffer(GL_FRAMEBUFFER, 0));
+}
+
+void RenderTarget::bind(int layer) const {
+  static const GLenum draw_buffers[] = {
+      GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2,
+      GL_COLOR_ATTACHMENT3, GL_COLOR_ATTACHMENT4, GL_COLOR_ATTACHMENT5,
+      GL_COLOR_ATTACHMENT6, GL_COLOR_ATTACHMENT7};
+  glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+  if (layered) {
+    for (size_t i = 0; i < textures.size(); ++i) {
+      glFramebufferTextureLayer(GL_FRAMEBUFFER,
+                                GL_COLOR_ATTACHMENT0 + (GLenum)i, textures[i],
+                                0, layer);
+    }
+  }
+  glDrawBuffers((GLsizei)textures.size(), draw_buffers);
+  glViewport(0, 0, target_width, target_height);
+}
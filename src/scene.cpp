@@ -0,0 +1,1161 @@
+#include "scene.h"
+
+#include "alias_table.h"
+#include "json.h"
+#include "packing.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <sstream>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+Camera SceneSettings::camera() const {
+  Camera camera;
+  for (int i = 0; i < 3; ++i)
+    camera.position[i] = camera_position[i];
+  camera.yaw = camera_yaw;
+  camera.pitch = camera_pitch;
+  camera.fov = camera_fov;
+  update_camera_direction(camera);
+  return camera;
+}
+
+// JSON scene files
+
+static bool read_text(const std::string &path, std::string &text) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    fprintf(stderr, "[Scene] Failed to open %s\n", path.c_str());
+    return false;
+  }
+  std::stringstream stream;
+  stream << file.rdbuf();
+  text = stream.str();
+  return true;
+}
+
+static bool read_float(const JsonValue *value, float &out) {
+  if (!value)
+    return true;
+  if (!value->is_number())
+    return false;
+  out = (float)value->number;
+  return true;
+}
+
+static bool read_vec3(const JsonValue *value, float out[3]) {
+  if (!value)
+    return true;
+  if (!value->is_array() || value->array.size() != 3)
+    return false;
+  for (int i = 0; i < 3; ++i) {
+    if (!value->array[i].is_number())
+      return false;
+    out[i] = (float)value->array[i].number;
+  }
+  return true;
+}
+
+namespace {
+
+struct SceneParser {
+  std::string path;
+  std::filesystem::path directory;
+  SceneDescription &scene;
+  std::map<std::string, int> material_ids;
+  std::map<std::string, int> texture_ids;
+
+  SceneParser(const std::string &path, SceneDescription &scene)
+      : path(path), directory(std::filesystem::path(path).parent_path()),
+        scene(scene) {}
+
+  bool error(const std::string &what) {
+    fprintf(stderr, "[Scene] %s: %s\n", path.c_str(), what.c_str());
+    return false;
+  }
+
+  bool parse(const JsonValue &root) {
+    if (!root.is_object())
+      return error("top level must be an object");
+
+    SceneSettings &s = scene.settings;
+    if (const JsonValue *camera = root.find("camera")) {
+      if (!read_vec3(camera->find("position"), s.camera_position) ||
+          !read_float(camera->find("yaw"), s.camera_yaw) ||
+          !read_float(camera->find("pitch"), s.camera_pitch) ||
+          !read_float(camera->find("fov"), s.camera_fov))
+        return error("invalid camera");
+    }
+    if (const JsonValue *sun = root.find("sun")) {
+      if (!read_vec3(sun->find("direction"), s.sun_direction) ||
+          !read_vec3(sun->find("color"), s.sun_color) ||
+          !read_float(sun->find("intensity"), s.sun_intensity))
+        return error("invalid sun");
+      if (const JsonValue *radius = sun->find("angular_radius")) {
+        if (!read_float(radius, s.sun_angular_radius) ||
+            s.sun_angular_radius < 0.0f)
+          return error("invalid sun angular_radius");
+      }
+    }
+    if (const JsonValue *sky = root.find("sky")) {
+      if (!read_vec3(sky->find("color"), s.sky_color) ||
+          !read_float(sky->find("intensity"), s.sky_intensity))
+        return error("invalid sky");
+      if (const JsonValue *map = sky->find("map")) {
+        if (!map->is_string())
+          return error("sky \"map\" must be a path");
+        std::string resolved = (directory / map->string).string();
+        if (resolved.size() >= sizeof(s.sky_map))
+          return error("sky map path is too long");
+        memcpy(s.sky_map, resolved.c_str(), resolved.size() + 1);
+        if (!sky->find("intensity"))
+          s.sky_intensity = 1.0f;
+      }
+    }
+
+    if (const JsonValue *materials = root.find("materials")) {
+      if (!materials->is_object())
+        return error("\"materials\" must be an object");
+      for (const auto &entry : materials->object) {
+        if (!parse_material(entry.first, entry.second))
+          return false;
+      }
+    }
+
+    if (const JsonValue *planes = root.find("planes")) {
+      if (!planes->is_array())
+        return error("\"planes\" must be an array");
+      for (const JsonValue &value : planes->array) {
+        ScenePlane plane;
+        if (!read_vec3(value.find("point"), plane.point) ||
+            !read_vec3(value.find("normal"), plane.normal))
+          return error("invalid plane");
+        if (!material_of(value, plane.material))
+          return false;
+        scene.planes.push_back(plane);
+      }
+    }
+
+    // Loose top-level primitives become one object instanced at the origin.
+    SceneGeometry world;
+    if (!parse_geometry(root, world))
+      return false;
+    if (!world.spheres.empty() || !world.triangles.empty()) {
+      SceneInstance instance;
+      instance.geometry = (int)scene.geometries.size();
+      scene.geometries.push_back(world);
+      scene.instances.push_back(instance);
+    }
+
+    std::map<std::string, int> geometry_ids;
+    if (const JsonValue *objects = root.find("objects")) {
+      if (!objects->is_object())
+        return error("\"objects\" must be an object");
+      for (const auto &entry : objects->object) {
+        SceneGeometry geometry;
+        geometry.name = entry.first;
+        if (!entry.second.is_object())
+          return error("invalid object '" + entry.first + "'");
+        if (!parse_geometry(entry.second, geometry))
+          return false;
+        geometry_ids[entry.first] = (int)scene.geometries.size();
+        scene.geometries.push_back(geometry);
+      }
+    }
+
+    if (const JsonValue *instances = root.find("instances")) {
+      if (!instances->is_array())
+        return error("\"instances\" must be an array");
+      for (const JsonValue &value : instances->array) {
+        const JsonValue *object = value.find("object");
+        if (!object || !object->is_string())
+          return error("instance needs an \"object\" name");
+        auto it = geometry_ids.find(object->string);
+        if (it == geometry_ids.end())
+          return error("unknown object '" + object->string + "'");
+
+        SceneInstance instance;
+        instance.geometry = it->second;
+        if (!parse_transform(value, instance.transform))
+          return error("invalid instance transform");
+        if (value.find("material") &&
+            !material_of(value, instance.material))
+          return false;
+        scene.instances.push_back(instance);
+      }
+    }
+    return true;
+  }
+
+  bool parse_geometry(const JsonValue &value, SceneGeometry &geometry) {
+    if (const JsonValue *spheres = value.find("spheres")) {
+      if (!spheres->is_array())
+        return error("\"spheres\" must be an array");
+      for (const JsonValue &entry : spheres->array) {
+        SceneSphere sphere;
+        if (!read_vec3(entry.find("center"), sphere.center) ||
+            !read_float(entry.find("radius"), sphere.radius))
+          return error("invalid sphere");
+        if (!material_of(entry, sphere.material))
+          return false;
+        geometry.spheres.push_back(sphere);
+      }
+    }
+
+    if (const JsonValue *meshes = value.find("meshes")) {
+      if (!meshes->is_array())
+        return error("\"meshes\" must be an array");
+      for (const JsonValue &entry : meshes->array) {
+        if (!parse_mesh(entry, geometry))
+          return false;
+      }
+    }
+    return true;
+  }
+
+  // Either a row-major 3x4 "transform" or T * Rz * Ry * Rx * S.
+  bool parse_transform(const JsonValue &value, float m[12]) {
+    if (const JsonValue *transform = value.find("transform")) {
+      if (!transform->is_array() || transform->array.size() != 12)
+        return false;
+      for (int i = 0; i < 12; ++i) {
+        if (!transform->array[i].is_number())
+          return false;
+        m[i] = (float)transform->array[i].number;
+      }
+      return true;
+    }
+
+    float translate[3] = {0.0f, 0.0f, 0.0f};
+    float rotate[3] = {0.0f, 0.0f, 0.0f};
+    float scale[3] = {1.0f, 1.0f, 1.0f};
+    const JsonValue *scale_value = value.find("scale");
+    if (scale_value && scale_value->is_number()) {
+      scale[0] = scale[1] = scale[2] = (float)scale_value->number;
+    } else if (!read_vec3(scale_value, scale)) {
+      return false;
+    }
+    if (!read_vec3(value.find("translate"), translate) ||
+        !read_vec3(value.find("rotate"), rotate))
+      return false;
+
+    const float to_radians = 3.14159265f / 180.0f;
+    float cx = cosf(rotate[0] * to_radians), sx = sinf(rotate[0] * to_radians);
+    float cy = cosf(rotate[1] * to_radians), sy = sinf(rotate[1] * to_radians);
+    float cz = cosf(rotate[2] * to_radians), sz = sinf(rotate[2] * to_radians);
+    float r[9] = {cz * cy, cz * sy * sx - sz * cx, cz * sy * cx + sz * sx,
+                  sz * cy, sz * sy * sx + cz * cx, sz * sy * cx - cz * sx,
+                  -sy,     cy * sx,                cy * cx};
+    for (int row = 0; row < 3; ++row) {
+      for (int col = 0; col < 3; ++col)
+        m[row * 4 + col] = r[row * 3 + col] * scale[col];
+      m[row * 4 + 3] = translate[row];
+    }
+    return true;
+  }
+
+  bool parse_material(const std::string &name, const JsonValue &value) {
+    SceneMaterial material;
+    if (const JsonValue *type = value.find("type")) {
+      if (!type->is_string())
+        return error("material '" + name + "' has an invalid type");
+      if (type->string == "lambert") {
+        material.type = kMaterialLambert;
+      } else if (type->string == "metal") {
+        material.type = kMaterialMetal;
+      } else if (type->string == "dielectric") {
+        material.type = kMaterialDielectric;
+      } else {
+        return error("material '" + name + "' has unknown type '" +
+                     type->string + "'");
+      }
+    }
+    if (!read_vec3(value.find("albedo"), material.albedo) ||
+        !read_float(value.find("roughness"), material.roughness) ||
+        !read_float(value.find("ior"), material.ior) ||
+        !read_vec3(value.find("emission"), material.emission) ||
+        !read_float(value.find("texture_scale"), material.texture_scale))
+      return error("invalid material '" + name + "'");
+    if (const JsonValue *texture = value.find("albedo_texture")) {
+      if (!texture->is_string())
+        return error("material '" + name + "' texture must be a path");
+      std::string resolved = (directory / texture->string).string();
+      if (resolved.size() >= kTexturePathTexels * 16)
+        return error("texture path is too long: " + resolved);
+      auto it = texture_ids.find(resolved);
+      if (it == texture_ids.end() && scene.textures.size() >= 0xffff)
+        return error("too many textures");
+      if (it == texture_ids.end()) {
+        it = texture_ids.emplace(resolved, (int)scene.textures.size()).first;
+        scene.textures.push_back(resolved);
+      }
+      material.albedo_texture = it->second;
+    }
+
+    material_ids[name] = (int)scene.materials.size();
+    scene.materials.push_back(material);
+    return true;
+  }
+
+  // Objects without a material share a white lambert default.
+  bool material_of(const JsonValue &object, int &id) {
+    const JsonValue *name = object.find("material");
+    if (!name) {
+      auto it = material_ids.find("");
+      if (it == material_ids.end()) {
+        material_ids[""] = (int)scene.materials.size();
+        scene.materials.push_back(SceneMaterial());
+      }
+      id = material_ids[""];
+      return true;
+    }
+    if (!name->is_string())
+      return error("\"material\" must be a material name");
+    auto it = material_ids.find(name->string);
+    if (it == material_ids.end())
+      return error("unknown material '" + name->string + "'");
+    id = it->second;
+    return true;
+  }
+
+  // Texture coordinates are indexed separately from positions, as in .obj
+  // files; uv_indices is empty when a mesh has none.
+  bool parse_mesh(const JsonValue &value, SceneGeometry &geometry) {
+    std::vector<float> positions;
+    std::vector<int> indices;
+    std::vector<float> uvs;
+    std::vector<int> uv_indices;
+
+    if (const JsonValue *obj = value.find("obj")) {
+      if (!obj->is_string())
+        return error("mesh \"obj\" must be a path");
+      std::string file = (directory / obj->string).string();
+      if (file.size() >= kTexturePathTexels * 16)
+        return error("mesh path is too long: " + file);
+      if (!load_obj(file, positions, indices, uvs, uv_indices))
+        return false;
+      std::vector<std::string> &meshes = scene.meshes;
+      if (std::find(meshes.begin(), meshes.end(), file) == meshes.end())
+        meshes.push_back(file);
+    } else {
+      const JsonValue *vertices = value.find("vertices");
+      const JsonValue *faces = value.find("indices");
+      if (!vertices || !vertices->is_array() || !faces || !faces->is_array())
+        return error("mesh needs \"obj\" or \"vertices\" and \"indices\"");
+      for (const JsonValue &vertex : vertices->array) {
+        float p[3];
+        if (!read_vec3(&vertex, p))
+          return error("invalid mesh vertex");
+        positions.insert(positions.end(), p, p + 3);
+      }
+      for (const JsonValue &index : faces->array) {
+        if (!index.is_number())
+          return error("invalid mesh index");
+        indices.push_back((int)index.number);
+      }
+      if (const JsonValue *uv_values = value.find("uvs")) {
+        if (!uv_values->is_array() ||
+            uv_values->array.size() != vertices->array.size())
+          return error("mesh needs one \"uvs\" entry per vertex");
+        for (const JsonValue &uv : uv_values->array) {
+          if (!uv.is_array() || uv.array.size() != 2 ||
+              !uv.array[0].is_number() || !uv.array[1].is_number())
+            return error("invalid mesh uv");
+          uvs.push_back((float)uv.array[0].number);
+          uvs.push_back((float)uv.array[1].number);
+        }
+        uv_indices = indices;
+      }
+    }
+
+    float translate[3] = {0.0f, 0.0f, 0.0f};
+    float scale = 1.0f;
+    if (!read_vec3(value.find("translate"), translate) ||
+        !read_float(value.find("scale"), scale))
+      return error("invalid mesh transform");
+    int material = 0;
+    if (!material_of(value, material))
+      return false;
+
+    if (indices.size() % 3 != 0)
+      return error("mesh index count is not a multiple of 3");
+    int vertex_count = (int)positions.size() / 3;
+    int uv_count = (int)uvs.size() / 2;
+    for (size_t i = 0; i < indices.size(); i += 3) {
+      SceneTriangle triangle;
+      float *corners[3] = {triangle.v0, triangle.v1, triangle.v2};
+      float *corner_uvs[3] = {triangle.uv0, triangle.uv1, triangle.uv2};
+      for (int c = 0; c < 3; ++c) {
+        int index = indices[i + c];
+        if (index < 0 || index >= vertex_count)
+          return error("mesh index out of range");
+        for (int k = 0; k < 3; ++k)
+          corners[c][k] = positions[index * 3 + k] * scale + translate[k];
+        if (uv_indices.empty())
+          continue;
+        int uv = uv_indices[i + c];
+        if (uv < 0)
+          continue;
+        if (uv >= uv_count)
+          return error("mesh uv index out of range");
+        corner_uvs[c][0] = uvs[uv * 2];
+        corner_uvs[c][1] = uvs[uv * 2 + 1];
+      }
+      triangle.material = material;
+      geometry.triangles.push_back(triangle);
+    }
+    return true;
+  }
+
+  bool load_obj(const std::string &obj_path, std::vector<float> &positions,
+                std::vector<int> &indices, std::vector<float> &uvs,
+                std::vector<int> &uv_indices) {
+    std::ifstream file(obj_path);
+    if (!file)
+      return error("failed to open " + obj_path);
+
+    std::string line;
+    while (std::getline(file, line)) {
+      std::istringstream stream(line);
+      std::string tag;
+      stream >> tag;
+      if (tag == "v") {
+        float p[3];
+        if (!(stream >> p[0] >> p[1] >> p[2]))
+          return error("bad vertex in " + obj_path);
+        positions.insert(positions.end(), p, p + 3);
+      } else if (tag == "vt") {
+        float uv[2];
+        if (!(stream >> uv[0] >> uv[1]))
+          return error("bad texture coordinate in " + obj_path);
+        uvs.insert(uvs.end(), uv, uv + 2);
+      } else if (tag == "f") {
+        // "f 1 2 3", "f 1/1/1 2/2/2 3/3/3", negative indices are relative.
+        // Corners without a texture coordinate get -1.
+        std::vector<int> face;
+        std::vector<int> face_uvs;
+        std::string corner;
+        while (stream >> corner) {
+          int index = atoi(corner.c_str());
+          if (index < 0)
+            index += (int)positions.size() / 3 + 1;
+          face.push_back(index - 1);
+
+          int uv = 0;
+          size_t slash = corner.find('/');
+          if (slash != std::string::npos)
+            uv = atoi(corner.c_str() + slash + 1);
+          if (uv < 0)
+            uv += (int)uvs.size() / 2 + 1;
+          face_uvs.push_back(uv - 1);
+        }
+        for (size_t i = 2; i < face.size(); ++i) {
+          size_t corners[3] = {0, i - 1, i};
+          for (size_t c : corners) {
+            indices.push_back(face[c]);
+            uv_indices.push_back(face_uvs[c]);
+          }
+        }
+      }
+    }
+    return true;
+  }
+};
+
+} // namespace
+
+bool parse_scene_file(const std::string &path, SceneDescription &scene) {
+  std::string text;
+  if (!read_text(path, text))
+    return false;
+
+  JsonValue root;
+  std::string error;
+  if (!parse_json(text, root, error)) {
+    fprintf(stderr, "[Scene] %s:%s\n", path.c_str(), error.c_str());
+    return false;
+  }
+
+  scene = SceneDescription();
+  SceneParser parser(path, scene);
+  return parser.parse(root);
+}
+
+// Binary cache
+
+static size_t align16(size_t n) { return (n + 15) & ~(size_t)15; }
+
+static float int_bits(int value) {
+  float f;
+  memcpy(&f, &value, sizeof(f));
+  return f;
+}
+
+static int float_bits(float value) {
+  int i;
+  memcpy(&i, &value, sizeof(i));
+  return i;
+}
+
+static void push_texel(std::vector<float> &out, float x, float y, float z,
+                       float w) {
+  out.push_back(x);
+  out.push_back(y);
+  out.push_back(z);
+  out.push_back(w);
+}
+
+// Interior `first` indices are rebased onto node_base, leaf ones onto
+// item_base.
+static void push_nodes(std::vector<float> &out,
+                       const std::vector<BvhNode> &nodes, int node_base,
+                       int item_base) {
+  for (const BvhNode &node : nodes) {
+    int first = node.first + (node.count > 0 ? item_base : node_base);
+    push_texel(out, node.bounds.min[0], node.bounds.min[1],
+               node.bounds.min[2], int_bits(first));
+    push_texel(out, node.bounds.max[0], node.bounds.max[1],
+               node.bounds.max[2], int_bits(node.count));
+  }
+}
+
+static bool invert_affine(const float m[12], float inv[12]) {
+  float a = m[0], b = m[1], c = m[2];
+  float d = m[4], e = m[5], f = m[6];
+  float g = m[8], h = m[9], i = m[10];
+  float det = a * (e * i - f * h) - b * (d * i - f * g) + c * (d * h - e * g);
+  if (fabsf(det) < 1e-12f)
+    return false;
+  float s = 1.0f / det;
+  float r[9] = {(e * i - f * h) * s, (c * h - b * i) * s, (b * f - c * e) * s,
+                (f * g - d * i) * s, (a * i - c * g) * s, (c * d - a * f) * s,
+                (d * h - e * g) * s, (b * g - a * h) * s, (a * e - b * d) * s};
+  for (int row = 0; row < 3; ++row) {
+    for (int col = 0; col < 3; ++col)
+      inv[row * 4 + col] = r[row * 3 + col];
+    inv[row * 4 + 3] = -(r[row * 3] * m[3] + r[row * 3 + 1] * m[7] +
+                         r[row * 3 + 2] * m[11]);
+  }
+  return true;
+}
+
+void build_top_level(const std::vector<SceneInstance> &instances,
+                     const std::vector<Aabb> &geometry_bounds,
+                     const std::vector<int> &geometry_roots,
+                     SceneTopLevel &top_level) {
+  std::vector<int> kept;
+  std::vector<Aabb> bounds;
+  std::vector<float> inverses;
+  for (size_t i = 0; i < instances.size(); ++i) {
+    const SceneInstance &instance = instances[i];
+    const Aabb &local = geometry_bounds[instance.geometry];
+    float inv[12];
+    if (local.empty() || !invert_affine(instance.transform, inv))
+      continue;
+    kept.push_back((int)i);
+    bounds.push_back(transform_aabb(local, instance.transform));
+    inverses.insert(inverses.end(), inv, inv + 12);
+  }
+
+  std::vector<BvhNode> nodes;
+  std::vector<int> order;
+  top_level.instances.clear();
+  top_level.nodes.clear();
+  if (kept.empty())
+    return;
+  build_bvh(bounds, nodes, order);
+
+  for (int index : order) {
+    const SceneInstance &instance = instances[kept[index]];
+    const float *inv = &inverses[index * 12];
+    top_level.instances.insert(top_level.instances.end(), inv, inv + 12);
+    push_texel(top_level.instances,
+               int_bits(geometry_roots[instance.geometry]),
+               int_bits(instance.material), 0.0f, 0.0f);
+  }
+  push_nodes(top_level.nodes, nodes, 0, 0);
+}
+
+static void transform_point(const float m[12], const float p[3],
+                            float out[3]) {
+  for (int row = 0; row < 3; ++row) {
+    out[row] = m[row * 4] * p[0] + m[row * 4 + 1] * p[1] +
+               m[row * 4 + 2] * p[2] + m[row * 4 + 3];
+  }
+}
+
+static void transform_vector(const float m[12], const float v[3],
+                             float out[3]) {
+  for (int row = 0; row < 3; ++row)
+    out[row] =
+        m[row * 4] * v[0] + m[row * 4 + 1] * v[1] + m[row * 4 + 2] * v[2];
+}
+
+static float luminance(const float *rgb) {
+  return 0.2126f * rgb[0] + 0.7152f * rgb[1] + 0.0722f * rgb[2];
+}
+
+void build_lights(const std::vector<SceneInstance> &instances,
+                  const SceneLightSources &sources, SceneLights &lights) {
+  const float pi = 3.14159265f;
+  static const float zero[3] = {0.0f, 0.0f, 0.0f};
+  // Lights carry the emission as the shader decodes it, so their powers
+  // match emitter_pick_pdf() exactly.
+  auto emission_of = [&](int material, float e[3]) {
+    const float *texel = sources.materials + (size_t)material * 4;
+    unpack_rgb9e5((uint32_t)float_bits(texel[2]), e);
+  };
+  auto emissive = [&](int material) {
+    float e[3];
+    emission_of(material, e);
+    return e[0] > 0.0f || e[1] > 0.0f || e[2] > 0.0f;
+  };
+
+  std::vector<double> powers;
+  lights.texels.assign(4, 0.0f);
+  auto push_light = [&](const float p[3], float radius, const float e1[3],
+                        const float e2[3], int material, float area) {
+    float e[3];
+    emission_of(material, e);
+    push_texel(lights.texels, p[0], p[1], p[2], radius);
+    push_texel(lights.texels, e1[0], e1[1], e1[2], 0.0f);
+    push_texel(lights.texels, e2[0], e2[1], e2[2], 0.0f);
+    push_texel(lights.texels, e[0], e[1], e[2], 0.0f);
+    powers.push_back((double)luminance(e) * area * pi);
+  };
+
+  for (const SceneInstance &instance : instances) {
+    int override_material = instance.material;
+    if (override_material >= 0 && !emissive(override_material))
+      continue;
+    const int *range = &sources.geometry_ranges[instance.geometry * 4];
+    const float *m = instance.transform;
+    float det = m[0] * (m[5] * m[10] - m[6] * m[9]) -
+                m[1] * (m[4] * m[10] - m[6] * m[8]) +
+                m[2] * (m[4] * m[9] - m[5] * m[8]);
+    float scale = cbrtf(fabsf(det));
+
+    for (int i = range[0]; i < range[0] + range[1]; ++i) {
+      const float *sphere = sources.spheres + (size_t)i * 8;
+      int material =
+          override_material >= 0 ? override_material : float_bits(sphere[4]);
+      if (!emissive(material))
+        continue;
+      float center[3];
+      transform_point(m, sphere, center);
+      float radius = fabsf(sphere[3]) * scale;
+      push_light(center, radius, zero, zero, material,
+                 4.0f * pi * radius * radius);
+    }
+    for (int i = range[2]; i < range[2] + range[3]; ++i) {
+      const float *t = sources.triangles + (size_t)i * 16;
+      int material =
+          override_material >= 0 ? override_material : float_bits(t[3]);
+      if (!emissive(material))
+        continue;
+      float v0[3], e1[3], e2[3];
+      transform_point(m, t, v0);
+      transform_vector(m, t + 4, e1);
+      transform_vector(m, t + 8, e2);
+      float n[3] = {e1[1] * e2[2] - e1[2] * e2[1],
+                    e1[2] * e2[0] - e1[0] * e2[2],
+                    e1[0] * e2[1] - e1[1] * e2[0]};
+      float area = 0.5f * sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+      push_light(v0, 0.0f, e1, e2, material, area);
+    }
+  }
+
+  lights.count = (int)powers.size();
+  lights.power = 0.0f;
+  if (lights.count == 0) {
+    lights.texels.clear();
+    return;
+  }
+  double total = 0.0;
+  for (double power : powers)
+    total += power;
+  lights.power = (float)total;
+  lights.texels[0] = lights.power;
+  build_alias_table(powers.data(), lights.count, &lights.texels[4 + 7],
+                    &lights.texels[4 + 11], 16);
+}
+
+// Size and modification time, which together decide whether a cache built
+// from a file is still current.
+static bool file_stamp(const std::string &path, uint64_t &size,
+                       int64_t &mtime) {
+  std::error_code ec;
+  size = std::filesystem::file_size(path, ec);
+  if (ec)
+    return false;
+  mtime = (int64_t)std::filesystem::last_write_time(path, ec)
+              .time_since_epoch()
+              .count();
+  return !ec;
+}
+
+std::vector<unsigned char> compile_scene(const SceneDescription &scene,
+                                         uint64_t source_size,
+                                         int64_t source_mtime) {
+  std::vector<float> sections[kSceneSectionCount];
+  uint32_t counts[kSceneSectionCount] = {0};
+
+  for (const SceneMaterial &m : scene.materials) {
+    const float albedo[4] = {m.albedo[0], m.albedo[1], m.albedo[2], 0.0f};
+    uint32_t texture = m.albedo_texture >= 0 ? (uint32_t)m.albedo_texture
+                                             : 0xffffu;
+    push_texel(
+        sections[kSectionMaterials],
+        int_bits((int)(pack_unorm4x8(albedo) | (uint32_t)m.type << 24)),
+        int_bits((int)(float_to_half(m.roughness) |
+                       (uint32_t)float_to_half(m.ior) << 16)),
+        int_bits((int)pack_rgb9e5(m.emission)),
+        int_bits((int)(texture |
+                       (uint32_t)float_to_half(m.texture_scale) << 16)));
+  }
+  counts[kSectionMaterials] = (uint32_t)scene.materials.size();
+
+  for (const ScenePlane &p : scene.planes) {
+    float length = sqrtf(p.normal[0] * p.normal[0] +
+                         p.normal[1] * p.normal[1] +
+                         p.normal[2] * p.normal[2]);
+    if (length <= 0.0f)
+      length = 1.0f;
+    push_texel(sections[kSectionPlanes], p.point[0], p.point[1], p.point[2],
+               int_bits(p.material));
+    push_texel(sections[kSectionPlanes], p.normal[0] / length,
+               p.normal[1] / length, p.normal[2] / length, 0.0f);
+  }
+  counts[kSectionPlanes] = (uint32_t)scene.planes.size();
+
+  // Bottom level: one BVH per geometry over its spheres and triangles, all
+  // sharing the primitive, node and leaf-entry sections.
+  std::vector<Aabb> geometry_bounds;
+  std::vector<int> geometry_roots;
+  std::vector<int> primitives;
+  SceneLightSources light_sources;
+  for (const SceneGeometry &geometry : scene.geometries) {
+    int sphere_base = (int)counts[kSectionSpheres];
+    int triangle_base = (int)counts[kSectionTriangles];
+    int ranges[4] = {sphere_base, (int)geometry.spheres.size(),
+                     triangle_base, (int)geometry.triangles.size()};
+    light_sources.geometry_ranges.insert(
+        light_sources.geometry_ranges.end(), ranges, ranges + 4);
+
+    std::vector<Aabb> items;
+    for (const SceneSphere &sphere : geometry.spheres) {
+      Aabb box;
+      for (int k = 0; k < 3; ++k) {
+        box.min[k] = sphere.center[k] - fabsf(sphere.radius);
+        box.max[k] = sphere.center[k] + fabsf(sphere.radius);
+      }
+      items.push_back(box);
+      push_texel(sections[kSectionSpheres], sphere.center[0],
+                 sphere.center[1], sphere.center[2], sphere.radius);
+      push_texel(sections[kSectionSpheres], int_bits(sphere.material), 0.0f,
+                 0.0f, 0.0f);
+    }
+    for (const SceneTriangle &t : geometry.triangles) {
+      Aabb box;
+      box.grow(t.v0);
+      box.grow(t.v1);
+      box.grow(t.v2);
+      items.push_back(box);
+      push_texel(sections[kSectionTriangles], t.v0[0], t.v0[1], t.v0[2],
+                 int_bits(t.material));
+      push_texel(sections[kSectionTriangles], t.v1[0] - t.v0[0],
+                 t.v1[1] - t.v0[1], t.v1[2] - t.v0[2],
+                 t.uv2[0] - t.uv0[0]);
+      push_texel(sections[kSectionTriangles], t.v2[0] - t.v0[0],
+                 t.v2[1] - t.v0[1], t.v2[2] - t.v0[2],
+                 t.uv2[1] - t.uv0[1]);
+      push_texel(sections[kSectionTriangles], t.uv0[0], t.uv0[1],
+                 t.uv1[0] - t.uv0[0], t.uv1[1] - t.uv0[1]);
+    }
+    counts[kSectionSpheres] += (uint32_t)geometry.spheres.size();
+    counts[kSectionTriangles] += (uint32_t)geometry.triangles.size();
+
+    int node_base = (int)counts[kSectionBlasNodes];
+    geometry_roots.push_back(node_base);
+    if (items.empty()) {
+      geometry_bounds.push_back(Aabb());
+      continue;
+    }
+
+    std::vector<BvhNode> nodes;
+    std::vector<int> order;
+    build_bvh(items, nodes, order);
+    geometry_bounds.push_back(nodes[0].bounds);
+
+    int sphere_count = (int)geometry.spheres.size();
+    push_nodes(sections[kSectionBlasNodes], nodes, node_base,
+               (int)primitives.size());
+    for (int item : order) {
+      if (item < sphere_count) {
+        primitives.push_back((sphere_base + item) << 1);
+      } else {
+        primitives.push_back((triangle_base + item - sphere_count) << 1 | 1);
+      }
+    }
+    counts[kSectionBlasNodes] += (uint32_t)nodes.size();
+  }
+
+  counts[kSectionPrimitives] = (uint32_t)primitives.size();
+  for (size_t i = 0; i < primitives.size(); ++i)
+    sections[kSectionPrimitives].push_back(int_bits(primitives[i]));
+  while (sections[kSectionPrimitives].size() % 4 != 0)
+    sections[kSectionPrimitives].push_back(0.0f);
+
+  for (size_t g = 0; g < scene.geometries.size(); ++g) {
+    const Aabb &b = geometry_bounds[g];
+    push_texel(sections[kSectionGeometries], b.min[0], b.min[1], b.min[2],
+               int_bits(geometry_roots[g]));
+    push_texel(sections[kSectionGeometries], b.max[0], b.max[1], b.max[2],
+               0.0f);
+    const int *ranges = &light_sources.geometry_ranges[g * 4];
+    push_texel(sections[kSectionGeometries], int_bits(ranges[0]),
+               int_bits(ranges[1]), int_bits(ranges[2]), int_bits(ranges[3]));
+  }
+  counts[kSectionGeometries] = (uint32_t)scene.geometries.size();
+
+  for (const SceneInstance &instance : scene.instances) {
+    const float *m = instance.transform;
+    sections[kSectionInstanceSources].insert(
+        sections[kSectionInstanceSources].end(), m, m + 12);
+    push_texel(sections[kSectionInstanceSources], int_bits(instance.geometry),
+               int_bits(instance.material), 0.0f, 0.0f);
+  }
+  counts[kSectionInstanceSources] = (uint32_t)scene.instances.size();
+
+  for (const std::string &texture : scene.textures) {
+    std::vector<float> &out = sections[kSectionTextures];
+    size_t start = out.size();
+    out.resize(start + kTexturePathTexels * 4, 0.0f);
+    memcpy(&out[start], texture.c_str(), texture.size());
+  }
+  counts[kSectionTextures] = (uint32_t)scene.textures.size();
+
+  for (const std::string &mesh : scene.meshes) {
+    std::vector<float> &out = sections[kSectionMeshFiles];
+    size_t start = out.size();
+    out.resize(start + (kTexturePathTexels + 1) * 4, 0.0f);
+    memcpy(&out[start], mesh.c_str(), mesh.size());
+    // A mesh that vanished since parsing keeps a zero stamp, which never
+    // matches, so the next load compiles again and reports it.
+    uint64_t size = 0;
+    int64_t mtime = 0;
+    file_stamp(mesh, size, mtime);
+    float *stamp = &out[start + kTexturePathTexels * 4];
+    memcpy(stamp, &size, sizeof(size));
+    memcpy(stamp + 2, &mtime, sizeof(mtime));
+  }
+  counts[kSectionMeshFiles] = (uint32_t)scene.meshes.size();
+
+  SceneTopLevel top_level;
+  build_top_level(scene.instances, geometry_bounds, geometry_roots,
+                  top_level);
+  sections[kSectionInstances] = top_level.instances;
+  sections[kSectionTlasNodes] = top_level.nodes;
+  counts[kSectionInstances] = (uint32_t)(top_level.instances.size() / 16);
+  counts[kSectionTlasNodes] = (uint32_t)(top_level.nodes.size() / 8);
+
+  // Moves change where lights are and how bright they look, never how
+  // many there are, so this section keeps its size too.
+  light_sources.materials = sections[kSectionMaterials].data();
+  light_sources.spheres = sections[kSectionSpheres].data();
+  light_sources.triangles = sections[kSectionTriangles].data();
+  SceneLights lights;
+  build_lights(scene.instances, light_sources, lights);
+  sections[kSectionLights] = lights.texels;
+  counts[kSectionLights] = (uint32_t)lights.count;
+
+  // Reserve room for a TLAS over every source instance (at most 2n - 1
+  // nodes) so moving instances can rewrite the top level in place.
+  uint32_t texels[kSceneSectionCount];
+  for (int s = 0; s < kSceneSectionCount; ++s)
+    texels[s] = (uint32_t)(sections[s].size() / 4);
+  size_t instance_count = scene.instances.size();
+  texels[kSectionInstances] = (uint32_t)(instance_count * 4);
+  texels[kSectionTlasNodes] =
+      (uint32_t)(instance_count > 0 ? (2 * instance_count - 1) * 2 : 0);
+
+  SceneCacheHeader header;
+  memset((void *)&header, 0, sizeof(header));
+  memcpy(header.magic, "RTSB", 4);
+  header.version = kSceneCacheVersion;
+  header.source_size = source_size;
+  header.source_mtime = source_mtime;
+  header.settings = scene.settings;
+
+  size_t offset = align16(sizeof(header));
+  for (int s = 0; s < kSceneSectionCount; ++s) {
+    header.sections[s].offset = offset;
+    header.sections[s].count = counts[s];
+    header.sections[s].texels = texels[s];
+    offset += (size_t)texels[s] * 4 * sizeof(float);
+  }
+
+  std::vector<unsigned char> bytes(offset, 0);
+  memcpy(bytes.data(), &header, sizeof(header));
+  for (int s = 0; s < kSceneSectionCount; ++s) {
+    if (!sections[s].empty()) {
+      memcpy(bytes.data() + header.sections[s].offset, sections[s].data(),
+             sections[s].size() * sizeof(float));
+    }
+  }
+  return bytes;
+}
+
+SceneBlob::~SceneBlob() { release(); }
+
+void SceneBlob::release() {
+#ifndef _WIN32
+  if (mapping) {
+    munmap(mapping, size);
+  }
+#endif
+  mapping = nullptr;
+  owned.clear();
+  data = nullptr;
+  size = 0;
+}
+
+bool SceneBlob::map(const std::string &path) {
+  release();
+#ifndef _WIN32
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+    close(fd);
+    return false;
+  }
+  void *address = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE,
+                       fd, 0);
+  close(fd);
+  if (address == MAP_FAILED)
+    return false;
+  mapping = address;
+  data = (const unsigned char *)address;
+  size = (size_t)st.st_size;
+#else
+  std::ifstream file(path, std::ios::binary);
+  if (!file)
+    return false;
+  std::vector<unsigned char> bytes((std::istreambuf_iterator<char>(file)),
+                                   std::istreambuf_iterator<char>());
+  owned = std::move(bytes);
+  data = owned.data();
+  size = owned.size();
+#endif
+  if (!check()) {
+    release();
+    return false;
+  }
+  return true;
+}
+
+void SceneBlob::adopt(std::vector<unsigned char> bytes) {
+  release();
+  owned = std::move(bytes);
+  data = owned.data();
+  size = owned.size();
+  if (!check())
+    release();
+}
+
+// Texels a section needs to hold `count` elements; see SceneSection.
+static uint64_t section_texels(int section, uint64_t count) {
+  switch (section) {
+  case kSectionMaterials:
+    return count;
+  case kSectionSpheres:
+  case kSectionPlanes:
+  case kSectionBlasNodes:
+  case kSectionTlasNodes:
+    return count * 2;
+  case kSectionTriangles:
+  case kSectionInstances:
+  case kSectionInstanceSources:
+    return count * 4;
+  case kSectionPrimitives:
+    return (count + 3) / 4;
+  case kSectionLights: // empty without emitters
+    return count > 0 ? 1 + count * 4 : 0;
+  case kSectionGeometries:
+    return count * 3;
+  case kSectionTextures:
+    return count * kTexturePathTexels;
+  case kSectionMeshFiles:
+    return count * (kTexturePathTexels + 1);
+  }
+  return ~0ull;
+}
+
+bool SceneBlob::check() const {
+  if (size < sizeof(SceneCacheHeader))
+    return false;
+  const SceneCacheHeader &h = header();
+  if (memcmp(h.magic, "RTSB", 4) != 0 || h.version != kSceneCacheVersion)
+    return false;
+  for (int s = 0; s < kSceneSectionCount; ++s) {
+    uint64_t bytes = (uint64_t)h.sections[s].texels * 4 * sizeof(float);
+    if (h.sections[s].offset % 16 != 0 ||
+        h.sections[s].offset + bytes > size ||
+        section_texels(s, h.sections[s].count) > h.sections[s].texels)
+      return false;
+  }
+  return true;
+}
+
+uint32_t SceneBlob::count(SceneSection section) const {
+  return header().sections[section].count;
+}
+
+const float *SceneBlob::texels(SceneSection section) const {
+  return reinterpret_cast<const float *>(data +
+                                         header().sections[section].offset);
+}
+
+void read_top_level_sources(const SceneBlob &blob,
+                            std::vector<SceneInstance> &instances,
+                            std::vector<Aabb> &geometry_bounds,
+                            std::vector<int> &geometry_roots) {
+  const float *g = blob.texels(kSectionGeometries);
+  uint32_t geometry_count = blob.count(kSectionGeometries);
+  geometry_bounds.resize(geometry_count);
+  geometry_roots.resize(geometry_count);
+  for (uint32_t i = 0; i < geometry_count; ++i, g += 12) {
+    for (int k = 0; k < 3; ++k) {
+      geometry_bounds[i].min[k] = g[k];
+      geometry_bounds[i].max[k] = g[4 + k];
+    }
+    geometry_roots[i] = float_bits(g[3]);
+  }
+
+  const float *t = blob.texels(kSectionInstanceSources);
+  uint32_t instance_count = blob.count(kSectionInstanceSources);
+  instances.resize(instance_count);
+  for (uint32_t i = 0; i < instance_count; ++i, t += 16) {
+    memcpy(instances[i].transform, t, sizeof(instances[i].transform));
+    instances[i].geometry = float_bits(t[12]);
+    instances[i].material = float_bits(t[13]);
+  }
+}
+
+void read_light_sources(const SceneBlob &blob, SceneLightSources &sources) {
+  sources.materials = blob.texels(kSectionMaterials);
+  sources.spheres = blob.texels(kSectionSpheres);
+  sources.triangles = blob.texels(kSectionTriangles);
+  const float *g = blob.texels(kSectionGeometries);
+  uint32_t geometry_count = blob.count(kSectionGeometries);
+  sources.geometry_ranges.resize(geometry_count * 4);
+  for (uint32_t i = 0; i < geometry_count * 4; ++i)
+    sources.geometry_ranges[i] = float_bits(g[(i / 4) * 12 + 8 + i % 4]);
+}
+
+std::vector<std::string> read_texture_paths(const SceneBlob &blob) {
+  std::vector<std::string> paths;
+  const char *path = (const char *)blob.texels(kSectionTextures);
+  for (uint32_t i = 0; i < blob.count(kSectionTextures); ++i) {
+    const size_t bytes = kTexturePathTexels * 16;
+    paths.push_back(std::string(path, strnlen(path, bytes)));
+    path += bytes;
+  }
+  return paths;
+}
+
+int SceneBlob::gpu_base(SceneSection section) const {
+  const SceneSectionRange *sections = header().sections;
+  return (int)((sections[section].offset - sections[0].offset) / 16);
+}
+
+static std::string cache_path_for(const std::string &path) {
+  std::filesystem::path cache(path);
+  cache.replace_extension(".rtsb");
+  return cache.string();
+}
+
+// Whether every .obj a blob was compiled from still has the size and
+// modification time recorded for it.
+static bool meshes_current(const SceneBlob &blob) {
+  const float *mesh = blob.texels(kSectionMeshFiles);
+  for (uint32_t i = 0; i < blob.count(kSectionMeshFiles); ++i) {
+    const size_t bytes = kTexturePathTexels * 16;
+    std::string path((const char *)mesh, strnlen((const char *)mesh, bytes));
+    uint64_t recorded_size, size;
+    int64_t recorded_mtime, mtime;
+    memcpy(&recorded_size, mesh + kTexturePathTexels * 4, 8);
+    memcpy(&recorded_mtime, mesh + kTexturePathTexels * 4 + 2, 8);
+    if (!file_stamp(path, size, mtime) || size != recorded_size ||
+        mtime != recorded_mtime)
+      return false;
+    mesh += (kTexturePathTexels + 1) * 4;
+  }
+  return true;
+}
+
+bool load_scene(const std::string &path, SceneBlob &blob) {
+  auto start = std::chrono::steady_clock::now();
+
+  uint64_t source_size;
+  int64_t source_mtime;
+  if (!file_stamp(path, source_size, source_mtime)) {
+    fprintf(stderr, "[Scene] Failed to open %s\n", path.c_str());
+    return false;
+  }
+
+  std::string cache = cache_path_for(path);
+  bool cached = blob.map(cache) &&
+                blob.header().source_size == source_size &&
+                blob.header().source_mtime == source_mtime &&
+                meshes_current(blob);
+
+  if (!cached) {
+    SceneDescription scene;
+    if (!parse_scene_file(path, scene))
+      return false;
+    std::vector<unsigned char> bytes =
+        compile_scene(scene, source_size, source_mtime);
+
+    // A read-only scene directory only costs the cache, not the scene.
+    std::ofstream file(cache, std::ios::binary);
+    if (file) {
+      file.write((const char *)bytes.data(), (std::streamsize)bytes.size());
+    }
+    if (!file) {
+      fprintf(stderr, "[Scene] Could not write cache %s\n", cache.c_str());
+    }
+    blob.adopt(std::move(bytes));
+    if (!blob.valid()) {
+      fprintf(stderr, "[Scene] Compiled %s is inconsistent\n", path.c_str());
+      return false;
+    }
+  }
+
+  double ms = std::chrono::duration<double, std::milli>(
+                  std::chrono::steady_clock::now() - start)
+                  .count();
+  fprintf(stderr,
+          "[Scene] %s %s in %.2f ms: %u spheres, %u planes, %u triangles, "
+          "%u instances\n",
+          cached ? "Mapped" : "Compiled", path.c_str(), ms,
+          blob.count(kSectionSpheres), blob.count(kSectionPlanes),
+          blob.count(kSectionTriangles), blob.count(kSectionInstances));
+  return blob.valid();
+}
@@ -0,0 +1,87 @@
+#include "scene_gpu.h"
+
+#include "gl_debug.h"
+
+#include <cstdio>
+#include <cstring>
+
+bool SceneGpu::upload(const SceneBlob &blob) {
+  const SceneSectionRange *sections = blob.header().sections;
+  for (int s = 0; s < kSceneGpuSectionCount; ++s) {
+    bases[s] = blob.gpu_base((SceneSection)s);
+    counts[s] = (int)sections[s].count;
+  }
+  const SceneSectionRange &last = sections[kSceneGpuSectionCount - 1];
+  GLsizeiptr texels =
+      bases[kSceneGpuSectionCount - 1] + (GLsizeiptr)last.texels;
+
+  GLint max_texels = 0;
+  glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &max_texels);
+  if (texels > max_texels) {
+    fprintf(stderr,
+            "[Scene] Scene needs %ld texels, texture buffers hold %d\n",
+            (long)texels, max_texels);
+    return false;
+  }
+
+  // An empty scene still gets one texel so the sampler has storage.
+  static const float zero[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+  const float *data = texels > 0 ? blob.texels(kSectionMaterials) : zero;
+  GLsizeiptr bytes = (texels > 0 ? texels : 1) * 4 * sizeof(float);
+
+  GL_CALL(glGenBuffers(1, &buffer));
+  GL_CALL(glBindBuffer(GL_TEXTURE_BUFFER, buffer));
+  GL_CALL(glBufferData(GL_TEXTURE_BUFFER, bytes, data, GL_STATIC_DRAW));
+  GL_CALL(glBindBuffer(GL_TEXTURE_BUFFER, 0));
+
+  GL_CALL(glGenTextures(1, &texture));
+  GL_CALL(glBindTexture(GL_TEXTURE_BUFFER, texture));
+  GL_CALL(glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, buffer));
+  GL_CALL(glBindTexture(GL_TEXTURE_BUFFER, 0));
+
+  read_top_level_sources(blob, instances, geometry_bounds, geometry_roots);
+  read_light_sources(blob, light_sources);
+  return true;
+}
+
+SceneGpu::~SceneGpu() {
+  glDeleteTextures(1, &texture);
+  glDeleteBuffers(1, &buffer);
+}
+
+void SceneGpu::bind(int unit) const {
+  glActiveTexture(GL_TEXTURE0 + unit);
+  glBindTexture(GL_TEXTURE_BUFFER, texture);
+  glActiveTexture(GL_TEXTURE0);
+}
+
+void SceneGpu::move_instance(int index, const float transform[12]) {
+  memcpy(instances[index].transform, transform,
+         sizeof(instances[index].transform));
+
+  SceneTopLevel top_level;
+  build_top_level(instances, geometry_bounds, geometry_roots, top_level);
+
+  // Both fit the capacity reserved at compile time for every instance.
+  GL_CALL(glBindBuffer(GL_TEXTURE_BUFFER, buffer));
+  if (!top_level.instances.empty()) {
+    GL_CALL(glBufferSubData(
+        GL_TEXTURE_BUFFER, (GLintptr)bases[kSectionInstances] * 16,
+        top_level.instances.size() * sizeof(float),
+        top_level.instances.data()));
+    GL_CALL(glBufferSubData(
+        GL_TEXTURE_BUFFER, (GLintptr)bases[kSectionTlasNodes] * 16,
+        top_level.nodes.size() * sizeof(float), top_level.nodes.data()));
+  }
+  if (counts[kSectionLights] > 0) {
+    SceneLights lights;
+    build_lights(instances, light_sources, lights);
+    GL_CALL(glBufferSubData(
+        GL_TEXTURE_BUFFER, (GLintptr)bases[kSectionLights] * 16,
+        lights.texels.size() * sizeof(float), lights.texels.data()));
+  }
+  GL_CALL(glBindBuffer(GL_TEXTURE_BUFFER, 0));
+
+  counts[kSectionInstances] = (int)(top_level.instances.size() / 16);
+  counts[kSectionTlasNodes] = (int)(top_level.nodes.size() / 8);
+}
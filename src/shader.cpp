@@ -3,10 +3,46 @@
 #include "gl_debug.h"
 #include "shader.h"
 
+#define GLFW_INCLUDE_NONE
+#include <GLFW/glfw3.h>
+
 #include <fstream>
 #include <iostream>
 #include <sstream>
 
+#ifdef DEBUG
+static const char *uniform_type_name(GLenum type) {
+  switch (type) {
+  case GL_BOOL:
+    return "bool";
+  case GL_INT:
+    return "int";
+  case GL_FLOAT:
+    return "float";
+  case GL_INT_VEC2:
+    return "ivec2";
+  case GL_FLOAT_VEC2:
+    return "vec2";
+  case GL_FLOAT_VEC3:
+    return "vec3";
+  case GL_FLOAT_VEC4:
+    return "vec4";
+  case GL_SAMPLER_2D:
+    return "sampler2D";
+  case GL_SAMPLER_3D:
+    return "sampler3D";
+  case GL_SAMPLER_2D_ARRAY:
+    return "sampler2DArray";
+  case GL_SAMPLER_BUFFER:
+    return "samplerBuffer";
+  case GL_FLOAT_MAT4:
+    return "mat4";
+  default:
+    return "other";
+  }
+}
+#endif
+
 static void checkCompileErrors(unsigned int shader, const std::string &type) {
   int success;
   char infoLog[1024];
@@ -27,28 +63,110 @@ static void checkCompileErrors(unsigned int shader, const std::string &type) {
   }
 }
 
-Shader::Shader(const std::string &vertex_path,
-               const std::string &fragment_path) {
+// GL_KHR_parallel_shader_compile (and its ARB twin) is not part of the glad
+// loader, so its entry point and enum are pulled in by hand.
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+typedef void(GLAD_API_PTR *PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)(GLuint count);
+
+static PFNGLMAXSHADERCOMPILERTHREADSKHRPROC load_max_compiler_threads() {
+  if (glfwExtensionSupported("GL_KHR_parallel_shader_compile"))
+    return (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)glfwGetProcAddress(
+        "glMaxShaderCompilerThreadsKHR");
+  if (glfwExtensionSupported("GL_ARB_parallel_shader_compile"))
+    return (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)glfwGetProcAddress(
+        "glMaxShaderCompilerThreadsARB");
+  return nullptr;
+}
+
+bool Shader::supports_parallel_compile() {
+  return load_max_compiler_threads() != nullptr;
+}
+
+Shader::Shader(const std::string &vertex_path, const std::string &fragment_path,
+               const ShaderOptions &options) {
+
+  std::string vert_code =
+      inject_defines(read_file(vertex_path), options.defines);
+  std::string frag_code =
+      inject_defines(read_file(fragment_path), options.defines);
+
+  if (options.async) {
+    if (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC max_threads =
+            load_max_compiler_threads()) {
+      // Let the driver pick the thread count; compile and link now only
+      // queue work, and ready() polls GL_COMPLETION_STATUS_KHR.
+      max_threads(0xFFFFFFFFu);
+      parallel_compile = true;
+    } else if (options.worker_context) {
+      GLFWwindow *context = options.worker_context;
+      worker = std::thread([this, context, vert_code, frag_code]() {
+        glfwMakeContextCurrent(context);
+        vert_id = compile(GL_VERTEX_SHADER, vert_code);
+        frag_id = compile(GL_FRAGMENT_SHADER, frag_code);
+        link();
+        // Make the linked program visible to the main context.
+        glFinish();
+        glfwMakeContextCurrent(nullptr);
+        worker_done.store(true, std::memory_order_release);
+      });
+      return;
+    }
+  }
+
+  vert_id = compile(GL_VERTEX_SHADER, vert_code);
+  frag_id = compile(GL_FRAGMENT_SHADER, frag_code);
+  link();
+
+  if (!parallel_compile)
+    finish_link();
+}
+
+Shader::~Shader() {
+  if (worker.joinable())
+    worker.join();
+  glDeleteProgram(program_id);
+}
 
-  std::string vert_code = read_file(vertex_path);
-  std::string frag_code = read_file(fragment_path);
+bool Shader::ready() {
+  if (linked)
+    return true;
 
-  unsigned int vert = compile(GL_VERTEX_SHADER, vert_code);
-  unsigned int frag = compile(GL_FRAGMENT_SHADER, frag_code);
+  if (worker.joinable()) {
+    if (!worker_done.load(std::memory_order_acquire))
+      return false;
+    worker.join();
+  } else if (parallel_compile) {
+    GLint done = GL_FALSE;
+    glGetProgramiv(program_id, GL_COMPLETION_STATUS_KHR, &done);
+    if (!done)
+      return false;
+  }
 
+  finish_link();
+  return true;
+}
+
+void Shader::link() {
   program_id = glCreateProgram();
-  glAttachShader(program_id, vert);
-  glAttachShader(program_id, frag);
+  glAttachShader(program_id, vert_id);
+  glAttachShader(program_id, frag_id);
   glLinkProgram(program_id);
+}
+
+void Shader::finish_link() {
+  checkCompileErrors(vert_id, "VERTEX");
+  checkCompileErrors(frag_id, "FRAGMENT");
   check_program(program_id);
 
   checkCompileErrors(program_id, "PROGRAM");
 
-  glDeleteShader(vert);
-  glDeleteShader(frag);
-}
+  glDeleteShader(vert_id);
+  glDeleteShader(frag_id);
+  vert_id = frag_id = 0;
 
-Shader::~Shader() { glDeleteProgram(program_id); }
+  reflect_uniforms();
+  linked = true;
+}
 
 void Shader::use() const { glUseProgram(program_id); }
 
@@ -72,11 +190,27 @@ unsigned int Shader::compile(unsigned int type, const std::string &src) {
   glShaderSource(shader, 1, &code, nullptr);
   glCompileShader(shader);
 
-  checkCompileErrors(shader, type == GL_VERTEX_SHADER ? "VERTEX" : "FRAGMENT");
-
   return shader;
 }
 
+std::string Shader::inject_defines(const std::string &src,
+                                   const std::vector<std::string> &defines) {
+  if (defines.empty())
+    return src;
+
+  std::string block;
+  for (const std::string &define : defines)
+    block += "#define " + define + "\n";
+
+  // #version must stay the first directive in the file.
+  size_t insert_at = 0;
+  if (src.compare(0, 8, "#version") == 0) {
+    size_t eol = src.find('\n');
+    insert_at = eol == std::string::npos ? src.size() : eol + 1;
+  }
+  return src.substr(0, insert_at) + block + src.substr(insert_at);
+}
+
 void Shader::set_bool(const std::string &name, bool value) const {
   glUniform1i(get_uniform_location(name), (int)value);
 }
@@ -117,3 +251,113 @@ GLint Shader::get_uniform_location(const std::string &name) const {
 
   return location;
 }
+
+void Shader::set_bool(UniformHandle handle, bool value) const {
+  glUniform1i(handle.location, (int)value);
+}
+
+void Shader::set_int(UniformHandle handle, int value) const {
+  glUniform1i(handle.location, value);
+}
+
+void Shader::set_float(UniformHandle handle, float value) const {
+  glUniform1f(handle.location, value);
+}
+
+void Shader::set_vec2(UniformHandle handle, float value1, float value2) const {
+  glUniform2f(handle.location, value1, value2);
+}
+
+void Shader::set_ivec2(UniformHandle handle, int value1, int value2) const {
+  glUniform2i(handle.location, value1, value2);
+}
+
+void Shader::set_vec3(UniformHandle handle, float value1, float value2,
+                      float value3) const {
+  glUniform3f(handle.location, value1, value2, value3);
+}
+
+void Shader::set_int_array(UniformHandle handle, const int *values,
+                           int count) const {
+  glUniform1iv(handle.location, count, values);
+}
+
+void Shader::set_mat4(UniformHandle handle, const float *values) const {
+  glUniformMatrix4fv(handle.location, 1, GL_FALSE, values);
+}
+
+void Shader::reflect_uniforms() {
+  GLint count = 0;
+  GLint max_length = 0;
+  glGetProgramiv(program_id, GL_ACTIVE_UNIFORMS, &count);
+  glGetProgramiv(program_id, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_length);
+
+  std::string name(max_length > 0 ? max_length : 1, '\0');
+  for (GLint i = 0; i < count; ++i) {
+    GLsizei length = 0;
+    GLint size = 0;
+    GLenum type = GL_NONE;
+    glGetActiveUniform(program_id, (GLuint)i, max_length, &length, &size,
+                       &type, name.data());
+
+    std::string uniform_name = name.substr(0, length);
+    // Arrays of basic types are reported as "name[0]"; register them under
+    // the base name. Members of struct arrays ("lights[2].color") are
+    // reported one element at a time and keep their full name.
+    const std::string suffix = "[0]";
+    if (uniform_name.size() > suffix.size() &&
+        uniform_name.compare(uniform_name.size() - suffix.size(),
+                             suffix.size(), suffix) == 0)
+      uniform_name.erase(uniform_name.size() - suffix.size());
+
+    GLint location = glGetUniformLocation(program_id, uniform_name.c_str());
+    active_uniforms[uniform_name] = {location, type, size, false};
+  }
+}
+
+UniformHandle Shader::uniform(const std::string &name, GLenum type) const {
+  UniformHandle handle;
+  handle.type = type;
+
+  auto it = active_uniforms.find(name);
+  if (it == active_uniforms.end()) {
+#ifdef DEBUG
+    std::cerr << "[Shader] Warning: uniform '" << name
+              << "' not found or optimized out\n";
+#endif
+    return handle;
+  }
+
+  it->second.resolved = true;
+  handle.location = it->second.location;
+
+#ifdef DEBUG
+  // Booleans and samplers are set through glUniform1i as well.
+  bool compatible = it->second.type == type ||
+                    (type == GL_INT && (it->second.type == GL_BOOL ||
+                                        it->second.type == GL_SAMPLER_2D ||
+                                        it->second.type == GL_SAMPLER_3D ||
+                                        it->second.type ==
+                                            GL_SAMPLER_2D_ARRAY ||
+                                        it->second.type == GL_SAMPLER_BUFFER));
+  if (!compatible) {
+    std::cerr << "[Shader] Warning: uniform '" << name << "' is declared as "
+              << uniform_type_name(it->second.type) << " but bound as "
+              << uniform_type_name(type) << "\n";
+  }
+#endif
+
+  return handle;
+}
+
+void Shader::report_unused_uniforms() const {
+#ifdef DEBUG
+  for (const auto &entry : active_uniforms) {
+    if (!entry.second.resolved) {
+      std::cerr << "[Shader] Warning: active uniform '" << entry.first
+                << "' (" << uniform_type_name(entry.second.type)
+                << ") is never set\n";
+    }
+  }
+#endif
+}
@@ -0,0 +1,168 @@
+#include "texture_array.h"
+
+#include "gl_debug.h"
+#include "image_io.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+
+// Resamples one line of RGB texels: box averages when shrinking, linear
+// interpolation with wrap-around when growing.
+static void resample_line(const float *src, int src_count, int src_step,
+                          float *dst, int dst_count, int dst_step) {
+  for (int i = 0; i < dst_count; ++i) {
+    float *out = dst + (size_t)i * dst_step;
+    if (dst_count <= src_count) {
+      int a = (int)((long long)i * src_count / dst_count);
+      int b = std::max((int)((long long)(i + 1) * src_count / dst_count),
+                       a + 1);
+      for (int c = 0; c < 3; ++c) {
+        float sum = 0.0f;
+        for (int k = a; k < b; ++k)
+          sum += src[(size_t)k * src_step + c];
+        out[c] = sum / (float)(b - a);
+      }
+    } else {
+      float u = ((float)i + 0.5f) * (float)src_count / (float)dst_count -
+                0.5f;
+      float base = std::floor(u);
+      float f = u - base;
+      int k0 = ((int)base % src_count + src_count) % src_count;
+      int k1 = (k0 + 1) % src_count;
+      for (int c = 0; c < 3; ++c)
+        out[c] = src[(size_t)k0 * src_step + c] * (1.0f - f) +
+                 src[(size_t)k1 * src_step + c] * f;
+    }
+  }
+}
+
+static unsigned char linear_to_srgb8(float c) {
+  c = std::min(std::max(c, 0.0f), 1.0f);
+  float s = c <= 0.0031308f ? c * 12.92f
+                            : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+  return (unsigned char)(s * 255.0f + 0.5f);
+}
+
+TextureArray::~TextureArray() { glDeleteTextures(1, &texture); }
+
+bool TextureArray::load(const std::vector<std::string> &paths,
+                        ThreadPool &pool) {
+  auto start = std::chrono::steady_clock::now();
+  int count = (int)paths.size();
+
+  GLint max_layers = 0, max_size = 0;
+  glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &max_layers);
+  glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_size);
+  if (count == 0 || count > max_layers) {
+    fprintf(stderr, "[Textures] %d textures, the limit is %d\n", count,
+            max_layers);
+    return false;
+  }
+
+  std::vector<Image> images(count);
+  std::vector<char> decoded(count, 0);
+  pool.parallel_for(count, [&](int i) {
+    decoded[i] = read_image(paths[i], images[i]);
+  });
+  for (int i = 0; i < count; ++i) {
+    if (!decoded[i]) {
+      fprintf(stderr, "[Textures] Failed to load %s\n", paths[i].c_str());
+      return false;
+    }
+  }
+
+  int size = 1;
+  for (const Image &image : images) {
+    while (size < std::max(image.width, image.height) &&
+           size < std::min(kMaxSize, (int)max_size))
+      size *= 2;
+  }
+  int levels = 1;
+  while ((size >> (levels - 1)) > 1)
+    ++levels;
+
+  // Level l holds every layer back to back, as glTexImage3D expects.
+  std::vector<std::vector<unsigned char>> texels(levels);
+  for (int l = 0; l < levels; ++l) {
+    int s = size >> l;
+    texels[l].resize((size_t)s * s * 4 * count);
+  }
+
+  pool.parallel_for(count, [&](int layer) {
+    const Image &image = images[layer];
+    std::vector<float> rows((size_t)size * image.height * 3);
+    for (int y = 0; y < image.height; ++y)
+      resample_line(image.at(0, y), image.width, 3,
+                    &rows[(size_t)y * size * 3], size, 3);
+    std::vector<float> level((size_t)size * size * 3);
+    for (int x = 0; x < size; ++x)
+      resample_line(&rows[(size_t)x * 3], image.height, size * 3,
+                    &level[(size_t)x * 3], size, size * 3);
+
+    for (int l = 0; l < levels; ++l) {
+      int s = size >> l;
+      if (l > 0) {
+        // Power-of-two sizes halve exactly, so a 2x2 box is the whole
+        // footprint of a texel.
+        std::vector<float> next((size_t)s * s * 3);
+        for (int y = 0; y < s; ++y) {
+          for (int x = 0; x < s; ++x) {
+            const float *a = &level[((size_t)(2 * y) * s * 2 + 2 * x) * 3];
+            const float *b = a + (size_t)s * 2 * 3;
+            for (int c = 0; c < 3; ++c)
+              next[((size_t)y * s + x) * 3 + c] =
+                  0.25f * (a[c] + a[c + 3] + b[c] + b[c + 3]);
+          }
+        }
+        level.swap(next);
+      }
+
+      unsigned char *out = &texels[l][(size_t)layer * s * s * 4];
+      for (size_t i = 0; i < (size_t)s * s; ++i) {
+        for (int c = 0; c < 3; ++c)
+          out[i * 4 + c] = linear_to_srgb8(level[i * 3 + c]);
+        out[i * 4 + 3] = 255;
+      }
+    }
+  });
+
+  // Image rows run top to bottom, so t = 0 is the top edge.
+  GL_CALL(glGenTextures(1, &texture));
+  GL_CALL(glBindTexture(GL_TEXTURE_2D_ARRAY, texture));
+  for (int l = 0; l < levels; ++l) {
+    int s = size >> l;
+    GL_CALL(glTexImage3D(GL_TEXTURE_2D_ARRAY, l, GL_SRGB8_ALPHA8, s, s, count,
+                         0, GL_RGBA, GL_UNSIGNED_BYTE, texels[l].data()));
+  }
+  GL_CALL(glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL,
+                          levels - 1));
+  GL_CALL(glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER,
+                          GL_LINEAR_MIPMAP_LINEAR));
+  GL_CALL(glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER,
+                          GL_LINEAR));
+  GL_CALL(
+      glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT));
+  GL_CALL(
+      glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT));
+  GL_CALL(glBindTexture(GL_TEXTURE_2D_ARRAY, 0));
+
+  layer_count = count;
+  layer_size = size;
+
+  float ms = std::chrono::duration<float, std::milli>(
+                 std::chrono::steady_clock::now() - start)
+                 .count();
+  fprintf(stderr,
+          "[Textures] Loaded %d textures in %.1f ms: %dx%d layers, %d mip "
+          "levels, %d threads\n",
+          count, ms, size, size, levels, pool.size());
+  return true;
+}
+
+void TextureArray::bind(int unit) const {
+  glActiveTexture(GL_TEXTURE0 + unit);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+  glActiveTexture(GL_TEXTURE0);
+}
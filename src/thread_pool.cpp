@@ -0,0 +1,69 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+
+ThreadPool::ThreadPool(int threads) {
+  if (threads <= 0)
+    threads = std::max((int)std::thread::hardware_concurrency(), 1);
+  for (int i = 1; i < threads; ++i)
+    workers.emplace_back([this]() { work(); });
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  wake.notify_all();
+  for (std::thread &worker : workers)
+    worker.join();
+}
+
+void ThreadPool::parallel_for(int count, const std::function<void(int)> &fn) {
+  if (count <= 0)
+    return;
+  if (workers.empty() || count == 1) {
+    for (int i = 0; i < count; ++i)
+      fn(i);
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    job = &fn;
+    job_count = count;
+    next = 0;
+    busy = (int)workers.size();
+    ++generation;
+  }
+  wake.notify_all();
+  run_items();
+
+  std::unique_lock<std::mutex> lock(mutex);
+  done.wait(lock, [this]() { return busy == 0; });
+  job = nullptr;
+}
+
+void ThreadPool::run_items() {
+  for (int i = next++; i < job_count; i = next++)
+    (*job)(i);
+}
+
+void ThreadPool::work() {
+  unsigned seen = 0;
+  for (;;) {
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      wake.wait(lock, [&]() { return stopping || generation != seen; });
+      if (stopping)
+        return;
+      seen = generation;
+    }
+    run_items();
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (--busy == 0)
+        done.notify_one();
+    }
+  }
+}
@@ -0,0 +1,67 @@
+#include "tile_scheduler.h"
+
+#include <algorithm>
+
+int TileScheduler::begin(int width, int height) {
+  float elapsed_ms;
+  while (!batches.empty() && timer.poll(elapsed_ms)) {
+    float per_tile = elapsed_ms / (float)batches.front();
+    batches.pop_front();
+    if (stale > 0) {
+      --stale;
+      continue;
+    }
+    estimate_ms = estimate_ms == 0.0f
+                      ? per_tile
+                      : estimate_ms * 0.5f + per_tile * 0.5f;
+  }
+
+  int size = std::max(tile_size, 8);
+  int new_columns = (width + size - 1) / size;
+  int new_rows = (height + size - 1) / size;
+  if (new_columns != columns || new_rows != rows) {
+    reset_estimate();
+  }
+  columns = new_columns;
+  rows = new_rows;
+  target_width = width;
+  target_height = height;
+
+  // Resume after the tiles drawn last frame. With no estimate yet, a single
+  // tile is the safe guess.
+  first = (first + picked) % tile_count();
+  picked = 1;
+  if (estimate_ms > 0.0f) {
+    picked = std::min(std::max((int)(budget_ms / estimate_ms), 1),
+                      tile_count());
+  }
+
+  // GpuTimer drops its oldest span rather than stall once all are in
+  // flight; drop the matching count.
+  if ((int)batches.size() == GpuTimer::kLatency) {
+    batches.pop_front();
+    stale = std::max(stale - 1, 0);
+  }
+  batches.push_back(picked);
+  timer.begin();
+  return picked;
+}
+
+void TileScheduler::rect(int index, int out[4]) const {
+  int size = std::max(tile_size, 8);
+  int tile = (first + index) % tile_count();
+  int x = (tile % columns) * size;
+  int y = (tile / columns) * size;
+  out[0] = x;
+  out[1] = y;
+  out[2] = std::min(size, target_width - x);
+  out[3] = std::min(size, target_height - y);
+}
+
+void TileScheduler::end() { timer.end(); }
+
+void TileScheduler::reset_estimate() {
+  estimate_ms = 0.0f;
+  // Batches already in flight measured the old work.
+  stale = (int)batches.size();
+}